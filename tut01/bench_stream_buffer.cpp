@@ -0,0 +1,189 @@
+//
+// Benchmark: MB/s of vertex data streamed to the GPU with each
+// stream_buffer strategy, against client side arrays as render() used to.
+// Build with `make bench_stream_buffer`.
+//
+
+#include "stream_buffer.h"
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const GLsizeiptr FRAME_BYTES = 4 << 20;
+const GLsizeiptr CHUNK_BYTES = 64 << 10;
+const int FRAMES = 64;
+const int WARMUP_FRAMES = 4;
+// vec2 positions.
+const GLsizei VERTEX_BYTES = 2 * sizeof(GLfloat);
+
+GLint attribute_coord2d;
+
+GLuint create_program()
+{
+	// Every point lands outside the viewport, so the GPU only has to
+	// read the vertices, not rasterize anything.
+	const char *vs_source =
+		"#version 120\n"
+		"attribute vec2 coord2d;\n"
+		"void main(void) {\n"
+		"	gl_Position = vec4(coord2d, 0.0, 1.0);\n"
+		"}";
+	const char *fs_source =
+		"#version 120\n"
+		"void main(void) {\n"
+		"	gl_FragColor = vec4(0.0, 0.0, 1.0, 1.0);\n"
+		"}";
+
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, &vs_source, NULL);
+	glCompileShader(vs);
+	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, &fs_source, NULL);
+	glCompileShader(fs);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint link_ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+	if (!link_ok) {
+		cerr << "Error in glLinkProgram" << endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+//
+// Write and draw one frame of chunks, from stream when given or from
+// client side arrays otherwise.
+//
+void stream_frame(stream_buffer *stream, const std::vector<GLfloat> &source)
+{
+	const char *src = (const char *)source.data();
+	for (GLsizeiptr done = 0; done < FRAME_BYTES; done += CHUNK_BYTES) {
+		const GLvoid *pointer = src + done;
+		if (stream != nullptr) {
+			GLintptr offset;
+			void *data = stream->map(CHUNK_BYTES, &offset);
+			if (data == nullptr)
+				return;
+
+			memcpy(data, src + done, CHUNK_BYTES);
+			stream->unmap();
+			glBindBuffer(GL_ARRAY_BUFFER, stream->buffer());
+			pointer = (const GLvoid *)offset;
+		}
+
+		glVertexAttribPointer(attribute_coord2d, 2, GL_FLOAT, GL_FALSE,
+				0, pointer);
+
+		glDrawArrays(GL_POINTS, 0, CHUNK_BYTES / VERTEX_BYTES);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	if (stream != nullptr)
+		stream->end_frame();
+}
+
+void run(const char *name, stream_buffer *stream,
+		const std::vector<GLfloat> &source)
+{
+	for (int i = 0; i < WARMUP_FRAMES; ++i)
+		stream_frame(stream, source);
+
+	glFinish();
+	unsigned long stalls = stream != nullptr ? stream->stalls() : 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < FRAMES; ++i)
+		stream_frame(stream, source);
+
+	glFinish();
+	double s = (double)(SDL_GetPerformanceCounter() - start) /
+		SDL_GetPerformanceFrequency();
+
+	if (stream != nullptr)
+		stalls = stream->stalls() - stalls;
+
+	double mb = (double)FRAME_BYTES * FRAMES / (1 << 20);
+	cout << name << "," << FRAME_BYTES / (1 << 20) << "," << FRAMES
+		<< "," << s * 1000.0 << "," << mb / s << "," << stalls
+		<< endl;
+}
+
+// End of anon namespace.
+}
+
+int main()
+{
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow("bench_stream_buffer",
+						SDL_WINDOWPOS_CENTERED,
+						SDL_WINDOWPOS_CENTERED,
+						64,
+						64,
+						SDL_WINDOW_HIDDEN |
+						SDL_WINDOW_OPENGL);
+
+	if (window == nullptr || SDL_GL_CreateContext(window) == nullptr) {
+		cerr << "Error: can't create a GL window: " << SDL_GetError()
+			<< endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (glewInit() != GLEW_OK || !GLEW_VERSION_2_0) {
+		cerr << "Error: OpenGL 2.0 is required" << endl;
+		return EXIT_FAILURE;
+	}
+
+	GLuint program = create_program();
+	if (program == 0)
+		return EXIT_FAILURE;
+
+	glUseProgram(program);
+	attribute_coord2d = glGetAttribLocation(program, "coord2d");
+	glEnableVertexAttribArray(attribute_coord2d);
+
+	std::vector<GLfloat> source(FRAME_BYTES / sizeof(GLfloat), 2.0f);
+
+	cout << "strategy,frame_mb,frames,ms,mb_s,stalls" << endl;
+	run("client_array", nullptr, source);
+
+	const stream_strategy strategies[] = {
+		STREAM_ORPHAN, STREAM_UNSYNCHRONIZED, STREAM_PERSISTENT
+	};
+	for (stream_strategy strategy : strategies) {
+		if (!stream_buffer::supported(strategy))
+			continue;
+
+		stream_buffer stream;
+		if (stream.init(FRAME_BYTES, strategy)) {
+			run(stream_buffer::strategy_name(strategy), &stream,
+				source);
+		}
+	}
+
+	glDisableVertexAttribArray(attribute_coord2d);
+	glDeleteProgram(program);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+//
+// Source implementation file for streaming per-frame vertex data.
+//
+
+#include "stream_buffer.h"
+
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Give up waiting on a fence after a second, the GPU is likely gone.
+const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+// End of anon namespace.
+}
+
+stream_buffer::stream_buffer()
+	: mode(STREAM_ORPHAN), id(0), region_size(0), region(0), head(0),
+	region_ready(false), persistent(nullptr), mapped(false),
+	mapped_offset(0), mapped_size(0), waits(0)
+{
+	for (GLsync &fence : fences)
+		fence = 0;
+}
+
+stream_buffer::~stream_buffer()
+{
+	destroy();
+}
+
+bool stream_buffer::init(GLsizeiptr frame_size, stream_strategy strategy)
+{
+	destroy();
+	if (!supported(strategy)) {
+		cerr << "Streaming strategy " << strategy_name(strategy)
+			<< " isn't supported" << endl;
+
+		return false;
+	}
+
+	mode = strategy;
+	region_size = frame_size;
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+	if (mode == STREAM_PERSISTENT) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+			GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_ARRAY_BUFFER, REGIONS * region_size,
+				nullptr, flags);
+
+		persistent = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+						REGIONS * region_size, flags);
+	} else if (mode == STREAM_UNSYNCHRONIZED) {
+		glBufferData(GL_ARRAY_BUFFER, REGIONS * region_size, nullptr,
+				GL_STREAM_DRAW);
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, region_size, nullptr,
+				GL_STREAM_DRAW);
+
+		staging.resize(region_size);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (mode == STREAM_PERSISTENT && persistent == nullptr) {
+		cerr << "Error mapping the stream buffer" << endl;
+		destroy();
+		return false;
+	}
+
+	return true;
+}
+
+//
+// First write of a frame: make sure the GPU is done with the region.
+//
+void stream_buffer::begin_region()
+{
+	region_ready = true;
+	if (mode == STREAM_ORPHAN) {
+		glBufferData(GL_ARRAY_BUFFER, region_size, nullptr,
+				GL_STREAM_DRAW);
+
+		return;
+	}
+
+	GLsync &fence = fences[region];
+	if (fence == 0)
+		return;
+
+	GLenum res = glClientWaitSync(fence, 0, 0);
+	if (res == GL_TIMEOUT_EXPIRED) {
+		++waits;
+		res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+				FENCE_TIMEOUT_NS);
+	}
+
+	if (res == GL_WAIT_FAILED || res == GL_TIMEOUT_EXPIRED)
+		cerr << "Error waiting for a stream buffer fence" << endl;
+
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+void *stream_buffer::map(GLsizeiptr size, GLintptr *offset)
+{
+	if (id == 0 || head + size > region_size)
+		return nullptr;
+
+	if (mode != STREAM_PERSISTENT)
+		glBindBuffer(GL_ARRAY_BUFFER, id);
+
+	if (!region_ready)
+		begin_region();
+
+	GLintptr start = head;
+	if (mode != STREAM_ORPHAN)
+		start += region * region_size;
+
+	head += size;
+	*offset = start;
+	if (mode == STREAM_PERSISTENT)
+		return persistent + start;
+
+	mapped_offset = start;
+	mapped_size = size;
+	if (mode == STREAM_ORPHAN) {
+		mapped = true;
+		return staging.data() + start;
+	}
+
+	void *res = glMapBufferRange(GL_ARRAY_BUFFER, start, size,
+				GL_MAP_WRITE_BIT |
+				GL_MAP_UNSYNCHRONIZED_BIT |
+				GL_MAP_INVALIDATE_RANGE_BIT);
+
+	mapped = res != nullptr;
+
+	return res;
+}
+
+void stream_buffer::unmap()
+{
+	if (!mapped)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+	if (mode == STREAM_ORPHAN) {
+		glBufferSubData(GL_ARRAY_BUFFER, mapped_offset, mapped_size,
+				staging.data() + mapped_offset);
+	} else {
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	mapped = false;
+}
+
+void stream_buffer::end_frame()
+{
+	if (id == 0 || !region_ready)
+		return;
+
+	if (mode != STREAM_ORPHAN) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % REGIONS;
+	}
+
+	head = 0;
+	region_ready = false;
+}
+
+void stream_buffer::destroy()
+{
+	for (GLsync &fence : fences) {
+		if (fence != 0)
+			glDeleteSync(fence);
+
+		fence = 0;
+	}
+
+	if (id != 0) {
+		unmap();
+		if (persistent != nullptr) {
+			glBindBuffer(GL_ARRAY_BUFFER, id);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(1, &id);
+	}
+
+	id = 0;
+	persistent = nullptr;
+	staging.clear();
+	region = 0;
+	head = 0;
+	region_ready = false;
+}
+
+bool stream_buffer::supported(stream_strategy strategy)
+{
+	bool sync = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	bool map_range = GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range;
+	switch (strategy) {
+	case STREAM_PERSISTENT:
+		return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) &&
+			map_range && sync;
+	case STREAM_UNSYNCHRONIZED:
+		return map_range && sync;
+	default:
+		return GLEW_VERSION_1_5;
+	}
+}
+
+stream_strategy stream_buffer::best_strategy()
+{
+	if (supported(STREAM_PERSISTENT))
+		return STREAM_PERSISTENT;
+
+	if (supported(STREAM_UNSYNCHRONIZED))
+		return STREAM_UNSYNCHRONIZED;
+
+	return STREAM_ORPHAN;
+}
+
+const char *stream_buffer::strategy_name(stream_strategy strategy)
+{
+	switch (strategy) {
+	case STREAM_PERSISTENT:
+		return "persistent";
+	case STREAM_UNSYNCHRONIZED:
+		return "unsynchronized";
+	default:
+		return "orphan";
+	}
+}
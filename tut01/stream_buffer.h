@@ -0,0 +1,101 @@
+#ifndef STREAM_BUFFER
+#define STREAM_BUFFER
+
+//
+// Header file for streaming per-frame vertex data.
+//
+// A stream_buffer is a ring of three frame sized regions in one buffer
+// object. Each frame writes into its own region, and a fence placed at
+// end_frame() tells when the GPU is done reading it, so by the time the
+// ring comes back around the region can be written without waiting.
+// How the memory is reached depends on what the context offers:
+//
+//  - persistent: GL 4.4 or ARB_buffer_storage. The whole ring is mapped
+//    once, coherently, and stays mapped.
+//  - unsynchronized: GL 3.2, or ARB_map_buffer_range plus ARB_sync. Each
+//    write maps its range with GL_MAP_UNSYNCHRONIZED_BIT, and the fences
+//    do the synchronization instead of the driver.
+//  - orphan: anything else. The buffer is a single region, and every frame
+//    starts by orphaning it with glBufferData(NULL), so the driver hands
+//    out fresh storage instead of waiting for the old one. Writes go to
+//    memory of our own and are copied in with glBufferSubData on unmap().
+//
+
+#include <GL/glew.h>
+
+#include <vector>
+
+enum stream_strategy {
+	STREAM_PERSISTENT,
+	STREAM_UNSYNCHRONIZED,
+	STREAM_ORPHAN
+};
+
+class stream_buffer {
+public:
+	stream_buffer();
+	~stream_buffer();
+
+	stream_buffer(const stream_buffer &) = delete;
+	stream_buffer &operator=(const stream_buffer &) = delete;
+
+	//
+	// Create the buffer, with room for frame_size bytes per frame.
+	// Returns false if the strategy isn't supported.
+	//
+	bool init(GLsizeiptr frame_size,
+			stream_strategy strategy = best_strategy());
+
+	//
+	// Room for size bytes in this frame's region. Returns nullptr when
+	// the region is full, otherwise the data goes at offset in buffer().
+	// NOTE: call unmap() before drawing from it.
+	//
+	void *map(GLsizeiptr size, GLintptr *offset);
+	void unmap();
+
+	//
+	// Fence what this frame wrote and move on to the next region.
+	//
+	void end_frame();
+
+	GLuint buffer() const { return id; }
+	stream_strategy strategy() const { return mode; }
+
+	//
+	// Number of times a region was still in use by the GPU when a new
+	// frame wanted to write it.
+	//
+	unsigned long stalls() const { return waits; }
+
+	void destroy();
+
+	static bool supported(stream_strategy strategy);
+	static stream_strategy best_strategy();
+	static const char *strategy_name(stream_strategy strategy);
+
+private:
+	static const int REGIONS = 3;
+
+	void begin_region();
+
+	stream_strategy mode;
+	GLuint id;
+	GLsizeiptr region_size;
+	int region;
+	GLsizeiptr head;
+	// Whether this frame already waited for (or orphaned) its region.
+	bool region_ready;
+	// Whole ring, for the persistent strategy.
+	char *persistent;
+	// Range written since the last unmap() that still has to reach GL.
+	bool mapped;
+	GLintptr mapped_offset;
+	GLsizeiptr mapped_size;
+	// Where orphan writes go before glBufferSubData.
+	std::vector<char> staging;
+	GLsync fences[REGIONS];
+	unsigned long waits;
+};
+
+#endif // STREAM_BUFFER
@@ -1,7 +1,13 @@
+#include "display.h"
+#include "frame_profile.h"
+#include "gpu_profile.h"
+#include "stream_buffer.h"
+
 #include <GL/glew.h> // glew.h rather than gl.h for declarations.
 #include <SDL.h> // SDL2 for base window and OpenGL context init.
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 using std::cerr;
@@ -13,6 +19,14 @@ GLuint program;
 // Input variable for the vertex shader.
 GLint attribute_coord2d;
 
+// Bytes of vertices that can be written per frame.
+const GLsizeiptr STREAM_FRAME_SIZE = 4096;
+// Where the vertices are written every frame.
+stream_buffer stream;
+
+// Window, or offscreen framebuffer when running headless.
+display screen;
+
 //
 // Initiate resources.
 // NOTE: I probably would have done something like write my own shader
@@ -82,17 +96,25 @@ bool init_resources()
 		return false;
 	}
 
-	return true;
+	return stream.init(STREAM_FRAME_SIZE);
 }
 
 //
 // Render all in window.
 //
-void render(SDL_Window *window)
+void render()
 {
+	FRAME_PROFILE_SCOPE(PHASE_RENDER);
+	GPU_PROFILE_SCOPE("render");
+
 	// Make the background white to start.
-	glClearColor(1.0, 1.0, 1.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	{
+		GPU_PROFILE_SCOPE("clear");
+		glClearColor(1.0, 1.0, 1.0, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	GPU_PROFILE_SCOPE("draw");
 
 	// Tell it to use the GLSL program that we made.
 	glUseProgram(program);
@@ -105,20 +127,31 @@ void render(SDL_Window *window)
 		0.8, -0.8
 	};
 
-	// Describe our vertices array to OpenGL (it can't guess the format).
-	glVertexAttribPointer(attribute_coord2d, // attribute
-				2, // number of elements per vertex.
-				GL_FLOAT, // type of each element.
-				GL_FALSE, // take the values as-is.
-				0, // no extra data between each position.
-				triangle_vertices); // pointer to the array.
+	// Copy them into this frame's part of the stream buffer, rather than
+	// having the driver copy a client side array on every draw.
+	GLintptr offset;
+	void *data = stream.map(sizeof(triangle_vertices), &offset);
+	if (data != nullptr) {
+		memcpy(data, triangle_vertices, sizeof(triangle_vertices));
+		stream.unmap();
+
+		// Describe our vertices array to OpenGL (it can't guess the
+		// format).
+		glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+		glVertexAttribPointer(attribute_coord2d, // attribute
+					2, // number of elements per vertex.
+					GL_FLOAT, // type of each element.
+					GL_FALSE, // take the values as-is.
+					0, // no extra data between each position.
+					(GLvoid *)offset); // offset in the buffer.
+
+		// Push each element in triangle_vertics into the vertex shader.
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-	// Push each element in triangle_vertics into the vertex shader.
-	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glDisableVertexAttribArray(attribute_coord2d);
-
-	// Display the result.
-	SDL_GL_SwapWindow(window);
+	stream.end_frame();
 }
 
 //
@@ -126,60 +159,79 @@ void render(SDL_Window *window)
 //
 void free_resources()
 {
+	stream.destroy();
 	glDeleteProgram(program);
 }
 
+//
+// Handle the events queued since the last frame. Returns false on quit.
+//
+bool handle_events()
+{
+	FRAME_PROFILE_SCOPE(PHASE_EVENTS);
+
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev)) {
+		if (ev.type == SDL_QUIT)
+			return false;
+
+		// P writes out the frame profile so far.
+		if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_p)
+			FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+	}
+
+	return true;
+}
+
 //
 // Main loop that keeps rendering.
 //
-void main_loop(SDL_Window *window)
+void main_loop()
 {
-	while (true) {
-		SDL_Event ev;
-		while (SDL_PollEvent(&ev)) {
-			if (ev.type == SDL_QUIT)
-				return;
-		}
-
-		render(window);
+	while (!screen.done() && handle_events()) {
+		GPU_PROFILE_BEGIN_FRAME();
+		render();
+
+		// Display the result.
+		screen.swap();
+		GPU_PROFILE_END_FRAME();
+		FRAME_PROFILE_END_FRAME();
 	}
 }
 
 //
-// Driver.
+// Driver. Only takes the display flags.
 //
-int main()
+int main(int argc, char *argv[])
 {
-	// SDL initialization.
-	SDL_Init(SDL_INIT_VIDEO);
-	// Window initialization.
-	SDL_Window *window = SDL_CreateWindow("My First Triangle",
-						SDL_WINDOWPOS_CENTERED,
-						SDL_WINDOWPOS_CENTERED,
-						640,
-						480,
-						SDL_WINDOW_RESIZABLE |
-						SDL_WINDOW_OPENGL);
-
-	SDL_GL_CreateContext(window);
-	// Extension wrangler initializing.
-	GLenum glew_status = glewInit();
-	if (glew_status != GLEW_OK) {
-		cerr << "Error: glewInit: " << endl;
+	if (!screen.parse_args(argc, argv) || argc > 1) {
+		cerr << "Usage: triangle " << display::usage() << endl;
 		return EXIT_FAILURE;
 	}
 
+	// Window (or offscreen framebuffer), context and extensions.
+	if (!screen.open("My First Triangle", 640, 480))
+		return EXIT_FAILURE;
+
 	// When all of the init functiona have run without errors,
 	// the program can initialize the resources.
 	if (!init_resources())
 		return EXIT_FAILURE;
 
+	GPU_PROFILE_INIT();
+
 	// If everything has gone okay, we can display something.
-	main_loop(window);
+	main_loop();
+
+	screen.print_report();
+	FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+	GPU_PROFILE_WRITE(GPU_PROFILE_FILE);
 
 	// If the program exits in the usual way, free resources
 	// and exit success.
 	free_resources();
+	GPU_PROFILE_DESTROY();
+	screen.close();
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,4 @@
+// Declarations shared by both triangle stages.
+#ifdef VERTEX_COLOR
+varying vec3 f_color;
+#endif
@@ -1,8 +1,22 @@
 #version 120
+#include "triangle.common.glsl"
+#ifdef FADE
+uniform float fade;
+#endif
 void main(void)
 {
-	gl_FragColor[0] = 0.0;
-	gl_FragColor[1] = 0.0;
-	gl_FragColor[2] = 1.0;
-	gl_FragColor[3] = floor(mod(gl_FragCoord.y, 2.0));
+#ifdef VERTEX_COLOR
+	vec3 color = f_color;
+#else
+	vec3 color = vec3(0.0, 0.0, 1.0);
+#endif
+	float alpha = 1.0;
+#ifdef FADE
+	alpha = fade;
+#endif
+#ifdef STRIPES
+	// Every other line is see-through.
+	alpha *= floor(mod(gl_FragCoord.y, 2.0));
+#endif
+	gl_FragColor = vec4(color, alpha);
 }
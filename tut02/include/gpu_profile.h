@@ -0,0 +1,101 @@
+#ifndef GPU_PROFILE
+#define GPU_PROFILE
+
+//
+// Header file for the GPU timer markers.
+//
+// When GPU_PROFILE_MARKERS is defined, GPU_PROFILE_SCOPE(name) brackets
+// the GL commands of the rest of its block with two GL_TIMESTAMP queries,
+// so markers can nest. Queries come from a pool of GPU_PROFILE_FRAMES
+// frames and a frame's results are only read when its slot comes around
+// again, if the GPU says they are available; a frame still not done by
+// then is dropped rather than waited for, so the pipeline never stalls.
+// The frame_profile phases are recorded alongside as CPU events, and
+// GPU_PROFILE_WRITE() saves both timelines as a Chrome trace (load it in
+// chrome://tracing or ui.perfetto.dev). Without GPU_PROFILE_MARKERS every
+// macro expands to nothing.
+//
+// Needs GL 3.3 or ARB_timer_query for the GPU side; without it only the
+// CPU events are traced. The markers and frames belong to the thread with
+// the context; CPU events can come from any thread, each on its own track.
+//
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+// Where the tutorials write the trace.
+const char * const GPU_PROFILE_FILE = "frame_trace.json";
+
+#ifdef GPU_PROFILE_MARKERS
+
+// Frames of queries in flight, results are read this many frames late.
+const int GPU_PROFILE_FRAMES = 4;
+// Markers recorded per frame, the rest are ignored.
+const int GPU_PROFILE_MARKERS_PER_FRAME = 32;
+
+//
+// Set up the query pool and align the GPU clock with the CPU one.
+// Needs the GL context current.
+//
+void gpu_profile_init();
+
+//
+// Bracket a frame. begin reads back the frame that last used the slot.
+//
+void gpu_profile_begin_frame();
+void gpu_profile_end_frame();
+
+//
+// Open and close a marker; names must outlive the profiler.
+//
+void gpu_profile_push(const char *name);
+void gpu_profile_pop();
+
+//
+// Add a CPU event, in SDL_GetPerformanceCounter() ticks, to the trace of
+// the calling thread.
+//
+void gpu_profile_cpu_event(const char *name, Uint64 start, Uint64 end);
+
+//
+// Wait for the frames in flight and write everything as a Chrome trace.
+//
+bool gpu_profile_write(const char *filename);
+
+//
+// Delete the queries. Needs the GL context current.
+//
+void gpu_profile_destroy();
+
+class gpu_profile_scope {
+public:
+	explicit gpu_profile_scope(const char *name) { gpu_profile_push(name); }
+	~gpu_profile_scope() { gpu_profile_pop(); }
+
+	gpu_profile_scope(const gpu_profile_scope &) = delete;
+	gpu_profile_scope &operator=(const gpu_profile_scope &) = delete;
+};
+
+// One variable per line, so that scopes can follow each other in a block.
+#define GPU_PROFILE_VARIABLE(line) gpu_profile_scope_##line
+#define GPU_PROFILE_SCOPE_AT(name, line) \
+	gpu_profile_scope GPU_PROFILE_VARIABLE(line)(name)
+#define GPU_PROFILE_SCOPE(name) GPU_PROFILE_SCOPE_AT(name, __LINE__)
+#define GPU_PROFILE_INIT() gpu_profile_init()
+#define GPU_PROFILE_BEGIN_FRAME() gpu_profile_begin_frame()
+#define GPU_PROFILE_END_FRAME() gpu_profile_end_frame()
+#define GPU_PROFILE_WRITE(filename) gpu_profile_write(filename)
+#define GPU_PROFILE_DESTROY() gpu_profile_destroy()
+
+#else
+
+#define GPU_PROFILE_SCOPE(name) do {} while (0)
+#define GPU_PROFILE_INIT() do {} while (0)
+#define GPU_PROFILE_BEGIN_FRAME() do {} while (0)
+#define GPU_PROFILE_END_FRAME() do {} while (0)
+#define GPU_PROFILE_WRITE(filename) do {} while (0)
+#define GPU_PROFILE_DESTROY() do {} while (0)
+
+#endif // GPU_PROFILE_MARKERS
+
+#endif // GPU_PROFILE
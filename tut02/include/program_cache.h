@@ -0,0 +1,58 @@
+#ifndef PROGRAM_CACHE
+#define PROGRAM_CACHE
+
+//
+// Header file for the on-disk GLSL program binary cache.
+// Programs are keyed on a hash of their vertex and fragment sources and
+// the driver strings, so any mismatch simply misses and recompiles.
+//
+
+#include "asset_file.h"
+
+#include <GL/glew.h>
+
+// Directory (relative to the working directory) holding cached binaries.
+#define PROGRAM_CACHE_DIR ".program_cache"
+
+//
+// Counters used for the startup timing report.
+//
+struct program_cache_stats {
+	int hits; // programs restored with glProgramBinary.
+	int misses; // programs compiled and linked from source.
+	double ms; // total time spent submitting and waiting on programs.
+};
+
+//
+// Program binaries need GL 4.1 or ARB_get_program_binary,
+// plus at least one binary format exposed by the driver.
+//
+bool program_binary_supported();
+
+//
+// Key a program on both sources and on the driver that produced it.
+//
+GLuint64 program_cache_key(asset_view vs_source, asset_view fs_source);
+
+//
+// Restore a program from disk. Returns 0 when there is no usable entry.
+//
+GLuint load_program_binary(GLuint64 key);
+
+//
+// Write the binary of a linked program to disk.
+// The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+//
+void store_program_binary(GLuint program, GLuint64 key);
+
+//
+// Counters accumulated by the shader queue so far.
+//
+program_cache_stats &get_program_cache_stats();
+
+//
+// Print a one line cold-vs-warm startup report to stdout.
+//
+void print_program_cache_report();
+
+#endif // PROGRAM_CACHE
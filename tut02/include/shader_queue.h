@@ -0,0 +1,85 @@
+#ifndef SHADER_QUEUE
+#define SHADER_QUEUE
+
+//
+// Header file for the asynchronous GLSL program build queue.
+//
+// Every stage and program is handed to the driver up front by submit()
+// without reading back any status, so drivers exposing
+// KHR_parallel_shader_compile can build them concurrently. Status is only
+// checked (and errors printed) the first time program() is called.
+//
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+//
+// Queue of programs built from a vertex and a fragment shader file.
+//
+class shader_queue {
+public:
+	shader_queue();
+	~shader_queue();
+
+	shader_queue(const shader_queue &) = delete;
+	shader_queue &operator=(const shader_queue &) = delete;
+
+	//
+	// Queue a program and return the ticket used to fetch it later.
+	// Both stages are preprocessed with the given #define flags.
+	//
+	int add_program(const char *vs_filename,
+			const char *fs_filename,
+			const std::vector<std::string> &defines =
+				std::vector<std::string>());
+
+	//
+	// Hand every queued stage and program to the driver without waiting.
+	// Programs found in the program binary cache are restored instead.
+	//
+	void submit();
+
+	//
+	// True when program() would not block. Without parallel compile
+	// support the driver can't tell, so this is always true.
+	//
+	bool ready(int ticket) const;
+
+	//
+	// Wait for the program to finish linking and return it, or 0 if
+	// reading, compiling or linking failed. The caller owns the program.
+	//
+	GLuint program(int ticket);
+
+private:
+	struct entry {
+		std::string vs_filename;
+		std::string fs_filename;
+		std::vector<std::string> defines;
+		GLuint vs;
+		GLuint fs;
+		GLuint program;
+		GLuint64 key;
+		bool submitted;
+		bool from_cache;
+		bool resolved;
+	};
+
+	void submit_stages(entry &e);
+	void resolve(entry &e);
+
+	std::vector<entry> entries;
+	bool initialized;
+	bool parallel;
+	bool use_cache;
+};
+
+//
+// Build a single program right away through a one-entry queue.
+// Returns 0 on error.
+//
+GLuint create_program(const char *vs_filename, const char *fs_filename);
+
+#endif // SHADER_QUEUE
@@ -0,0 +1,64 @@
+#ifndef SHADER_VARIANTS
+#define SHADER_VARIANTS
+
+//
+// Header file for memoized shader permutations.
+//
+// A variant is a vertex/fragment pair plus a set of #define flags. Each
+// distinct flag set is built once and handed out again on every later
+// request, so picking variants at runtime only costs a map lookup.
+//
+
+#include "shader_queue.h"
+
+#include <GL/glew.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class shader_variants {
+public:
+	shader_variants() = default;
+	shader_variants(const shader_variants &) = delete;
+	shader_variants &operator=(const shader_variants &) = delete;
+
+	//
+	// Declare a variant that precompile() should build.
+	//
+	void declare(const char *vs_filename,
+			const char *fs_filename,
+			const std::vector<std::string> &defines);
+
+	//
+	// Submit every declared variant to the driver in one batch.
+	// Does not wait; get() blocks on a variant the first time only.
+	//
+	void precompile();
+
+	//
+	// Program for a variant, built on first use. The flag order doesn't
+	// matter. Returns 0 on error. The programs stay owned by this object.
+	//
+	GLuint get(const char *vs_filename,
+			const char *fs_filename,
+			const std::vector<std::string> &defines);
+
+	//
+	// Delete every program built or declared so far.
+	// Must be called while the GL context is still current.
+	//
+	void clear();
+
+private:
+	static std::string variant_key(const char *vs_filename,
+				const char *fs_filename,
+				const std::vector<std::string> &defines);
+
+	shader_queue queue;
+	// Queue tickets of declared variants not fetched yet.
+	std::map<std::string, int> pending;
+	std::map<std::string, GLuint> programs;
+};
+
+#endif // SHADER_VARIANTS
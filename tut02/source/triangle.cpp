@@ -1,4 +1,9 @@
-#include "../include/shader_utils.h"
+#include "../include/display.h"
+#include "../include/frame_profile.h"
+#include "../include/gl_state.h"
+#include "../include/gpu_profile.h"
+#include "../include/program_cache.h"
+#include "../include/shader_variants.h"
 
 #include <SDL.h> // SDL2 for base window and OpenGL context init.
 
@@ -11,9 +16,19 @@ using std::endl;
 // Constants.
 const char * const TRIANGLE_VERTEX_SHADER = "glsl/triangle.v.glsl";
 const char * const TRIANGLE_FRAGMENT_SHADER = "glsl/triangle.f.glsl";
+// Features of the shared triangle shaders this tutorial uses.
+const std::vector<std::string> TRIANGLE_FEATURES = {
+	"STRIPES"
+};
 
 // GLSL program handle
 GLuint program;
+// Drops binds and state changes that are already in effect.
+gl_state state;
+// Window, or offscreen framebuffer when running headless.
+display screen;
+// Every permutation of the triangle shaders built so far.
+shader_variants variants;
 // Triangle VBO handle.
 GLuint vbo_triangle;
 
@@ -31,6 +46,13 @@ GLint attribute_coord2d;
 //
 bool init_resources()
 {
+	// Start building the GLSL program first, so that compiling and linking
+	// overlap with the buffer uploads below.
+	variants.declare(TRIANGLE_VERTEX_SHADER,
+			TRIANGLE_FRAGMENT_SHADER,
+			TRIANGLE_FEATURES);
+	variants.precompile();
+
 	// Set the triangle vertices and load them to the GPU.
 	GLfloat triangle_vertices[] = {
 		0.0, 0.8,
@@ -45,29 +67,12 @@ bool init_resources()
 			triangle_vertices,
 			GL_STATIC_DRAW);
 
-	GLuint vs, fs;
-	if ((vs = create_shader(TRIANGLE_VERTEX_SHADER, GL_VERTEX_SHADER)) == 0)
-		return false;
-
-	if ((fs = create_shader(TRIANGLE_FRAGMENT_SHADER,
-				GL_FRAGMENT_SHADER)) == 0) {
-
+	// First use of the program, which waits for the driver if needed.
+	program = variants.get(TRIANGLE_VERTEX_SHADER,
+				TRIANGLE_FRAGMENT_SHADER,
+				TRIANGLE_FEATURES);
+	if (program == 0)
 		return false;
-	}
-
-	// Create the GLSL program by linking the vertex
-	// and the fragment shaders.
-	program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	GLint link_ok = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-	if (link_ok == GL_FALSE) {
-		cerr << "glLinkProgram: ";
-		print_log(program);
-		return false;
-	}
 
 	// Tell the GLSL program where its input is.
 	const char *attribute_name = "coord2d";
@@ -83,19 +88,27 @@ bool init_resources()
 //
 // Render all in window.
 //
-void render(SDL_Window *window)
+void render()
 {
+	FRAME_PROFILE_SCOPE(PHASE_RENDER);
+	GPU_PROFILE_SCOPE("render");
+
 	// Enable Alpha
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.enable(GL_BLEND);
+	state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Make the background white to start.
-	glClearColor(1.0, 1.0, 1.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	{
+		GPU_PROFILE_SCOPE("clear");
+		state.clear_color(1.0, 1.0, 1.0, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	GPU_PROFILE_SCOPE("draw");
 
 	// Tell it to use the GLSL program that we made.
-	glUseProgram(program);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_triangle);
+	state.use_program(program);
+	state.bind_buffer(GL_ARRAY_BUFFER, vbo_triangle);
 	glEnableVertexAttribArray(attribute_coord2d);
 
 	// Describe our vertices array to OpenGL (it can't guess the format).
@@ -109,9 +122,6 @@ void render(SDL_Window *window)
 	// Push each element in triangle_vertics into the vertex shader.
 	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glDisableVertexAttribArray(attribute_coord2d);
-
-	// Display the result.
-	SDL_GL_SwapWindow(window);
 }
 
 //
@@ -119,66 +129,59 @@ void render(SDL_Window *window)
 //
 void free_resources()
 {
-	glDeleteProgram(program);
+	variants.clear();
 	glDeleteBuffers(1, &vbo_triangle);
 }
 
 //
-// Main loop that keeps rendering.
+// Handle the events queued since the last frame. Returns false on quit.
 //
-void main_loop(SDL_Window *window)
+bool handle_events()
 {
-	while (true) {
-		SDL_Event ev;
-		while (SDL_PollEvent(&ev)) {
-			if (ev.type == SDL_QUIT)
-				return;
-		}
-
-		render(window);
+	FRAME_PROFILE_SCOPE(PHASE_EVENTS);
+
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev)) {
+		if (ev.type == SDL_QUIT)
+			return false;
+
+		// P writes out the frame profile so far.
+		if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_p)
+			FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
 	}
+
+	return true;
 }
 
 //
-// Driver.
+// Main loop that keeps rendering.
 //
-int main()
+void main_loop()
 {
-	// SDL initialization.
-	SDL_Init(SDL_INIT_VIDEO);
-	// Window initialization.
-	SDL_Window *window = SDL_CreateWindow("My First Triangle",
-						SDL_WINDOWPOS_CENTERED,
-						SDL_WINDOWPOS_CENTERED,
-						640,
-						480,
-						SDL_WINDOW_RESIZABLE |
-						SDL_WINDOW_OPENGL);
-
-	// Some SDL error handling.
-	if (window == nullptr) {
-		cerr << "Error: can't create window: " << SDL_GetError()
-			<< endl;
-
-		return EXIT_FAILURE;
+	while (!screen.done() && handle_events()) {
+		GPU_PROFILE_BEGIN_FRAME();
+		render();
+
+		// Display the result.
+		screen.swap();
+		GPU_PROFILE_END_FRAME();
+		FRAME_PROFILE_END_FRAME();
 	}
+}
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 1);
-
-	if (SDL_GL_CreateContext(window) == nullptr) {
-		cerr << "Error: SDL_GL_CreateContext: " 
-			<< SDL_GetError() << endl;
-
+//
+// Driver. Only takes the display flags.
+//
+int main(int argc, char *argv[])
+{
+	if (!screen.parse_args(argc, argv) || argc > 1) {
+		cerr << "Usage: triangle " << display::usage() << endl;
 		return EXIT_FAILURE;
 	}
 
-	// Extension wrangler initializing.
-	GLenum glew_status = glewInit();
-	if (glew_status != GLEW_OK) {
-		cerr << "Error: glewInit: " << endl;
+	// Window (or offscreen framebuffer), context and extensions.
+	if (!screen.open("My First Triangle", 640, 480))
 		return EXIT_FAILURE;
-	}
 
 	if (!GLEW_VERSION_2_0) {
 		cerr << "Error: your graphics card doesn't support OpenGL 2.0"
@@ -192,12 +195,23 @@ int main()
 	if (!init_resources())
 		return EXIT_FAILURE;
 
+	print_program_cache_report();
+
+	GPU_PROFILE_INIT();
+
 	// If everything has gone okay, we can display something.
-	main_loop(window);
+	main_loop();
+
+	state.print_report();
+	screen.print_report();
+	FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+	GPU_PROFILE_WRITE(GPU_PROFILE_FILE);
 
 	// If the program exits in the usual way, free resources
 	// and exit success.
 	free_resources();
+	GPU_PROFILE_DESTROY();
+	screen.close();
 
 	return EXIT_SUCCESS;
 }
@@ -1,7 +1,22 @@
 #version 120
-varying vec3 f_color;
+#include "triangle.common.glsl"
+#ifdef FADE
 uniform float fade;
+#endif
 void main(void)
 {
-	gl_FragColor = vec4(f_color.x, f_color.y, f_color.z, fade);
+#ifdef VERTEX_COLOR
+	vec3 color = f_color;
+#else
+	vec3 color = vec3(0.0, 0.0, 1.0);
+#endif
+	float alpha = 1.0;
+#ifdef FADE
+	alpha = fade;
+#endif
+#ifdef STRIPES
+	// Every other line is see-through.
+	alpha *= floor(mod(gl_FragCoord.y, 2.0));
+#endif
+	gl_FragColor = vec4(color, alpha);
 }
@@ -0,0 +1,540 @@
+//
+// Source implementation file for the window or offscreen framebuffer.
+//
+
+#include "../include/display.h"
+#include "../include/frame_profile.h"
+#include "../include/gpu_profile.h"
+
+// The X11 types are of no use here and their macros clash with others.
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const int DEFAULT_HEADLESS_FRAMES = 300;
+const int DEFAULT_FPS = 60;
+const int MAX_SIZE = 16384;
+const int DEFAULT_SIM_HZ = 120;
+const int VSYNC_UNSET = 2;
+const int VSYNC_ADAPTIVE = -1;
+// Sleeping is only trusted to this many milliseconds short of a deadline,
+// the rest is spun.
+const Uint32 SPIN_MS = 2;
+
+//
+// Value of a --name=N flag, false when arg isn't one or N isn't positive.
+//
+bool int_flag(const char *arg, const char *name, int *value)
+{
+	size_t length = strlen(name);
+	if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+		return false;
+
+	char *end;
+	long parsed = strtol(arg + length + 1, &end, 10);
+	if (*end != '\0' || parsed <= 0 || parsed > 1000000)
+		return false;
+
+	*value = (int)parsed;
+
+	return true;
+}
+
+//
+// Width and height of a --size=WxH flag, false when arg isn't one.
+//
+bool size_flag(const char *arg, int *w, int *h)
+{
+	if (strncmp(arg, "--size=", 7) != 0)
+		return false;
+
+	char *end;
+	long parsed_w = strtol(arg + 7, &end, 10);
+	if (*end != 'x')
+		return false;
+
+	long parsed_h = strtol(end + 1, &end, 10);
+	if (*end != '\0' || parsed_w <= 0 || parsed_h <= 0 ||
+		parsed_w > MAX_SIZE || parsed_h > MAX_SIZE) {
+
+		return false;
+	}
+
+	*w = (int)parsed_w;
+	*h = (int)parsed_h;
+
+	return true;
+}
+
+//
+// Swap interval of a --vsync=MODE flag, false when arg isn't one.
+//
+bool vsync_flag(const char *arg, int *interval)
+{
+	if (strncmp(arg, "--vsync=", 8) != 0)
+		return false;
+
+	const char *mode = arg + 8;
+	if (strcmp(mode, "on") == 0)
+		*interval = 1;
+	else if (strcmp(mode, "off") == 0)
+		*interval = 0;
+	else if (strcmp(mode, "adaptive") == 0)
+		*interval = VSYNC_ADAPTIVE;
+	else
+		return false;
+
+	return true;
+}
+
+// End of anon namespace.
+}
+
+display::display()
+	: offscreen(false), frame_limit(0), fps(DEFAULT_FPS),
+	vsync(VSYNC_UNSET), max_fps(0), sim_rate(DEFAULT_SIM_HZ),
+	next_present(0), dump_prefix(nullptr), frame(0), width(0),
+	height(0), start(0), window(nullptr), context(nullptr),
+	egl_display(EGL_NO_DISPLAY), egl_context(EGL_NO_CONTEXT), fbo(0)
+{
+	renderbuffers[0] = renderbuffers[1] = 0;
+}
+
+display::~display()
+{
+	close();
+}
+
+bool display::parse_args(int &argc, char *argv[])
+{
+	int kept = 1;
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (strncmp(arg, "--", 2) != 0) {
+			argv[kept++] = argv[i];
+			continue;
+		}
+
+		if (strcmp(arg, "--headless") == 0) {
+			offscreen = true;
+		} else if (strncmp(arg, "--dump=", 7) == 0 && arg[7] != '\0') {
+			dump_prefix = arg + 7;
+		} else if (!int_flag(arg, "--frames", &frame_limit) &&
+				!int_flag(arg, "--fps", &fps) &&
+				!int_flag(arg, "--max-fps", &max_fps) &&
+				!int_flag(arg, "--sim-hz", &sim_rate) &&
+				!size_flag(arg, &width, &height) &&
+				!vsync_flag(arg, &vsync)) {
+
+			cerr << "Bad display flag " << arg << endl;
+			return false;
+		}
+	}
+
+	argv[kept] = nullptr;
+	argc = kept;
+	if (offscreen && frame_limit == 0)
+		frame_limit = DEFAULT_HEADLESS_FRAMES;
+
+	return true;
+}
+
+bool display::open(const char *title, int new_width, int new_height)
+{
+	// A --size flag wins over the size the caller asks for.
+	if (width == 0) {
+		width = new_width;
+		height = new_height;
+	}
+
+	if (offscreen ? !open_headless() : !open_window(title))
+		return false;
+
+	// Extension wrangler initializing.
+	GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLEW built for GLX looks for an X display after loading the GL
+	// entry points; there is none under EGL, but the entry points work.
+	if (offscreen && glew_status == GLEW_ERROR_NO_GLX_DISPLAY)
+		glew_status = GLEW_OK;
+#endif
+
+	if (glew_status != GLEW_OK) {
+		cerr << "Error: glewInit: " << glewGetErrorString(glew_status)
+			<< endl;
+
+		return false;
+	}
+
+	if (offscreen && !create_framebuffer())
+		return false;
+
+	start = SDL_GetPerformanceCounter();
+
+	return true;
+}
+
+bool display::open_window(const char *title)
+{
+	// SDL initialization.
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+		cerr << "Error: SDL_Init: " << SDL_GetError() << endl;
+		return false;
+	}
+
+	// Window initialization.
+	window = SDL_CreateWindow(title,
+				SDL_WINDOWPOS_CENTERED,
+				SDL_WINDOWPOS_CENTERED,
+				width,
+				height,
+				SDL_WINDOW_RESIZABLE |
+				SDL_WINDOW_OPENGL);
+
+	// Some SDL error handling.
+	if (window == nullptr) {
+		cerr << "Error: can't create window: " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 1);
+
+	context = SDL_GL_CreateContext(window);
+	if (context == nullptr) {
+		cerr << "Error: SDL_GL_CreateContext: "
+			<< SDL_GetError() << endl;
+
+		return false;
+	}
+
+	// Not every driver does adaptive vsync, fall back to plain vsync.
+	if (vsync != VSYNC_UNSET && SDL_GL_SetSwapInterval(vsync) != 0 &&
+		(vsync != VSYNC_ADAPTIVE || SDL_GL_SetSwapInterval(1) != 0)) {
+
+		cerr << "Warning: can't set the swap interval: "
+			<< SDL_GetError() << endl;
+	}
+
+	return true;
+}
+
+//
+// A context with no surface at all, on the surfaceless platform where
+// EGL has one (Mesa), and on the default display otherwise.
+//
+bool display::open_headless()
+{
+	// Events only, the shader watcher still posts through SDL.
+	if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+		cerr << "Error: SDL_Init: " << SDL_GetError() << endl;
+		return false;
+	}
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+						"eglGetPlatformDisplayEXT");
+
+	if (get_platform_display != nullptr) {
+		egl_display = get_platform_display(
+					EGL_PLATFORM_SURFACELESS_MESA,
+					EGL_DEFAULT_DISPLAY, nullptr);
+	}
+#endif
+
+	if (egl_display == EGL_NO_DISPLAY)
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (egl_display == EGL_NO_DISPLAY ||
+		!eglInitialize(egl_display, nullptr, nullptr)) {
+
+		cerr << "Error: can't initialize EGL" << endl;
+		egl_display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	// Nothing is drawn to a surface, but the default asks for windows.
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) ||
+		!eglChooseConfig(egl_display, config_attributes, &config, 1,
+				&configs) ||
+		configs == 0) {
+
+		cerr << "Error: EGL has no desktop OpenGL config" << endl;
+		return false;
+	}
+
+	egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT,
+					nullptr);
+
+	if (egl_context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				egl_context)) {
+
+		cerr << "Error: can't make a surfaceless EGL context current"
+			<< endl;
+
+		return false;
+	}
+
+	return true;
+}
+
+//
+// Color and depth renderbuffers standing in for the window, left bound
+// for the whole run.
+//
+bool display::create_framebuffer()
+{
+	if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+		cerr << "Error: headless rendering needs framebuffer objects"
+			<< endl;
+
+		return false;
+	}
+
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+				height);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				GL_RENDERBUFFER, renderbuffers[0]);
+
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_RENDERBUFFER, renderbuffers[1]);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+		GL_FRAMEBUFFER_COMPLETE) {
+
+		cerr << "Error: incomplete offscreen framebuffer" << endl;
+		return false;
+	}
+
+	glViewport(0, 0, width, height);
+
+	return true;
+}
+
+void display::swap()
+{
+	present(frame);
+	advance();
+}
+
+void display::present(int number)
+{
+	FRAME_PROFILE_SCOPE(PHASE_SWAP);
+	GPU_PROFILE_SCOPE("swap");
+
+	if (dump_prefix != nullptr)
+		dump_frame(number);
+
+	// Nothing to present offscreen, but keep the frames moving.
+	if (offscreen)
+		glFlush();
+	else
+		SDL_GL_SwapWindow(window);
+
+	if (max_fps > 0)
+		limit_frame_rate();
+}
+
+bool display::make_current()
+{
+	if (offscreen) {
+		return eglMakeCurrent(egl_display, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, egl_context) == EGL_TRUE;
+	}
+
+	return SDL_GL_MakeCurrent(window, context) == 0;
+}
+
+void display::release_current()
+{
+	if (offscreen) {
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				EGL_NO_CONTEXT);
+	} else {
+		SDL_GL_MakeCurrent(window, nullptr);
+	}
+}
+
+//
+// Wait until the next frame is due: sleep while it is far off, then spin
+// so the wake up isn't late by a scheduler tick.
+//
+void display::limit_frame_rate()
+{
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint64 period = frequency / max_fps;
+	Uint64 now = SDL_GetPerformanceCounter();
+	// A late frame restarts the pacing rather than rushing to catch up.
+	if (next_present == 0 || now > next_present + period)
+		next_present = now;
+
+	while (now < next_present) {
+		Uint64 left_ms = (next_present - now) * 1000 / frequency;
+		if (left_ms > SPIN_MS)
+			SDL_Delay((Uint32)(left_ms - SPIN_MS));
+
+		now = SDL_GetPerformanceCounter();
+	}
+
+	next_present += period;
+}
+
+//
+// Write the frame being drawn, numbered number, as a binary PPM.
+//
+bool display::dump_frame(int number) const
+{
+	int w = width, h = height;
+	if (!offscreen)
+		SDL_GL_GetDrawableSize(window, &w, &h);
+
+	std::vector<GLubyte> pixels(w * h * 4);
+	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s%05d.ppm", dump_prefix,
+		number);
+
+	SDL_RWops *rw = SDL_RWFromFile(filename, "wb");
+	if (rw == nullptr) {
+		cerr << "Error writing " << filename << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	char header[64];
+	int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+				w, h);
+
+	SDL_RWwrite(rw, header, header_size, 1);
+
+	// GL rows go bottom to top, PPM rows top to bottom.
+	std::vector<GLubyte> row(w * 3);
+	for (int y = h - 1; y >= 0; --y) {
+		const GLubyte *src = &pixels[y * w * 4];
+		for (int x = 0; x < w; ++x) {
+			row[x * 3] = src[x * 4];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+
+		SDL_RWwrite(rw, row.data(), row.size(), 1);
+	}
+
+	SDL_RWclose(rw);
+
+	return true;
+}
+
+bool display::done() const
+{
+	return frame_limit > 0 && frame >= frame_limit;
+}
+
+Uint32 display::ticks() const
+{
+	if (frame_limit > 0)
+		return (Uint32)((Uint64)frame * 1000 / fps);
+
+	return SDL_GetTicks();
+}
+
+Uint64 display::time_ns() const
+{
+	if (frame_limit > 0)
+		return (Uint64)frame * 1000000000 / fps;
+
+	// Through a double, the tick count times 10^9 would overflow.
+	return (Uint64)((SDL_GetPerformanceCounter() - start) *
+			(1000000000.0 / SDL_GetPerformanceFrequency()));
+}
+
+void display::print_report() const
+{
+	if (frame_limit == 0)
+		return;
+
+	// Count the frames still in flight too.
+	glFinish();
+	double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency();
+
+	cout << "Frames: " << frame << " in " << ms << " ms, "
+		<< (ms > 0.0 ? frame * 1000.0 / ms : 0.0) << " frames/s"
+		<< (offscreen ? " (headless)" : "") << endl;
+}
+
+void display::close()
+{
+	if (fbo != 0) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(2, renderbuffers);
+		fbo = 0;
+		renderbuffers[0] = renderbuffers[1] = 0;
+	}
+
+	if (egl_display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				EGL_NO_CONTEXT);
+
+		if (egl_context != EGL_NO_CONTEXT)
+			eglDestroyContext(egl_display, egl_context);
+
+		eglTerminate(egl_display);
+		egl_display = EGL_NO_DISPLAY;
+		egl_context = EGL_NO_CONTEXT;
+	}
+
+	if (context != nullptr)
+		SDL_GL_DeleteContext(context);
+
+	if (window != nullptr)
+		SDL_DestroyWindow(window);
+
+	context = nullptr;
+	window = nullptr;
+}
+
+const char *display::usage()
+{
+	return "[--headless] [--frames=N] [--fps=N] [--size=WxH] "
+		"[--vsync=on|off|adaptive] [--max-fps=N] [--sim-hz=N] "
+		"[--dump=PREFIX]";
+}
@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# Headless benchmark matrix of a tutorial, run by `make bench`.
+#
+# Runs PROGRAM offscreen for BENCH_FRAMES frames at every size in
+# BENCH_SIZES and with every scene in BENCH_SCENES (the program's own
+# arguments joined by ':', or '-' for none), keeping the best of BENCH_RUNS
+# runs. The frame rates go to RESULTS as CSV and are compared against
+# BASELINE when that file exists: a frame rate more than THRESHOLD percent
+# below its baseline is a regression, and any regression or failed run
+# makes the exit status non-zero. Pass '-' as BASELINE to skip the check.
+#
+# Usage: bench.sh PROGRAM RESULTS BASELINE THRESHOLD
+#
+
+if [ $# -ne 4 ]; then
+	echo "Usage: bench.sh PROGRAM RESULTS BASELINE THRESHOLD" >&2
+	exit 2
+fi
+
+program=$1
+results=$2
+baseline=$3
+threshold=$4
+name=$(basename "$program")
+
+: "${BENCH_FRAMES:=300}"
+: "${BENCH_SIZES:=640x480}"
+: "${BENCH_SCENES:=-}"
+: "${BENCH_RUNS:=3}"
+
+echo "program,size,scene,frames,ms,fps" > "$results.tmp"
+
+for size in $BENCH_SIZES; do
+	for scene in $BENCH_SCENES; do
+		args=
+		if [ "$scene" != "-" ]; then
+			args=$(echo "$scene" | tr ':' ' ')
+		fi
+
+		best=
+		run=0
+		while [ $run -lt "$BENCH_RUNS" ]; do
+			run=$((run + 1))
+			# The report line is "Frames: N in X ms, ...".
+			line=$("$program" $args --headless \
+				--frames="$BENCH_FRAMES" --size="$size" |
+				grep '^Frames: ')
+
+			if [ -z "$line" ]; then
+				echo "$name $size $scene: run failed" >&2
+				rm -f "$results.tmp"
+				exit 1
+			fi
+
+			best=$(echo "$line" | awk -v best="$best" '{
+				if (best == "" || $4 < best)
+					print $4
+				else
+					print best
+			}')
+			frames=$(echo "$line" | awk '{ print $2 }')
+		done
+
+		echo "$name,$size,$scene,$frames,$best" |
+			awk -F, -v OFS=, '{ print $0, $4 * 1000.0 / $5 }' \
+			>> "$results.tmp"
+	done
+done
+
+mv "$results.tmp" "$results"
+echo "Benchmark results written to $results"
+
+if [ "$baseline" = "-" ] || [ ! -f "$baseline" ]; then
+	echo "No baseline to compare against"
+	exit 0
+fi
+
+awk -F, -v threshold="$threshold" '
+	FNR == 1 { next }
+	NR == FNR { base[$1 "," $2 "," $3] = $6; next }
+	{
+		key = $1 "," $2 "," $3
+		if (!(key in base)) {
+			printf "%-32s %10.1f frames/s (no baseline)\n", key, $6
+			next
+		}
+
+		change = ($6 - base[key]) * 100.0 / base[key]
+		verdict = ""
+		if (change < -threshold) {
+			verdict = " REGRESSION"
+			++regressions
+		}
+
+		printf "%-32s %10.1f frames/s %+7.1f%%%s\n", key, $6, change,
+			verdict
+	}
+	END {
+		if (regressions > 0) {
+			printf "%d run(s) over %s%% slower than the baseline\n",
+				regressions, threshold
+			exit 1
+		}
+	}' "$baseline" "$results"
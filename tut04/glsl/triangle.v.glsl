@@ -1,10 +1,28 @@
 #version 120
+#include "triangle.common.glsl"
+#ifdef COORD3D
 attribute vec3 coord3d;
+#else
+attribute vec2 coord2d;
+#endif
+#ifdef VERTEX_COLOR
 attribute vec3 v_color;
-varying vec3 f_color;
+#endif
+#ifdef TRANSFORM
 uniform mat4 m_transform;
+#endif
 void main(void)
 {
-	gl_Position = m_transform * vec4(coord3d, 1.0);
+#ifdef COORD3D
+	vec4 position = vec4(coord3d, 1.0);
+#else
+	vec4 position = vec4(coord2d, 0.0, 1.0);
+#endif
+#ifdef TRANSFORM
+	position = m_transform * position;
+#endif
+	gl_Position = position;
+#ifdef VERTEX_COLOR
 	f_color = v_color;
+#endif
 }
@@ -0,0 +1,64 @@
+#ifndef ASSET_FILE
+#define ASSET_FILE
+
+//
+// Header file for the read-only asset reader.
+//
+// Files are memory mapped where the platform supports it, so loading
+// shaders and meshes costs neither a heap allocation nor a copy. Anything
+// mmap can't reach (e.g. Android APK assets) is read through SDL_RWops.
+//
+
+#include <cstddef>
+#include <vector>
+
+//
+// Non-owning view of an asset's bytes. Only valid while the
+// asset_file it came from is alive. Not NUL terminated.
+//
+struct asset_view {
+	const char *data;
+	size_t size;
+};
+
+//
+// Owns one open asset for the lifetime of the object.
+//
+class asset_file {
+public:
+	asset_file();
+	explicit asset_file(const char *filename);
+	~asset_file();
+
+	asset_file(asset_file &&other);
+	asset_file &operator=(asset_file &&other);
+	asset_file(const asset_file &) = delete;
+	asset_file &operator=(const asset_file &) = delete;
+
+	//
+	// False when the file could not be read; SDL_GetError() has the reason.
+	//
+	bool is_open() const { return opened; }
+
+	//
+	// True when the bytes come straight from a file mapping.
+	//
+	bool is_mapped() const { return mapped; }
+
+	asset_view view() const;
+	const char *data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	bool map_file(const char *filename);
+	bool read_file(const char *filename);
+	void close();
+
+	const char *bytes;
+	size_t length;
+	bool opened;
+	bool mapped;
+	std::vector<char> fallback; // storage for the SDL_RWops path.
+};
+
+#endif // ASSET_FILE
@@ -0,0 +1,69 @@
+#ifndef FIXED_STEP
+#define FIXED_STEP
+
+//
+// Header file for the fixed timestep of the simulation.
+//
+// The simulation advances in steps of exactly 1/hz seconds whatever the
+// frame rate is: every frame, advance() is given the time and says how
+// many steps are due, and alpha() how far the time is past the last of
+// them. The caller keeps its state from before and after the last step
+// and draws the blend of the two at alpha, so motion stays smooth when
+// rendering runs faster than the simulation, or slower, or unevenly. Times
+// are integer nanoseconds, so given the same times the steps are the same.
+//
+
+#include <SDL.h>
+
+class fixed_step {
+public:
+	explicit fixed_step(int rate_hz = 120);
+
+	//
+	// Change the rate; steps restart from the next advance().
+	//
+	void set_rate(int rate_hz);
+
+	//
+	// Take the time, in nanoseconds, and return how many steps to run.
+	// After a stall at most MAX_CATCH_UP are run and the rest dropped,
+	// rather than the simulation falling further behind every frame.
+	//
+	int advance(Uint64 now);
+
+	//
+	// Fraction of a step the time is past the last step, in [0, 1).
+	//
+	float alpha() const;
+
+	//
+	// A value of the state drawn at alpha, from before and after the step.
+	//
+	double blend(double previous, double current) const
+	{
+		return previous + (current - previous) * alpha();
+	}
+
+	double step_seconds() const { return step_ns / 1000000000.0; }
+	int rate() const { return hz; }
+
+	//
+	// Print the steps run and dropped so far.
+	//
+	void print_report() const;
+
+	static const int MAX_CATCH_UP = 8;
+
+private:
+	int hz;
+	Uint64 step_ns;
+	bool started;
+	Uint64 origin_ns;
+	Uint64 now_ns;
+	// Steps due since the origin, run or dropped.
+	Uint64 taken;
+	Uint64 ran;
+	Uint64 dropped;
+};
+
+#endif // FIXED_STEP
@@ -0,0 +1,131 @@
+#ifndef SHADER_PROGRAM
+#define SHADER_PROGRAM
+
+//
+// Header file for GLSL program reflection.
+//
+// A shader_program enumerates the active attributes and uniforms of a
+// linked program once. Uniforms are set through typed handles backed by a
+// CPU copy of the value the program holds, so setting an unchanged value
+// doesn't reach the driver at all.
+//
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+//
+// Uniform upload counters across every program.
+//
+struct uniform_upload_stats {
+	unsigned long issued; // glUniform* calls made.
+	unsigned long skipped; // sets dropped because nothing changed.
+};
+
+class shader_program;
+
+//
+// Typed handle to one uniform. T must have the size of the GLSL type,
+// e.g. GLfloat for float or glm::mat4 for mat4.
+//
+template <typename T>
+class uniform {
+public:
+	uniform() : owner(nullptr), index(-1) {}
+
+	bool valid() const { return owner != nullptr; }
+
+	//
+	// Upload value, unless the program already holds it.
+	// NOTE: the program has to be in use (glUseProgram).
+	//
+	void set(const T &value);
+
+private:
+	friend class shader_program;
+
+	uniform(shader_program *owner, int index)
+		: owner(owner), index(index) {}
+
+	shader_program *owner;
+	int index;
+};
+
+class shader_program {
+public:
+	shader_program() : id(0) {}
+
+	//
+	// Enumerate the active attributes and uniforms of a linked program.
+	// Previously fetched handles become invalid.
+	//
+	void reflect(GLuint program);
+
+	GLuint program() const { return id; }
+
+	//
+	// Location of an active attribute, or -1.
+	//
+	GLint attribute(const char *name) const;
+
+	//
+	// Handle to an active uniform. The handle is invalid (valid() is
+	// false) when there is no such uniform or T has the wrong size.
+	//
+	template <typename T>
+	uniform<T> get_uniform(const char *name)
+	{
+		int index = find_uniform(name, sizeof(T));
+		if (index == -1)
+			return uniform<T>();
+
+		return uniform<T>(this, index);
+	}
+
+	//
+	// Upload size bytes to uniform number index unless they're unchanged.
+	//
+	void set_uniform(int index, const void *value, size_t size);
+
+private:
+	struct attribute_info {
+		std::string name;
+		GLint location;
+	};
+
+	struct uniform_info {
+		std::string name;
+		GLint location;
+		GLenum type;
+		GLint count; // array length, 1 for plain uniforms.
+		bool initialized; // shadow holds what the program holds.
+		std::vector<unsigned char> shadow;
+	};
+
+	int find_uniform(const char *name, size_t size) const;
+	static void upload(const uniform_info &u);
+
+	GLuint id;
+	std::vector<attribute_info> attributes;
+	std::vector<uniform_info> uniforms;
+};
+
+template <typename T>
+void uniform<T>::set(const T &value)
+{
+	if (owner != nullptr)
+		owner->set_uniform(index, &value, sizeof(T));
+}
+
+//
+// Counters accumulated by every shader_program so far.
+//
+const uniform_upload_stats &get_uniform_upload_stats();
+
+//
+// Print the issued vs skipped uniform upload counts to stdout.
+//
+void print_uniform_upload_report();
+
+#endif // SHADER_PROGRAM
@@ -6,16 +6,45 @@
 // Wade Bonkowski - 6/18/2016
 //
 
+#include "asset_file.h"
+
 #include <GL/glew.h>
 
+#include <string>
+#include <vector>
+
 //
 // Print more information regarding GLSL compile errors.
 //
 void print_log(GLuint object);
 
+//
+// Compile the shader from an in-memory source with error handling.
+// The name is only used to label compile errors.
+//
+GLuint compile_shader(const char *name, asset_view source, GLenum type);
+
+//
+// Run a GLSL file through the preprocessing stage:
+// - #include "file" is replaced by that file, relative to the includer.
+// - every flag ("NAME" or "NAME=VALUE") becomes a #define after #version.
+// #line directives keep compile errors pointing at the right line; before
+// GLSL 3.30 (ES 3.00) "#line N" makes the next line N + 1, from it N, and
+// the file's #version decides which. The source string number is the
+// index of the file in files, if given.
+// Returns false if a file can't be read or includes are nested too deep.
+//
+bool preprocess_shader(const char *filename,
+			const std::vector<std::string> &defines,
+			std::string &source,
+			std::vector<std::string> *files = nullptr);
+
 //
 // Compile the shader from filename with error handling.
 //
-GLuint create_shader(const char *filename, GLenum type);
+GLuint create_shader(const char *filename,
+			GLenum type,
+			const std::vector<std::string> &defines =
+				std::vector<std::string>());
 
 #endif // CREATE_SHADER
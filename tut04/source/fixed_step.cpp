@@ -0,0 +1,63 @@
+//
+// Source implementation file for the fixed timestep of the simulation.
+//
+
+#include "../include/fixed_step.h"
+
+#include <iostream>
+
+using std::cout;
+using std::endl;
+
+fixed_step::fixed_step(int rate_hz)
+	: hz(0), step_ns(0), started(false), origin_ns(0), now_ns(0),
+	taken(0), ran(0), dropped(0)
+{
+	set_rate(rate_hz);
+}
+
+void fixed_step::set_rate(int rate_hz)
+{
+	hz = rate_hz > 0 ? rate_hz : 1;
+	step_ns = 1000000000 / hz;
+	started = false;
+}
+
+int fixed_step::advance(Uint64 now)
+{
+	// The first time seen is step zero, the initial state.
+	if (!started || now < origin_ns) {
+		started = true;
+		origin_ns = now;
+		taken = 0;
+	}
+
+	now_ns = now;
+	// Counting from the origin rather than adding up frame times keeps
+	// rounding from building up into extra or missing steps.
+	Uint64 due = (now - origin_ns) / step_ns;
+	Uint64 steps = due - taken;
+	taken = due;
+	if (steps > (Uint64)MAX_CATCH_UP) {
+		dropped += steps - MAX_CATCH_UP;
+		steps = MAX_CATCH_UP;
+	}
+
+	ran += steps;
+
+	return (int)steps;
+}
+
+float fixed_step::alpha() const
+{
+	if (!started)
+		return 0.0f;
+
+	return (float)((now_ns - origin_ns) % step_ns) / step_ns;
+}
+
+void fixed_step::print_report() const
+{
+	cout << "Simulation: " << ran << " steps at " << hz
+		<< " Hz, " << dropped << " dropped" << endl;
+}
@@ -0,0 +1,170 @@
+//
+// Source implementation file for the per-phase frame timer.
+//
+
+#include "../include/frame_profile.h"
+#include "../include/gpu_profile.h"
+
+#ifdef FRAME_PROFILE_TIMERS
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Slot of the frame total, after the phases.
+const int FRAME_TOTAL = PHASE_COUNT;
+const int SAMPLE_VALUES = PHASE_COUNT + 1;
+
+const char * const PHASE_NAMES[SAMPLE_VALUES] = {
+	"events", "logic", "render", "swap", "wait", "frame"
+};
+
+//
+// One published frame. Every value is atomic so that a reader racing the
+// writer on a slot gets a stale or a fresh value, never a torn one; the
+// reader then throws away the slots the writer may have reached.
+//
+struct frame_sample {
+	std::atomic<Uint64> ticks[SAMPLE_VALUES];
+};
+
+frame_sample ring[FRAME_PROFILE_FRAMES];
+// Frames published so far, the next one goes to ring[written % size].
+std::atomic<unsigned long> written(0);
+
+// Phases of the frame in progress, added to from any thread.
+std::atomic<Uint64> current[PHASE_COUNT];
+// End of the last frame, only touched by the thread ending frames.
+Uint64 last_end;
+
+//
+// Nearest rank percentile of sorted values, in milliseconds.
+//
+double percentile_ms(const std::vector<Uint64> &sorted, double p)
+{
+	size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.5);
+	rank = std::min(std::max(rank, (size_t)1), sorted.size());
+
+	return sorted[rank - 1] * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// End of anon namespace.
+}
+
+void frame_profile_add(frame_phase phase, Uint64 start, Uint64 end)
+{
+	current[phase].fetch_add(end - start, std::memory_order_relaxed);
+#ifdef GPU_PROFILE_MARKERS
+	gpu_profile_cpu_event(PHASE_NAMES[phase], start, end);
+#endif
+}
+
+void frame_profile_end_frame()
+{
+	Uint64 values[SAMPLE_VALUES];
+	values[FRAME_TOTAL] = 0;
+	for (int i = 0; i < PHASE_COUNT; ++i) {
+		values[i] = current[i].exchange(0, std::memory_order_relaxed);
+		values[FRAME_TOTAL] += values[i];
+	}
+
+	// The first frame has nothing to measure from, it takes its phases.
+	Uint64 now = SDL_GetPerformanceCounter();
+	if (last_end != 0)
+		values[FRAME_TOTAL] = now - last_end;
+
+	last_end = now;
+
+	unsigned long frame = written.load(std::memory_order_relaxed);
+	frame_sample &sample = ring[frame % FRAME_PROFILE_FRAMES];
+	// A reader that sees any of the stores below also sees written
+	// at frame, and knows this slot's older frame is gone.
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int i = 0; i < SAMPLE_VALUES; ++i)
+		sample.ticks[i].store(values[i], std::memory_order_relaxed);
+
+	written.store(frame + 1, std::memory_order_release);
+}
+
+bool frame_profile_write(const char *filename)
+{
+	// Copy the ring out, then keep only the frames the writer can't
+	// have overwritten meanwhile.
+	unsigned long end = written.load(std::memory_order_acquire);
+	unsigned long begin = end > FRAME_PROFILE_FRAMES ?
+		end - FRAME_PROFILE_FRAMES : 0;
+
+	std::vector<Uint64> values[SAMPLE_VALUES];
+	for (unsigned long frame = begin; frame < end; ++frame) {
+		const frame_sample &sample =
+			ring[frame % FRAME_PROFILE_FRAMES];
+
+		for (int i = 0; i < SAMPLE_VALUES; ++i) {
+			Uint64 ticks = sample.ticks[i].load(
+						std::memory_order_relaxed);
+
+			values[i].push_back(ticks);
+		}
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned long now = written.load(std::memory_order_relaxed);
+	// Slot of frame f is rewritten by frame f + size, from frame now on.
+	unsigned long valid = now >= FRAME_PROFILE_FRAMES ?
+		now - FRAME_PROFILE_FRAMES + 1 : 0;
+
+	size_t skip = valid > begin ? std::min(valid, end) - begin : 0;
+
+	std::ostringstream json;
+	json << "{\"frames\": " << end - begin - skip
+		<< ", \"total_frames\": " << end << ", \"phases\": {";
+	for (int i = 0; i < SAMPLE_VALUES; ++i) {
+		std::vector<Uint64> &sorted = values[i];
+		sorted.erase(sorted.begin(), sorted.begin() + skip);
+		std::sort(sorted.begin(), sorted.end());
+
+		json << (i > 0 ? ", " : "") << "\"" << PHASE_NAMES[i]
+			<< "\": {";
+
+		if (!sorted.empty()) {
+			json << "\"p50_ms\": " << percentile_ms(sorted, 50)
+				<< ", \"p95_ms\": " << percentile_ms(sorted, 95)
+				<< ", \"p99_ms\": " << percentile_ms(sorted, 99)
+				<< ", \"max_ms\": "
+				<< percentile_ms(sorted, 100);
+		}
+
+		json << "}";
+	}
+
+	json << "}}\n";
+
+	SDL_RWops *rw = SDL_RWFromFile(filename, "wb");
+	if (rw == nullptr) {
+		cerr << "Error writing " << filename << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	std::string text = json.str();
+	SDL_RWwrite(rw, text.data(), text.size(), 1);
+	SDL_RWclose(rw);
+
+	cout << "Frame profile: " << end - begin - skip
+		<< " frames written to " << filename << endl;
+
+	return true;
+}
+
+#endif // FRAME_PROFILE_TIMERS
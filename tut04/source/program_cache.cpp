@@ -0,0 +1,209 @@
+//
+// Source implementation file for the GLSL program binary cache.
+//
+
+#include "../include/program_cache.h"
+
+#include "SDL.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const Uint32 CACHE_MAGIC = 0x42504c47; // "GLPB"
+const Uint32 CACHE_VERSION = 1;
+const Uint64 FNV_OFFSET = 14695981039346656037ULL;
+const Uint64 FNV_PRIME = 1099511628211ULL;
+
+// Header written in front of every cached binary.
+struct cache_header {
+	Uint32 magic;
+	Uint32 version;
+	Uint64 key;
+	GLenum format;
+	GLint length;
+};
+
+program_cache_stats stats = { 0, 0, 0.0 };
+
+//
+// Fold bytes into a FNV-1a hash, followed by a separator byte
+// so that the field boundaries are part of the key.
+//
+Uint64 hash_bytes(Uint64 hash, const char *bytes, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	hash ^= 0xff;
+	hash *= FNV_PRIME;
+
+	return hash;
+}
+
+Uint64 hash_string(Uint64 hash, const char *str)
+{
+	if (str == nullptr)
+		str = "";
+
+	return hash_bytes(hash, str, strlen(str));
+}
+
+//
+// Location of the cache entry for a program key.
+//
+std::string cache_path(GLuint64 key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+	return std::string(PROGRAM_CACHE_DIR "/") + name;
+}
+
+// End of anon namespace.
+}
+
+//
+// Key a program on both sources and on the driver that produced it.
+//
+GLuint64 program_cache_key(asset_view vs_source, asset_view fs_source)
+{
+	GLuint64 key = FNV_OFFSET;
+	key = hash_bytes(key, vs_source.data, vs_source.size);
+	key = hash_bytes(key, fs_source.data, fs_source.size);
+	key = hash_string(key, (const char *)glGetString(GL_VENDOR));
+	key = hash_string(key, (const char *)glGetString(GL_RENDERER));
+	key = hash_string(key, (const char *)glGetString(GL_VERSION));
+
+	return key;
+}
+
+//
+// Program binaries need GL 4.1 or ARB_get_program_binary,
+// plus at least one binary format exposed by the driver.
+//
+bool program_binary_supported()
+{
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+	return formats > 0;
+}
+
+//
+// Restore a program from disk. Returns 0 when there is no usable entry.
+//
+GLuint load_program_binary(GLuint64 key)
+{
+	std::string path = cache_path(key);
+	SDL_RWops *rw = SDL_RWFromFile(path.c_str(), "rb");
+	if (rw == nullptr)
+		return 0;
+
+	cache_header header;
+	std::vector<char> binary;
+	bool read_ok = SDL_RWread(rw, &header, sizeof(header), 1) == 1 &&
+			header.magic == CACHE_MAGIC &&
+			header.version == CACHE_VERSION &&
+			header.key == key &&
+			header.length > 0;
+
+	if (read_ok) {
+		binary.resize(header.length);
+		read_ok = SDL_RWread(rw, binary.data(), header.length, 1) == 1;
+	}
+
+	SDL_RWclose(rw);
+	if (!read_ok)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), header.length);
+	GLint link_ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+	if (link_ok == GL_FALSE) {
+		// The driver rejected it (e.g. after an update), so recompile.
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+//
+// Write the linked program binary of program to disk.
+//
+void store_program_binary(GLuint program, GLuint64 key)
+{
+	cache_header header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.key = key;
+	header.format = 0;
+	header.length = 0;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0)
+		return;
+
+	std::vector<char> binary(header.length);
+	glGetProgramBinary(program,
+			header.length,
+			&header.length,
+			&header.format,
+			binary.data());
+
+#ifdef _WIN32
+	_mkdir(PROGRAM_CACHE_DIR);
+#else
+	mkdir(PROGRAM_CACHE_DIR, 0755);
+#endif
+
+	std::string path = cache_path(key);
+	SDL_RWops *rw = SDL_RWFromFile(path.c_str(), "wb");
+	if (rw == nullptr) {
+		cerr << "Error writing " << path << ": " << SDL_GetError()
+			<< endl;
+
+		return;
+	}
+
+	SDL_RWwrite(rw, &header, sizeof(header), 1);
+	SDL_RWwrite(rw, binary.data(), header.length, 1);
+	SDL_RWclose(rw);
+}
+
+program_cache_stats &get_program_cache_stats()
+{
+	return stats;
+}
+
+//
+// Print the cold-vs-warm startup report.
+//
+void print_program_cache_report()
+{
+	cout << "Program cache: " << stats.hits << " hit(s), "
+		<< stats.misses << " miss(es), "
+		<< stats.ms << " ms building programs" << endl;
+}
@@ -6,47 +6,156 @@
 #include "../include/shader_utils.h"
 
 #include "SDL.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
 using std::cerr;
 using std::endl;
+using std::to_string;
 
 // Anon namespace for internal linkage.
 namespace {
 
+// Deep enough for real shaders, shallow enough to stop include cycles.
+const int MAX_INCLUDE_DEPTH = 16;
+
 //
-// Read a GLSL file into a c-string.
-// Use SDL_RWops for Android asset support.
-// NOTE: Make sure to delete[] the returned buffer.
+// Directory part of filename, including the trailing slash.
 //
-char *file_read(const char *filename)
+std::string directory_of(const std::string &filename)
 {
-	SDL_RWops *rw = SDL_RWFromFile(filename, "rb");
-	if (rw == nullptr)
-		return nullptr;
-
-	Sint64 res_size = SDL_RWsize(rw);
-	char *res = new char[res_size + 1];
-
-	Sint64 nb_read_total = 0, nb_read = 1;
-	char *buf = res;
-	// Read the file by chunks until its all read.
-	while (nb_read_total < res_size && nb_read != 0) {
-		nb_read = SDL_RWread(rw, buf, 1, (res_size - nb_read_total));
-		nb_read_total += nb_read;
-		buf += nb_read;
+	size_t slash = filename.find_last_of('/');
+	if (slash == std::string::npos)
+		return "";
+
+	return filename.substr(0, slash + 1);
+}
+
+//
+// Turn the flags into #define lines.
+//
+std::string define_lines(const std::vector<std::string> &defines)
+{
+	std::string res;
+	for (const std::string &flag : defines) {
+		std::string line = flag;
+		size_t equals = line.find('=');
+		if (equals != std::string::npos)
+			line[equals] = ' ';
+
+		res += "#define " + line + "\n";
 	}
 
-	SDL_RWclose(rw);
-	// If the whole file wasn't read, error out.
-	if (nb_read_total != res_size) {
-		delete[] res;
-		return nullptr;
+	return res;
+}
+
+//
+// Whether text, a #version line, asks for GLSL 3.30 or GLSL ES 3.00 and
+// up, where "#line L" numbers the line after it L. Before those (and so
+// without #version, which means 1.10) that line is numbered L + 1.
+//
+bool numbers_next_line(const std::string &text)
+{
+	size_t start = text.find("#version") + 8;
+	int version = atoi(text.c_str() + start);
+	bool es = text.find(" es", start) != std::string::npos;
+
+	return version >= 330 || (es && version >= 300);
+}
+
+//
+// A #line directive numbering the line after it line, in source string
+// file.
+//
+std::string line_directive(int line, size_t file, bool next_line)
+{
+	return "#line " + to_string(next_line ? line : line - 1) + " " +
+		to_string(file) + "\n";
+}
+
+//
+// Append filename to source, expanding its #include lines recursively.
+// The #version of the first file says how #line counts, in next_line.
+//
+bool expand(const std::string &filename,
+		const std::vector<std::string> &defines,
+		std::string &source,
+		std::vector<std::string> &files,
+		int depth,
+		bool &next_line)
+{
+	if (depth > MAX_INCLUDE_DEPTH) {
+		cerr << filename << ": #include nested too deeply" << endl;
+		return false;
+	}
+
+	asset_file file(filename.c_str());
+	if (!file.is_open()) {
+		cerr << "Error opening " << filename << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
 	}
 
-	res[nb_read_total] = '\0';
+	int file_number = files.size();
+	files.push_back(filename);
 
-	return res;
+	const char *p = file.data();
+	const char *end = p + file.size();
+	for (int line = 1; p < end; ++line) {
+		const char *eol = std::find(p, end, '\n');
+		std::string text(p, eol);
+		p = eol < end ? eol + 1 : end;
+
+		size_t first = text.find_first_not_of(" \t");
+		bool directive = first != std::string::npos &&
+				text[first] == '#';
+
+		bool version = depth == 0 && line == 1 && directive &&
+			text.compare(first, 8, "#version") == 0;
+
+		if (version)
+			next_line = numbers_next_line(text);
+
+		// The flags go right after #version, which must come first.
+		if (depth == 0 && line == 1 && !defines.empty()) {
+			if (version)
+				source += text + "\n";
+
+			source += define_lines(defines);
+			source += line_directive(version ? 2 : 1, 0, next_line);
+			if (version)
+				continue;
+		}
+
+		if (!directive || text.compare(first, 8, "#include") != 0) {
+			source += text + "\n";
+			continue;
+		}
+
+		size_t open = text.find('"', first + 8);
+		size_t close = open == std::string::npos ?
+				std::string::npos : text.find('"', open + 1);
+
+		if (close == std::string::npos) {
+			cerr << filename << ":" << line << ": malformed #include"
+				<< endl;
+
+			return false;
+		}
+
+		std::string name = directory_of(filename) +
+				text.substr(open + 1, close - open - 1);
+
+		source += line_directive(1, files.size(), next_line);
+		if (!expand(name, defines, source, files, depth + 1, next_line))
+			return false;
+
+		source += line_directive(line + 1, file_number, next_line);
+	}
+
+	return true;
 }
 
 // End of anon namespace.
@@ -79,32 +188,58 @@ void print_log(GLuint object)
 }
 
 //
-// Compile the shader from filename with error handling.
+// Compile the shader from an in-memory source with error handling.
 //
-GLuint create_shader(const char *filename, GLenum type)
+GLuint compile_shader(const char *name, asset_view source, GLenum type)
 {
-	const GLchar *source = file_read(filename);
-	if (source == nullptr) {
-		cerr << "Error opening " << filename << ": " << SDL_GetError()
-			<< endl;
-
-		return 0;
-	}
-
+	// Sources are views, so pass the length rather than rely on a '\0'.
+	GLint length = source.size;
 	GLuint res = glCreateShader(type);
-	glShaderSource(res, 1, &source, nullptr);
+	glShaderSource(res, 1, &source.data, &length);
 
 	glCompileShader(res);
 	GLint compile_ok = GL_FALSE;
 	glGetShaderiv(res, GL_COMPILE_STATUS, &compile_ok);
 	if (compile_ok == GL_FALSE) {
-		cerr << filename << ":";
+		cerr << name << ":";
 		print_log(res);
 		glDeleteShader(res);
 		return 0;
 	}
 
-	delete[] source;
+	return res;
+}
+
+//
+// Expand includes and inject the flags of one shader permutation.
+//
+bool preprocess_shader(const char *filename,
+			const std::vector<std::string> &defines,
+			std::string &source,
+			std::vector<std::string> *files)
+{
+	std::vector<std::string> read;
+	source.clear();
+	bool next_line = false;
+	bool res = expand(filename, defines, source, read, 0, next_line);
+	if (files != nullptr)
+		files->swap(read);
 
 	return res;
 }
+
+//
+// Compile the shader from filename with error handling.
+//
+GLuint create_shader(const char *filename,
+			GLenum type,
+			const std::vector<std::string> &defines)
+{
+	std::string source;
+	if (!preprocess_shader(filename, defines, source))
+		return 0;
+
+	asset_view view = { source.data(), source.size() };
+
+	return compile_shader(filename, view, type);
+}
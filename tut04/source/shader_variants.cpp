@@ -0,0 +1,74 @@
+//
+// Source implementation file for memoized shader permutations.
+//
+
+#include "../include/shader_variants.h"
+
+#include <algorithm>
+
+//
+// Same flags in any order (or repeated) make the same variant.
+//
+std::string shader_variants::variant_key(const char *vs_filename,
+					const char *fs_filename,
+					const std::vector<std::string> &defines)
+{
+	std::vector<std::string> flags = defines;
+	std::sort(flags.begin(), flags.end());
+	flags.erase(std::unique(flags.begin(), flags.end()), flags.end());
+
+	std::string key = std::string(vs_filename) + "\n" + fs_filename;
+	for (const std::string &flag : flags)
+		key += "\n" + flag;
+
+	return key;
+}
+
+void shader_variants::declare(const char *vs_filename,
+				const char *fs_filename,
+				const std::vector<std::string> &defines)
+{
+	std::string key = variant_key(vs_filename, fs_filename, defines);
+	if (programs.count(key) != 0 || pending.count(key) != 0)
+		return;
+
+	pending[key] = queue.add_program(vs_filename, fs_filename, defines);
+}
+
+void shader_variants::precompile()
+{
+	queue.submit();
+}
+
+GLuint shader_variants::get(const char *vs_filename,
+				const char *fs_filename,
+				const std::vector<std::string> &defines)
+{
+	std::string key = variant_key(vs_filename, fs_filename, defines);
+	auto built = programs.find(key);
+	if (built != programs.end())
+		return built->second;
+
+	// Undeclared variants are built on the spot.
+	declare(vs_filename, fs_filename, defines);
+	GLuint res = queue.program(pending[key]);
+	pending.erase(key);
+
+	// Failures are remembered too, so a broken variant isn't rebuilt
+	// (and its errors reprinted) every frame.
+	programs[key] = res;
+
+	return res;
+}
+
+void shader_variants::clear()
+{
+	for (auto &p : pending)
+		glDeleteProgram(queue.program(p.second));
+
+	pending.clear();
+	for (auto &p : programs)
+		glDeleteProgram(p.second);
+
+	programs.clear();
+}
@@ -1,4 +1,11 @@
-#include "../include/shader_utils.h"
+#include "../include/display.h"
+#include "../include/fixed_step.h"
+#include "../include/frame_profile.h"
+#include "../include/gl_state.h"
+#include "../include/gpu_profile.h"
+#include "../include/program_cache.h"
+#include "../include/shader_program.h"
+#include "../include/shader_variants.h"
 
 #include <SDL.h> // SDL2 for base window and OpenGL context init.
 #define GLM_FORCE_RADIANS
@@ -20,17 +27,44 @@ namespace {
 // Constants.
 const char * const TRIANGLE_VERTEX_SHADER = "glsl/triangle.v.glsl";
 const char * const TRIANGLE_FRAGMENT_SHADER = "glsl/triangle.f.glsl";
+// Features of the shared triangle shaders this tutorial uses.
+const std::vector<std::string> TRIANGLE_FEATURES = {
+	"COORD3D", "VERTEX_COLOR", "FADE", "TRANSFORM"
+};
 
 // GLSL program handle
 GLuint program;
+// Drops binds and state changes that are already in effect.
+gl_state state;
+// Window, or offscreen framebuffer when running headless.
+display screen;
+// Steps the animation at a fixed rate, whatever the frame rate.
+fixed_step simulation;
+
+//
+// Animation state, kept from before and after the last step so that a
+// frame can be drawn between the two.
+//
+struct sim_state {
+	// Rotation in degrees.
+	double angle;
+	// Radians into the 5 second oscillation.
+	double phase;
+};
+
+sim_state previous_state, current_state;
+// Every permutation of the triangle shaders built so far.
+shader_variants variants;
 // Triangle VBO handles.
 GLuint vbo_triangle;
 // Input variables for the vertex shader.
 GLint attribute_coord3d, attribute_v_color;
+// Active attributes and uniforms of the GLSL program.
+shader_program triangle_program;
 // Global uniform variable.
-GLint uniform_fade;
+uniform<GLfloat> uniform_fade;
 // Global unform transformation handle.
-GLint uniform_m_transform;
+uniform<glm::mat4> uniform_m_transform;
 
 // Attributes struct.
 struct attributes {
@@ -49,6 +83,13 @@ struct attributes {
 //
 bool init_resources()
 {
+	// Start building the GLSL program first, so that compiling and linking
+	// overlap with the buffer uploads below.
+	variants.declare(TRIANGLE_VERTEX_SHADER,
+			TRIANGLE_FRAGMENT_SHADER,
+			TRIANGLE_FEATURES);
+	variants.precompile();
+
 	// Pass both of the attributes in a single array.
 	struct attributes triangle_attributes[] = {
 		{{ 0.0, 0.8, 0.0 }, { 1.0, 1.0, 0.0 }},
@@ -63,41 +104,26 @@ bool init_resources()
 			triangle_attributes,
 			GL_STATIC_DRAW);
 
-	GLuint vs, fs;
-	if ((vs = create_shader(TRIANGLE_VERTEX_SHADER, GL_VERTEX_SHADER)) == 0)
+	// First use of the program, which waits for the driver if needed.
+	program = variants.get(TRIANGLE_VERTEX_SHADER,
+				TRIANGLE_FRAGMENT_SHADER,
+				TRIANGLE_FEATURES);
+	if (program == 0)
 		return false;
 
-	if ((fs = create_shader(TRIANGLE_FRAGMENT_SHADER,
-				GL_FRAGMENT_SHADER)) == 0) {
-
-		return false;
-	}
-
-	// Create the GLSL program by linking the vertex
-	// and the fragment shaders.
-	program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	GLint link_ok = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-	if (link_ok == GL_FALSE) {
-		cerr << "glLinkProgram: ";
-		print_log(program);
-		return false;
-	}	
+	triangle_program.reflect(program);
 
 	// Bind attribute names for the GLSL program
 	// NOTE: all of the names should be global constants in this case..
 	const char *attribute_name = "coord3d";
-	attribute_coord3d = glGetAttribLocation(program, attribute_name);
+	attribute_coord3d = triangle_program.attribute(attribute_name);
 	if (attribute_coord3d == -1) {
 		cerr << "Could not bind attribute " << attribute_name << endl;
 		return false;
 	}
 
 	attribute_name = "v_color";
-	attribute_v_color = glGetAttribLocation(program, attribute_name);
+	attribute_v_color = triangle_program.attribute(attribute_name);
 	if (attribute_v_color == -1) {
 		cerr << "Could not bind attribute " << attribute_name << endl;
 		return false;
@@ -106,16 +132,18 @@ bool init_resources()
 	// Bind the uniform variable for the GLSL program.
 	const char *uniform_name;
 	uniform_name = "fade";
-	uniform_fade = glGetUniformLocation(program, uniform_name);
-	if (uniform_fade == -1) {
+	uniform_fade = triangle_program.get_uniform<GLfloat>(uniform_name);
+	if (!uniform_fade.valid()) {
 		cerr << "Could not bind uniform_fade " << uniform_name << endl;
 		return false;
 	}
 
 	// Bind the uniform matrix transormation handle for the GLSL program.
 	uniform_name = "m_transform";
-	uniform_m_transform = glGetUniformLocation(program, uniform_name);
-	if (uniform_m_transform == -1) {
+	uniform_m_transform =
+		triangle_program.get_uniform<glm::mat4>(uniform_name);
+
+	if (!uniform_m_transform.valid()) {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
@@ -126,19 +154,27 @@ bool init_resources()
 //
 // Render all in window.
 //
-void render(SDL_Window *window)
+void render()
 {
+	FRAME_PROFILE_SCOPE(PHASE_RENDER);
+	GPU_PROFILE_SCOPE("render");
+
 	// Enable Alpha
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.enable(GL_BLEND);
+	state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Make the background white to start.
-	glClearColor(1.0, 1.0, 1.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	{
+		GPU_PROFILE_SCOPE("clear");
+		state.clear_color(1.0, 1.0, 1.0, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	GPU_PROFILE_SCOPE("draw");
 
 	// Tell it to use the GLSL program that we made.
-	glUseProgram(program);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_triangle);
+	state.use_program(program);
+	state.bind_buffer(GL_ARRAY_BUFFER, vbo_triangle);
 	// Pass all of the triangle information into the GLSL program.
 	glEnableVertexAttribArray(attribute_coord3d);
 	glEnableVertexAttribArray(attribute_v_color);
@@ -162,9 +198,6 @@ void render(SDL_Window *window)
 	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glDisableVertexAttribArray(attribute_coord3d);
 	glDisableVertexAttribArray(attribute_v_color);
-
-	// Display the result.
-	SDL_GL_SwapWindow(window);
 }
 
 //
@@ -172,20 +205,40 @@ void render(SDL_Window *window)
 //
 void free_resources()
 {
-	glDeleteProgram(program);
+	variants.clear();
 	glDeleteBuffers(1, &vbo_triangle);
 }
 
+//
+// Advance the animation by one fixed step.
+//
+void step_simulation(double seconds)
+{
+	previous_state = current_state;
+	current_state.angle += 45 * seconds;
+	current_state.phase += seconds * (2*3.14) / 5;
+}
+
 //
 // Have the uniform fade oscillate between 0 and 1 every 5 seconds.
 //
 void input_logic()
 {
+	FRAME_PROFILE_SCOPE(PHASE_LOGIC);
+
+	int steps = simulation.advance(screen.time_ns());
+	for (int i = 0; i < steps; ++i)
+		step_simulation(simulation.step_seconds());
+
+	double phase = simulation.blend(previous_state.phase,
+					current_state.phase);
+
 	// Logic for rotation and translation.
 	// -1 <--> +1 every 5 seconds.
-	float move = sinf(SDL_GetTicks() / 1000.0 * (2*3.14) /5);
+	float move = sin(phase);
 	// Rotate at 45 degrees per second.
-	float angle = SDL_GetTicks() / 1000.0 * 45;
+	float angle = fmod(simulation.blend(previous_state.angle,
+					current_state.angle), 360.0);
 
 	glm::vec3 axis_z(0, 0, 1);
 	glm::mat4 m_transform = glm::rotate(glm::mat4(1.0f),
@@ -194,77 +247,70 @@ void input_logic()
 				glm::translate(glm::mat4(1.0f),
 						glm::vec3(move, 0.0, 0.0));
 
-	glUniformMatrix4fv(uniform_m_transform,
-				1,
-				GL_FALSE,
-				glm::value_ptr(m_transform));
-
 	// alpha 0->1->0 every 5 seconds.
-	float cur_fade = sinf(SDL_GetTicks() / 1000.0 * (2*3.14) / 5) / 2 + 0.5;
-	glUseProgram(program);
-	glUniform1f(uniform_fade, cur_fade);
+	float cur_fade = sin(phase) / 2 + 0.5;
+
+	// Unchanged values are not sent to the driver again.
+	state.use_program(program);
+	uniform_m_transform.set(m_transform);
+	uniform_fade.set(cur_fade);
 }
 
 //
-// Main loop that keeps rendering.
+// Handle the events queued since the last frame. Returns false on quit.
 //
-void main_loop(SDL_Window *window)
+bool handle_events()
 {
-	while (true) {
-		SDL_Event ev;
-		while (SDL_PollEvent(&ev)) {
-			if (ev.type == SDL_QUIT)
-				return;
-		}
+	FRAME_PROFILE_SCOPE(PHASE_EVENTS);
 
-		input_logic();
-		render(window);
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev)) {
+		if (ev.type == SDL_QUIT)
+			return false;
+
+		// P writes out the frame profile so far.
+		if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_p)
+			FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
 	}
-}
 
-// End of anon namespace.
+	return true;
 }
 
 //
-// Driver.
+// Main loop that keeps rendering.
 //
-int main()
+void main_loop()
 {
-	// SDL initialization.
-	SDL_Init(SDL_INIT_VIDEO);
-	// Window initialization.
-	SDL_Window *window = SDL_CreateWindow("My First Triangle",
-						SDL_WINDOWPOS_CENTERED,
-						SDL_WINDOWPOS_CENTERED,
-						640,
-						480,
-						SDL_WINDOW_RESIZABLE |
-						SDL_WINDOW_OPENGL);
-
-	// Some SDL error handling.
-	if (window == nullptr) {
-		cerr << "Error: can't create window: " << SDL_GetError()
-			<< endl;
+	while (!screen.done() && handle_events()) {
+		GPU_PROFILE_BEGIN_FRAME();
+		input_logic();
+		render();
 
-		return EXIT_FAILURE;
+		// Display the result.
+		screen.swap();
+		GPU_PROFILE_END_FRAME();
+		FRAME_PROFILE_END_FRAME();
 	}
+}
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 1);
-
-	if (SDL_GL_CreateContext(window) == nullptr) {
-		cerr << "Error: SDL_GL_CreateContext: " 
-			<< SDL_GetError() << endl;
+// End of anon namespace.
+}
 
+//
+// Driver. Only takes the display flags.
+//
+int main(int argc, char *argv[])
+{
+	if (!screen.parse_args(argc, argv) || argc > 1) {
+		cerr << "Usage: triangle " << display::usage() << endl;
 		return EXIT_FAILURE;
 	}
 
-	// Extension wrangler initializing.
-	GLenum glew_status = glewInit();
-	if (glew_status != GLEW_OK) {
-		cerr << "Error: glewInit: " << endl;
+	simulation.set_rate(screen.sim_hz());
+
+	// Window (or offscreen framebuffer), context and extensions.
+	if (!screen.open("My First Triangle", 640, 480))
 		return EXIT_FAILURE;
-	}
 
 	if (!GLEW_VERSION_2_0) {
 		cerr << "Error: your graphics card doesn't support OpenGL 2.0"
@@ -278,12 +324,25 @@ int main()
 	if (!init_resources())
 		return EXIT_FAILURE;
 
+	print_program_cache_report();
+
+	GPU_PROFILE_INIT();
+
 	// If everything has gone okay, we can display something.
-	main_loop(window);
+	main_loop();
+
+	print_uniform_upload_report();
+	state.print_report();
+	screen.print_report();
+	simulation.print_report();
+	FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+	GPU_PROFILE_WRITE(GPU_PROFILE_FILE);
 
 	// If the program exits in the usual way, free resources
 	// and exit success.
 	free_resources();
+	GPU_PROFILE_DESTROY();
+	screen.close();
 
 	return EXIT_SUCCESS;
 }
@@ -1,6 +1,8 @@
 #version 120
 varying vec3 f_color;
+// Alpha of every fragment, below 1 only while the cube fades.
+uniform float fade;
 void main(void)
 {
-	gl_FragColor = vec4(f_color.x, f_color.y, f_color.z, 1.0);
+	gl_FragColor = vec4(f_color.x, f_color.y, f_color.z, fade);
 }
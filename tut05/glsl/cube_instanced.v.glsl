@@ -0,0 +1,11 @@
+#version 120
+attribute vec3 coord3d;
+attribute vec3 v_color;
+attribute mat4 instance_model;
+varying vec3 f_color;
+uniform mat4 mvp;
+void main(void)
+{
+	gl_Position = mvp * instance_model * vec4(coord3d, 1.0);
+	f_color = v_color;
+}
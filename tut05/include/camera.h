@@ -0,0 +1,85 @@
+#ifndef CAMERA
+#define CAMERA
+
+//
+// Header file for the camera and batched transforms.
+//
+// The camera keeps its view and projection matrices, and their product,
+// from one frame to the next: moving it or resizing the viewport marks
+// them stale and they are only rebuilt when next asked for.
+//
+// A transform_array holds many matrices in SoA layout, each of the 16
+// elements in an array of its own, so that multiply() can take 4 (SSE)
+// or 8 (AVX, when the CPU has it) matrices per step. The products come
+// out as ordinary glm matrices, ready for GL.
+//
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class camera {
+public:
+	camera();
+
+	//
+	// Viewport size for the aspect ratio, and the vertical field of view
+	// (as glm::perspective takes it) and depth range. Either only marks
+	// the projection stale when something changed.
+	//
+	void set_viewport(int new_width, int new_height);
+	void set_lens(float new_fov, float z_near, float z_far);
+
+	//
+	// Place the camera at eye, looking at center.
+	//
+	void look_at(const glm::vec3 &eye, const glm::vec3 &center,
+			const glm::vec3 &up);
+
+	//
+	// Projection times view, rebuilt only if either went stale.
+	//
+	const glm::mat4 &view_projection();
+
+private:
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 product;
+	int width, height;
+	float fov, near_plane, far_plane;
+	bool stale_projection, stale_product;
+};
+
+class transform_array {
+public:
+	transform_array() : count(0), stride(0) {}
+
+	//
+	// Take the matrices into SoA layout.
+	//
+	void assign(const glm::mat4 *matrices, size_t n);
+
+	size_t size() const { return count; }
+
+	//
+	// out[i] = left * matrix i, for every matrix, using the widest SIMD
+	// the CPU has. out must have room for size() matrices.
+	//
+	void multiply(const glm::mat4 &left, glm::mat4 *out) const;
+
+	//
+	// Name of the path multiply() takes on this CPU.
+	//
+	static const char *simd_name();
+
+private:
+	// Element (column c, row r) of matrix i is at elements[(c * 4 + r) *
+	// stride + i]; the stride is size() rounded up to 8 floats.
+	std::vector<float> elements;
+	size_t count;
+	size_t stride;
+};
+
+#endif // CAMERA
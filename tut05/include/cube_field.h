@@ -0,0 +1,92 @@
+#ifndef CUBE_FIELD
+#define CUBE_FIELD
+
+//
+// Header file for fields of identical cubes.
+//
+// A cube_field lays count cubes out on a grid and keeps one model matrix
+// per cube in a buffer, fed to the vertex shader as a per-instance mat4,
+// so the whole field is a single instanced draw of the cube's elements.
+// The matrices are also kept on the CPU for drawing the cubes one by one
+// where instancing isn't available.
+//
+
+#include "gl_state.h"
+#include "mesh.h"
+#include "vertex_format.h"
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class cube_field {
+public:
+	cube_field();
+	~cube_field();
+
+	cube_field(const cube_field &) = delete;
+	cube_field &operator=(const cube_field &) = delete;
+
+	//
+	// Place count cubes on a grid filling the same -1..1 box as a
+	// single cube, and upload their model matrices. Each is multiplied
+	// by mesh_transform on the right, for cubes whose vertices need
+	// one first, such as the dequantization of packed positions.
+	//
+	void layout(gl_state &state, GLsizei count,
+			const glm::mat4 &mesh_transform = glm::mat4(1.0f));
+
+	//
+	// The same without the upload, for drawing without GL.
+	//
+	void place(GLsizei count);
+
+	GLsizei size() const { return models.size(); }
+	const glm::mat4 &model(GLsizei i) const { return models[i]; }
+
+	//
+	// Record the cube layout plus the per-instance model matrix, which
+	// takes the four locations starting at model_location. Call after
+	// layout(), which creates the buffer of model matrices. The cube's
+	// attributes are where position and color say in their buffers.
+	//
+	void build(gl_state &state,
+			GLint coord3d, GLuint vbo_vertices,
+			GLint v_color, GLuint vbo_colors,
+			GLint model_location,
+			GLuint ibo, const draw_descriptor &draw,
+			const attribute_layout &position = FLOAT3_LAYOUT,
+			const attribute_layout &color = FLOAT3_LAYOUT);
+
+	//
+	// Draw every cube with one call.
+	// NOTE: needs mesh::instancing_supported().
+	//
+	void draw(gl_state &state) const;
+
+	//
+	// Draw the cubes numbered in visible with one call, their matrices
+	// copied to the front of the model buffer first, orphaned before
+	// every upload. With every cube listed the buffer is only put back
+	// in order, if it isn't already.
+	//
+	void draw(gl_state &state, const std::vector<GLuint> &visible);
+
+	//
+	// Delete the model buffer and the instanced layout.
+	//
+	void clear();
+
+private:
+	std::vector<glm::mat4> models;
+	GLuint vbo_models;
+	mesh instanced;
+	// The matrices of the last subset drawn, and whether the buffer
+	// holds every matrix in order.
+	std::vector<glm::mat4> visible_models;
+	bool models_in_order;
+};
+
+#endif // CUBE_FIELD
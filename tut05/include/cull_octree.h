@@ -0,0 +1,162 @@
+#ifndef CULL_OCTREE
+#define CULL_OCTREE
+
+//
+// Header file for frustum culling over a loose octree.
+//
+// Objects are axis-aligned boxes (a center and a half extent each) kept in
+// the nodes of a loose octree: every node's bounds are its cell grown by
+// half a cell on each side, so an object goes in the deepest level whose
+// cells are at least as wide as it is, in the cell holding its center,
+// and always fits. The boxes of a node are stored four at a time,
+// each coordinate in an array of its own, so that cull() tests four
+// objects against a plane at once with SSE.
+//
+// cull() walks the tree against the six planes of a frustum: nodes whose
+// loose bounds are outside are skipped with everything below them, and
+// below a node that is all inside nothing is tested anymore.
+//
+// Moving an object with update() rewrites its box in place for as long
+// as it still fits the loose bounds of its node, and otherwise moves it to
+// the node it now belongs in; the rest of the tree is left as it is.
+//
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Levels of the tree, the root included.
+const int CULL_OCTREE_LEVELS = 6;
+
+//
+// Planes a x + b y + c z + d >= 0 bounding what a matrix projects into the
+// clip volume: left, right, bottom, top, near, far.
+//
+struct frustum {
+	glm::vec4 planes[6];
+};
+
+//
+// The frustum of a model-view-projection matrix, in model space (Gribb
+// and Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix").
+//
+frustum frustum_from_matrix(const glm::mat4 &mvp);
+
+//
+// -1 when the box is outside a plane of view, 1 when it is inside them
+// all, 0 when it crosses one.
+//
+int classify_box(const frustum &view, const glm::vec3 &center,
+		const glm::vec3 &extent);
+
+//
+// Box of the box (center, extent) once moved by an affine model matrix.
+// The outputs may be the inputs.
+//
+void transform_bounds(const glm::mat4 &model, const glm::vec3 &center,
+		const glm::vec3 &extent, glm::vec3 &out_center,
+		glm::vec3 &out_extent);
+
+class cull_octree {
+public:
+	cull_octree();
+
+	cull_octree(const cull_octree &) = delete;
+	cull_octree &operator=(const cull_octree &) = delete;
+
+	//
+	// Forget every object and subdivide the cube around center, half_size
+	// wide on each side, into levels levels. Objects may be outside it,
+	// they are only tested one by one.
+	//
+	void reset(const glm::vec3 &center, float half_size,
+		int levels = CULL_OCTREE_LEVELS);
+
+	//
+	// Add a box. Returns its id, the number of objects before it.
+	//
+	GLuint insert(const glm::vec3 &center, const glm::vec3 &extent);
+
+	//
+	// Move the box of object id.
+	//
+	void update(GLuint id, const glm::vec3 &center, const glm::vec3 &extent);
+
+	GLuint size() const { return locations.size(); }
+
+	//
+	// Replace visible with the ids of the objects at least partly inside
+	// view, in an order that only depends on the tree. Boxes that are
+	// outside but cross the corner of two planes may pass too.
+	//
+	void cull(const frustum &view, std::vector<GLuint> &visible);
+
+	//
+	// Name of the path cull() takes on this CPU.
+	//
+	static const char *simd_name();
+
+	//
+	// Print the time cull() took and what it kept, a frame on average,
+	// and how many updates had to move objects.
+	//
+	void print_report() const;
+
+private:
+	struct node {
+		// Blocks of 4 boxes, each block 6 arrays of 4 floats: center x,
+		// y and z, then extent x, y and z. Lanes past ids.size() are
+		// never read.
+		std::vector<float> boxes;
+		std::vector<GLuint> ids;
+		// Objects here and in every node below.
+		GLuint subtree;
+		// Node above, none for the root.
+		GLuint parent;
+		int level;
+		// Center of the cell, the loose bounds are a cell wide each way.
+		glm::vec3 center;
+	};
+
+	// Where an object is: its node and its place in there.
+	struct location {
+		GLuint node;
+		GLuint slot;
+	};
+
+	GLuint node_index(int level, int x, int y, int z) const;
+	float cell_size(int level) const;
+	GLuint pick_node(const glm::vec3 &center, const glm::vec3 &extent) const;
+	bool fits(GLuint n, const glm::vec3 &center,
+		const glm::vec3 &extent) const;
+	void store(GLuint n, GLuint slot, const glm::vec3 &center,
+		const glm::vec3 &extent);
+	void add_to_node(GLuint n, GLuint id, const glm::vec3 &center,
+			const glm::vec3 &extent);
+	void remove_from_node(GLuint id);
+	void count_subtree(GLuint n, int change);
+	void cull_node(int level, int x, int y, int z, const frustum &view,
+			bool inside, std::vector<GLuint> &visible) const;
+
+	std::vector<node> nodes;
+	// First node of every level, x fastest then y then z inside a level.
+	std::vector<GLuint> level_start;
+	std::vector<location> locations;
+	// Minimum corner and edge of the root cell.
+	glm::vec3 origin;
+	float root_size;
+	int level_count;
+
+	// For the report.
+	size_t frames;
+	size_t visible_total;
+	GLuint visible_min, visible_max;
+	double ms;
+	size_t updates, moves;
+};
+
+#endif // CULL_OCTREE
@@ -0,0 +1,170 @@
+#ifndef DISPLAY
+#define DISPLAY
+
+//
+// Header file for where the frames go.
+//
+// Normally that is an SDL window. With --headless it is a framebuffer
+// object on a surfaceless EGL context instead, so the tutorials also run
+// on hosts without a display server. A run given a frame count stops after
+// that many frames and reads the time from a simulated clock advancing a
+// fixed step per frame, so two runs draw exactly the same frames; each
+// frame can also be written out as a PPM image.
+//
+// In a window, swap() can wait for vsync and cap the frame rate; the
+// simulation rate only matters to the callers stepping on time_ns().
+//
+// With --backend=soft there is no GL at all: the caller draws with the
+// software rasterizer and hands each frame over with set_pixels(), which
+// is shown in a plain window, or only dumped when headless.
+//
+// A caller drawing on another thread than the one building the frames
+// hands the context over with release_current() and make_current(), and
+// splits swap() in two: present() on the drawing thread, advance() on the
+// building one, which owns the frame count and the clock.
+//
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+class display {
+public:
+	display();
+	~display();
+
+	display(const display &) = delete;
+	display &operator=(const display &) = delete;
+
+	//
+	// Take the display flags out of the command line, leaving the rest
+	// in argv for the caller:
+	//   --headless      render offscreen, without a window.
+	//   --frames=N      stop after N frames, 300 by default headless.
+	//   --fps=N         frames per simulated second, 60 by default.
+	//   --size=WxH      window or framebuffer size, overriding open().
+	//   --vsync=MODE    on, off or adaptive, the driver's choice if unset.
+	//   --max-fps=N     wait in swap() so frames come at most N a second.
+	//   --sim-hz=N      simulation steps per second, 120 by default.
+	//   --dump=PREFIX   write frame i to PREFIX<i>.ppm.
+	//   --backend=NAME  gl, or soft for the software rasterizer.
+	//   --threads=N     software rasterizer and occlusion culling threads
+	//                   between them, one a core if unset.
+	// Returns false on a malformed flag.
+	//
+	bool parse_args(int &argc, char *argv[]);
+
+	//
+	// Initialize SDL, open the window or the offscreen framebuffer, make
+	// its context current and initialize GLEW. With the software backend
+	// only the window is opened, if any.
+	//
+	bool open(const char *title, int width, int height);
+
+	//
+	// Present the frame (or dump it), hold it back for --max-fps and
+	// advance the clock.
+	//
+	void swap();
+
+	//
+	// The two halves of swap(). present() shows (or dumps) the frame
+	// with the given number, advance() moves the clock to the next one.
+	//
+	void present(int number);
+	void advance() { ++frame; }
+
+	//
+	// The frame present() shows with the software backend: RGBA rows,
+	// bottom to top. The pixels must stay put until then.
+	//
+	void set_pixels(const GLubyte *rgba, int pixels_width,
+			int pixels_height);
+
+	//
+	// Make the context current on the calling thread, or on none.
+	// Nothing to do with the software backend.
+	//
+	bool make_current();
+	void release_current();
+
+	//
+	// Whether the requested number of frames has been drawn.
+	//
+	bool done() const;
+
+	//
+	// Milliseconds since the start, simulated when the frames are fixed.
+	// Use this rather than SDL_GetTicks() for animation.
+	//
+	Uint32 ticks() const;
+
+	//
+	// The same clock in nanoseconds, for fixed simulation steps.
+	//
+	Uint64 time_ns() const;
+
+	int sim_hz() const { return sim_rate; }
+
+	bool headless() const { return offscreen; }
+	bool software() const { return software_backend; }
+	int raster_threads() const { return threads; }
+
+	//
+	// Size the display was opened with.
+	//
+	int frame_width() const { return width; }
+	int frame_height() const { return height; }
+
+	//
+	// Print the frame count and the wall time the frames took.
+	//
+	void print_report() const;
+
+	//
+	// Release the framebuffer and context. Must come after the GL
+	// resources of the caller are freed.
+	//
+	void close();
+
+	static const char *usage();
+
+private:
+	bool open_window(const char *title);
+	bool open_headless();
+	bool open_software(const char *title);
+	void show_pixels();
+	bool create_framebuffer();
+	bool dump_frame(int number) const;
+	void limit_frame_rate();
+
+	bool offscreen;
+	int frame_limit;
+	int fps;
+	// Swap interval to ask for, VSYNC_UNSET leaves the driver's.
+	int vsync;
+	int max_fps;
+	int sim_rate;
+	// Earliest time the next frame may be presented, with max_fps.
+	Uint64 next_present;
+	const char *dump_prefix;
+	bool software_backend;
+	// Software rasterizer and occlusion culling threads together, 0 for
+	// one a core.
+	int threads;
+	// Frame from set_pixels().
+	const GLubyte *pixels;
+	int pixels_width, pixels_height;
+	int frame;
+	int width, height;
+	Uint64 start;
+	SDL_Window *window;
+	SDL_GLContext context;
+	// EGLDisplay and EGLContext, opaque so that including this doesn't
+	// bring the EGL (and X11) headers along.
+	void *egl_display;
+	void *egl_context;
+	GLuint fbo;
+	GLuint renderbuffers[2];
+};
+
+#endif // DISPLAY
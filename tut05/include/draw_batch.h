@@ -0,0 +1,111 @@
+#ifndef DRAW_BATCH
+#define DRAW_BATCH
+
+//
+// Header file for batches of static meshes.
+//
+// A draw_batch packs the vertices (already moved to world space by each
+// object's model matrix) and indices of many meshes into one vertex and
+// one index buffer. Each object keeps its own range of the index buffer,
+// and the ranges are submitted together: with glMultiDrawElementsIndirect
+// from a buffer of commands built on the CPU when the context has
+// GL 4.3 or ARB_multi_draw_indirect, with glMultiDrawElements otherwise.
+// Either way the whole batch is one call, and so is any subset of it: the
+// commands of the objects to draw are written to a second buffer, orphaned
+// every time so that a frame still drawing from it isn't waited for.
+//
+
+#include "gl_state.h"
+#include "mesh.h"
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class draw_batch {
+public:
+	draw_batch();
+	~draw_batch();
+
+	draw_batch(const draw_batch &) = delete;
+	draw_batch &operator=(const draw_batch &) = delete;
+
+	//
+	// Append an indexed triangle mesh with vertices positions and
+	// colors (three floats each), moved by model.
+	// Returns the number of the object in the batch.
+	//
+	GLsizei add(const GLfloat *coords,
+			const GLfloat *colors,
+			GLsizei vertices,
+			const GLuint *indices,
+			GLsizei count,
+			const glm::mat4 &model);
+
+	//
+	// Upload what was added (only the first time, objects can't be
+	// added afterwards) and record the layout for the given attribute
+	// locations. Call again after a relink.
+	// Without indirect, glMultiDrawElements is used even if the
+	// context could do better.
+	//
+	void build(gl_state &state, GLint coord3d, GLint v_color,
+			bool indirect = true);
+
+	//
+	// Draw every object in one call.
+	//
+	void draw(gl_state &state) const;
+
+	//
+	// Draw the objects numbered in visible in one call, the same way
+	// as all of them.
+	//
+	void draw(gl_state &state, const std::vector<GLuint> &visible);
+
+	GLsizei objects() const { return counts.size(); }
+	bool is_indirect() const { return indirect_buffer != 0; }
+
+	//
+	// Delete the buffers and forget every object.
+	//
+	void clear();
+
+	static bool indirect_supported();
+
+private:
+	// Layout of GL_DRAW_INDIRECT_BUFFER entries, fixed by the GL spec.
+	struct draw_command {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	// Interleaved position and color.
+	std::vector<GLfloat> vertex_data;
+	// Indices already offset to the object's first vertex.
+	std::vector<GLuint> index_data;
+	// Per object index count and byte offset, for glMultiDrawElements.
+	std::vector<GLsizei> counts;
+	std::vector<const GLvoid *> offsets;
+	// The same for the objects of the last subset drawn.
+	std::vector<GLsizei> visible_counts;
+	std::vector<const GLvoid *> visible_offsets;
+	// Every object's command, and those of the last subset drawn.
+	std::vector<draw_command> commands;
+	std::vector<draw_command> visible_commands;
+
+	GLuint vertex_buffer;
+	GLuint index_buffer;
+	GLuint indirect_buffer;
+	GLuint visible_buffer;
+	// Every index at once, for the layout.
+	draw_descriptor all_elements;
+	mesh layout;
+};
+
+#endif // DRAW_BATCH
@@ -0,0 +1,94 @@
+#ifndef FRAME_PROFILE
+#define FRAME_PROFILE
+
+//
+// Header file for the per-phase frame timer.
+//
+// When FRAME_PROFILE_TIMERS is defined, FRAME_PROFILE_SCOPE(phase) times
+// the rest of the enclosing block with SDL_GetPerformanceCounter() and
+// adds it to the phase for the current frame, and FRAME_PROFILE_END_FRAME()
+// publishes the frame into a ring of the last FRAME_PROFILE_FRAMES frames.
+// The ring is lock-free: the frame loop is its only writer, and
+// FRAME_PROFILE_WRITE() can read it from any thread at any time, writing
+// p50/p95/p99/max per phase as JSON. Without FRAME_PROFILE_TIMERS every
+// macro expands to nothing, so release builds pay nothing.
+//
+// Scopes may run on any thread; FRAME_PROFILE_END_FRAME() belongs to the
+// thread finishing the frames, so when frames are pipelined across
+// threads the phases can add up to more than the frame took.
+//
+// With GPU_PROFILE_MARKERS as well, every scope also goes to the frame
+// trace as a CPU event.
+//
+
+#include <SDL.h>
+
+// Phases of a frame, in loop order. The frame total is measured apart.
+enum frame_phase {
+	PHASE_EVENTS,
+	PHASE_LOGIC,
+	// Frustum culling, between the logic and the render thread.
+	PHASE_CULL,
+	PHASE_RENDER,
+	PHASE_SWAP,
+	// Blocked on another thread.
+	PHASE_WAIT,
+	PHASE_COUNT
+};
+
+// Where the tutorials write the report.
+const char * const FRAME_PROFILE_FILE = "frame_profile.json";
+
+#ifdef FRAME_PROFILE_TIMERS
+
+// Frames kept for the percentiles, a power of two.
+const unsigned FRAME_PROFILE_FRAMES = 4096;
+
+//
+// Add the ticks from start to end to a phase of the frame in progress.
+//
+void frame_profile_add(frame_phase phase, Uint64 start, Uint64 end);
+
+//
+// Publish the frame in progress to the ring and start the next one. One
+// thread only.
+//
+void frame_profile_end_frame();
+
+//
+// Write the percentiles of the frames in the ring as JSON to filename.
+//
+bool frame_profile_write(const char *filename);
+
+class frame_profile_scope {
+public:
+	explicit frame_profile_scope(frame_phase phase)
+		: phase(phase), start(SDL_GetPerformanceCounter()) {}
+
+	~frame_profile_scope()
+	{
+		frame_profile_add(phase, start, SDL_GetPerformanceCounter());
+	}
+
+	frame_profile_scope(const frame_profile_scope &) = delete;
+	frame_profile_scope &operator=(const frame_profile_scope &) = delete;
+
+private:
+	frame_phase phase;
+	Uint64 start;
+};
+
+#define FRAME_PROFILE_SCOPE(phase) \
+	frame_profile_scope frame_profile_scope_instance(phase)
+#define FRAME_PROFILE_END_FRAME() frame_profile_end_frame()
+#define FRAME_PROFILE_WRITE(filename) frame_profile_write(filename)
+
+#else
+
+#define FRAME_PROFILE_SCOPE(phase) do {} while (0)
+#define FRAME_PROFILE_END_FRAME() do {} while (0)
+#define FRAME_PROFILE_WRITE(filename) do {} while (0)
+
+#endif // FRAME_PROFILE_TIMERS
+
+#endif // FRAME_PROFILE
@@ -0,0 +1,99 @@
+#ifndef GL_STATE
+#define GL_STATE
+
+//
+// Header file for the GL state cache.
+//
+// Binds and fixed-function state go through a gl_state, which remembers
+// what the context currently holds and drops calls that would not change
+// anything. Only state set through the cache is tracked; after touching
+// the same state directly (or deleting a bound object) call invalidate().
+//
+
+#include <GL/glew.h>
+
+//
+// Calls made vs dropped by the cache.
+//
+struct gl_state_stats {
+	unsigned long issued;
+	unsigned long dropped;
+};
+
+class gl_state {
+public:
+	gl_state();
+
+	void use_program(GLuint program);
+
+	//
+	// GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER. Any other target is
+	// passed straight through.
+	//
+	void bind_buffer(GLenum target, GLuint buffer);
+
+	//
+	// Needs GL 3.0 or ARB_vertex_array_object. The element array buffer
+	// is part of the vertex array, so switching forgets it.
+	//
+	void bind_vertex_array(GLuint vertex_array);
+
+	//
+	// GL_BLEND or GL_DEPTH_TEST. Any other capability is passed
+	// straight through.
+	//
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+
+	void blend_func(GLenum src, GLenum dst);
+	void depth_func(GLenum func);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+	//
+	// Forget everything, so the next call of each kind is issued.
+	//
+	void invalidate();
+
+	//
+	// Forget a buffer binding, e.g. after glDeleteBuffers on a bound
+	// buffer or a direct glBindBuffer.
+	//
+	void invalidate_buffer(GLenum target);
+
+	const gl_state_stats &stats() const { return counters; }
+
+	//
+	// Print the issued vs dropped counts to stdout.
+	//
+	void print_report() const;
+
+private:
+	// Count one call; true when it has to reach GL.
+	bool changed(bool differs);
+	void set_cap(GLenum cap, bool on);
+
+	bool valid_program;
+	GLuint program;
+	bool valid_array_buffer;
+	GLuint array_buffer;
+	bool valid_element_buffer;
+	GLuint element_buffer;
+	bool valid_vertex_array;
+	GLuint vertex_array;
+	// Enabled state of GL_BLEND and GL_DEPTH_TEST, -1 for unknown.
+	int blend;
+	int depth_test;
+	bool valid_blend_func;
+	GLenum blend_src, blend_dst;
+	bool valid_depth_func;
+	GLenum depth;
+	bool valid_viewport;
+	GLint view[4];
+	bool valid_clear_color;
+	GLfloat clear[4];
+
+	gl_state_stats counters;
+};
+
+#endif // GL_STATE
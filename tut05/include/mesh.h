@@ -0,0 +1,122 @@
+#ifndef MESH
+#define MESH
+
+//
+// Header file for meshes drawn from vertex array objects.
+//
+// A mesh is described once (which buffer feeds which attribute, plus the
+// element buffer) and build() records that layout into a vertex array
+// object, so drawing it is a single bind. Without GL 3.0 or
+// ARB_vertex_array_object the layout is kept on the CPU instead and bind()
+// replays it, enabling and disabling attributes as meshes change.
+// Attributes with a divisor advance per instance instead of per vertex,
+// which needs GL 3.3 or ARB_instanced_arrays plus ARB_draw_instanced.
+//
+
+#include "gl_state.h"
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+//
+// How to draw an element buffer, kept on the CPU so drawing never has to
+// ask GL about the buffer.
+//
+struct draw_descriptor {
+	GLenum mode; // topology, e.g. GL_TRIANGLES.
+	GLsizei count; // number of indices.
+	GLenum type; // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+};
+
+//
+// Fill buffer with count indices and describe how to draw them.
+// The default vertex array is bound first, so no mesh is modified.
+//
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLubyte *indices, GLsizei count);
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLushort *indices, GLsizei count);
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLuint *indices, GLsizei count);
+
+class mesh {
+public:
+	mesh();
+	~mesh();
+
+	mesh(mesh &&other);
+	mesh &operator=(mesh &&other);
+	mesh(const mesh &) = delete;
+	mesh &operator=(const mesh &) = delete;
+
+	//
+	// Feed attribute location from buffer, as glVertexAttribPointer would.
+	// Locations of -1 (attributes the program dropped) are ignored.
+	// A non-zero divisor steps the attribute once every divisor instances.
+	//
+	void attribute(GLint location, GLuint buffer, GLint size, GLenum type,
+			GLboolean normalized = GL_FALSE, GLsizei stride = 0,
+			size_t offset = 0, GLuint divisor = 0);
+
+	void elements(GLuint buffer, const draw_descriptor &draw);
+
+	//
+	// Record the layout described so far. With emulate, or when vertex
+	// array objects aren't available, no object is created and bind()
+	// replays the layout every time.
+	//
+	void build(gl_state &state, bool emulate = false);
+
+	//
+	// Make this the layout used by the next draw call.
+	//
+	void bind(gl_state &state) const;
+
+	//
+	// Bind and draw every element.
+	//
+	void draw(gl_state &state) const;
+
+	//
+	// Bind and draw every element instances times in one call.
+	//
+	void draw_instanced(gl_state &state, GLsizei instances) const;
+
+	const draw_descriptor &descriptor() const { return draw_info; }
+
+	//
+	// Delete the vertex array object and forget the layout.
+	// The buffers belong to the caller and are left alone.
+	// NOTE: if the mesh may be bound, bind another one through the state
+	//       cache first, or invalidate() it afterwards.
+	//
+	void clear();
+
+	bool emulated() const { return vertex_array == 0; }
+
+	static bool vertex_arrays_supported();
+	static bool instancing_supported();
+
+private:
+	struct attribute_info {
+		GLuint location;
+		GLuint buffer;
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride;
+		size_t offset;
+		GLuint divisor;
+	};
+
+	void apply(gl_state &state) const;
+
+	std::vector<attribute_info> attributes;
+	GLuint element_buffer;
+	draw_descriptor draw_info;
+	GLuint vertex_array;
+};
+
+#endif // MESH
@@ -0,0 +1,94 @@
+#ifndef MESH_FILE
+#define MESH_FILE
+
+//
+// Header file for meshes loaded from OBJ and PLY files.
+//
+// Importing parses the text, fits the mesh into the -1..1 box the
+// tutorials' meshes use, gives uncolored vertices a gray, and runs the
+// mesh optimizer over it. The result is then written to a binary cache
+// laid out as the vertex and index buffers want it (positions, colors and
+// 32-bit indices, each section starting on a MESH_CACHE_ALIGN boundary),
+// and every later load only maps that file: the views point into the
+// mapping and go to glBufferData as they are, with no parsing and no
+// copy. Entries are keyed on the source path and stale once the source
+// changes size or modification time, or the cache version changes.
+//
+// Only ASCII PLY is read; OBJ faces may have any number of corners and
+// vertices may carry colors after their position, as many exporters do.
+//
+
+#include "asset_file.h"
+#include "mesh_optimizer.h"
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include <string>
+
+// Directory (relative to the working directory) holding cached meshes.
+#define MESH_CACHE_DIR ".mesh_cache"
+
+// Alignment of every section of a cache file, in bytes.
+const size_t MESH_CACHE_ALIGN = 64;
+
+//
+// Non-owning view of a mesh's buffers, three floats a vertex for
+// positions and colors.
+//
+struct mesh_view {
+	const GLfloat *positions;
+	const GLfloat *colors;
+	const GLuint *indices;
+	GLuint vertices;
+	GLsizei count; // indices.
+};
+
+mesh_view view_mesh(const mesh_data &mesh);
+
+//
+// Parse an .obj or .ply file into mesh, fitted and optimized as above.
+// A file without a single triangle is an error. Errors are printed.
+//
+bool import_mesh(const char *filename, mesh_data &mesh);
+
+class mesh_file {
+public:
+	mesh_file();
+
+	mesh_file(const mesh_file &) = delete;
+	mesh_file &operator=(const mesh_file &) = delete;
+
+	//
+	// Map the cache of filename if it is up to date, else import it and
+	// write the cache. Returns false when the file can't be imported.
+	//
+	bool load(const char *filename);
+
+	//
+	// Valid until the next load() or the end of the mesh_file.
+	//
+	const mesh_view &view() const { return current; }
+
+	//
+	// True when load() found an up to date cache entry.
+	//
+	bool from_cache() const { return cached; }
+
+	//
+	// Time the last load() took, importing included.
+	//
+	double load_ms() const { return ms; }
+
+private:
+	bool map_cache(const std::string &path, Uint64 size, Sint64 mtime);
+
+	asset_file cache;
+	// The import, kept only when it couldn't go through the cache.
+	mesh_data imported;
+	mesh_view current;
+	bool cached;
+	double ms;
+};
+
+#endif // MESH_FILE
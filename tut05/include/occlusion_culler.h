@@ -0,0 +1,190 @@
+#ifndef OCCLUSION_CULLER
+#define OCCLUSION_CULLER
+
+//
+// Header file for software occlusion culling.
+//
+// Every frame, the objects covering the most of the screen are picked as
+// occluders (up to OCCLUDERS of them, and only those whose mesh has at
+// most OCCLUDER_MAX_TRIANGLES triangles) and their triangles rasterized
+// into a depth buffer of OCCLUSION_WIDTH x OCCLUSION_HEIGHT, four pixels
+// at a time with SSE. The buffer is then reduced into a hierarchical-Z
+// pyramid, each level keeping the farthest depth of 2x2 texels of the one
+// below. An object is occluded when the nearest corner of its bounding box
+// is farther than everything in the screen rectangle the box covers, read
+// from the level where that rectangle is at most 2x2 texels.
+//
+// The pass runs on a pool of its own: begin() hands the frame to it and
+// returns, and end() waits for the result, so the caller can do other
+// work (the frustum culling, for one) in between. Objects are projected
+// and tested in ranges, and the depth buffer rasterized in bands of rows,
+// with every value computed from the frame's inputs alone, so that the
+// result is the same whatever the thread count or timing. The report
+// carries a checksum of every frame's result to compare runs by.
+//
+// Boxes whose corners aren't all in front of the near plane, or that are
+// off the screen, are never occluded: the frustum culling decides those.
+// The depth buffer is only sampled at pixel centers, so a gap between
+// occluders that misses every center counts as covered.
+//
+
+#include "worker_pool.h"
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Size of the depth buffer, whatever the size of the viewport.
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+// Occluders rasterized a frame, at most.
+const int OCCLUDERS = 32;
+// Meshes with more triangles than this are never occluders.
+const GLsizei OCCLUDER_MAX_TRIANGLES = 256;
+
+//
+// Geometry of occluders: three floats a position, three indices a
+// triangle. Must stay put while the culler uses it.
+//
+struct occluder_mesh {
+	const GLfloat *positions;
+	const GLuint *indices;
+	GLsizei count;
+};
+
+//
+// One object to test: its bounding box, and the occluders[mesh] moved by
+// model that it draws, which must be inside the box.
+//
+struct occlusion_object {
+	glm::vec3 center;
+	glm::vec3 extent;
+	glm::mat4 model;
+	GLuint mesh;
+};
+
+class occlusion_culler {
+public:
+	occlusion_culler();
+	~occlusion_culler();
+
+	occlusion_culler(const occlusion_culler &) = delete;
+	occlusion_culler &operator=(const occlusion_culler &) = delete;
+
+	//
+	// Start the pool, threads threads besides the caller's: one runs the
+	// frames, the others help it. With 0, one per core. Without a pool,
+	// begin() runs the whole pass before returning.
+	//
+	void start(int threads = 0);
+
+	int threads() const { return pool.threads(); }
+
+	//
+	// The meshes and the objects, copied. Not between begin() and end().
+	//
+	void set_scene(const std::vector<occluder_mesh> &meshes,
+			const std::vector<occlusion_object> &objects);
+
+	//
+	// Start testing every object against the occluders, as mvp sees them.
+	//
+	void begin(const glm::mat4 &mvp);
+
+	//
+	// Wait for the pass begin() started.
+	//
+	void end();
+
+	//
+	// Result of the last pass, valid from end() to the next begin().
+	//
+	bool occluded(GLuint object) const { return hidden[object] != 0; }
+
+	//
+	// Print what was occluded, a frame on average, with the checksum of
+	// every frame's result, then the time the pass took and how much of
+	// it end() waited for.
+	//
+	void print_report() const;
+
+	//
+	// Stop the pool.
+	//
+	void stop();
+
+private:
+	//
+	// A triangle ready to rasterize: edges are a * x + b * y + c over
+	// pixel centers, a pixel being inside when all three are at least 0,
+	// and depth is a plane over the same coordinates, never nearer than
+	// the nearest corner.
+	//
+	struct occluder_triangle {
+		int min_x, min_y, max_x, max_y;
+		float edge[3][3];
+		float depth[3];
+		float nearest;
+	};
+
+	void frame();
+	void project_pass(int worker);
+	void raster_pass(int worker);
+	void test_pass(int worker);
+	void pick_occluders();
+	void setup_occluder(GLuint object);
+	void build_pyramid();
+	void raster_triangle(const occluder_triangle &triangle, int y0, int y1);
+	bool test_object(GLuint object) const;
+
+	void drive();
+
+	std::vector<occluder_mesh> meshes;
+	std::vector<occlusion_object> objects;
+	glm::mat4 mvp;
+
+	// Per object, from the projection: its screen rectangle in pixels
+	// (min x, min y, max x, max y; empty when not testable), its
+	// nearest depth and how much of the screen it covers.
+	std::vector<int> rects;
+	std::vector<float> nearest;
+	std::vector<float> coverage;
+	std::vector<GLubyte> hidden;
+
+	// Objects picked as occluders this frame, by number.
+	std::vector<GLuint> occluders;
+	std::vector<occluder_triangle> triangles;
+	// Every level of the pyramid one after the other, level 0 being the
+	// depth buffer itself.
+	std::vector<float> pyramid;
+	std::vector<size_t> level_start;
+	std::vector<int> level_width, level_height;
+	std::atomic<int> next_band;
+
+	// For the report.
+	size_t frames;
+	size_t tested_total;
+	size_t hidden_total;
+	size_t occluders_total;
+	GLuint checksum;
+	double pass_ms;
+	double wait_ms;
+
+	// The driver thread runs a frame's passes when begin() asks for one,
+	// as worker 0 of the pool.
+	worker_pool pool;
+	std::thread driver;
+	std::mutex mutex;
+	std::condition_variable frame_asked, frame_done;
+	bool frame_pending;
+	bool stopping;
+};
+
+#endif // OCCLUSION_CULLER
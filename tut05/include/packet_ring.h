@@ -0,0 +1,119 @@
+#ifndef PACKET_RING
+#define PACKET_RING
+
+//
+// Header file for handing frame packets from one thread to another.
+//
+// A ring of N slots between one producer and one consumer. A slot belongs
+// to the producer until it is published and to the consumer until it is
+// released, so packets are built in place and read in place, never copied
+// and never locked: handing one over is a single atomic store. A thread
+// only sleeps, on a condition variable, when it has to wait for the other
+// one, the producer on a full ring and the consumer on an empty one. With
+// N = 2 that is double buffering; with N = 3 the producer can get one more
+// frame ahead. Slots are reused, so whatever a packet allocated for one
+// frame is still there for the next frame that lands on its slot.
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+template <typename T, unsigned N>
+class packet_ring {
+public:
+	packet_ring() : written(0), read(0), closed(false), waiting(false) {}
+
+	packet_ring(const packet_ring &) = delete;
+	packet_ring &operator=(const packet_ring &) = delete;
+
+	//
+	// Producer: the slot to fill next, once the consumer has let go of it.
+	//
+	T &begin_write()
+	{
+		unsigned long w = written.load();
+		wait([&] { return w - read.load() < N; });
+
+		return slots[w % N];
+	}
+
+	//
+	// Producer: publish the slot from begin_write().
+	//
+	void end_write()
+	{
+		written.store(written.load() + 1);
+		wake();
+	}
+
+	//
+	// Producer: no more packets. The consumer still gets the published
+	// ones, then nullptr.
+	//
+	void close()
+	{
+		closed.store(true);
+		wake();
+	}
+
+	//
+	// Consumer: the oldest published packet, waiting for one if needed.
+	// Returns nullptr once the ring is closed and drained.
+	//
+	const T *begin_read()
+	{
+		unsigned long r = read.load();
+		wait([&] { return written.load() != r || closed.load(); });
+		if (written.load() == r)
+			return nullptr;
+
+		return &slots[r % N];
+	}
+
+	//
+	// Consumer: give the packet from begin_read() back to the producer.
+	//
+	void end_read()
+	{
+		read.store(read.load() + 1);
+		wake();
+	}
+
+private:
+	//
+	// Sleep until ready() holds. Every access is sequentially consistent:
+	// either the waiter sees the other thread's store, or the other
+	// thread sees waiting and wakes it up.
+	//
+	template <typename Ready>
+	void wait(Ready ready)
+	{
+		if (ready())
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		waiting.store(true);
+		woken.wait(lock, ready);
+		waiting.store(false);
+	}
+
+	void wake()
+	{
+		if (waiting.load()) {
+			std::lock_guard<std::mutex> lock(mutex);
+			woken.notify_one();
+		}
+	}
+
+	T slots[N];
+	// Packets published and released so far.
+	std::atomic<unsigned long> written;
+	std::atomic<unsigned long> read;
+	std::atomic<bool> closed;
+	std::atomic<bool> waiting;
+	std::mutex mutex;
+	std::condition_variable woken;
+};
+
+#endif // PACKET_RING
@@ -0,0 +1,112 @@
+#ifndef QUERY_CHECK
+#define QUERY_CHECK
+
+//
+// Header file for the frame loop query checker.
+//
+// GL Get* calls usually make the driver finish queued work before it can
+// answer, which is fine while loading but stalls every frame once it
+// creeps into the render path. When QUERY_CHECK_FRAMES is defined, the Get*
+// calls below are wrapped in every file including this header, and each
+// call site reached between query_check_begin_frame() and
+// query_check_end_frame() is reported to stderr once.
+//
+// NOTE: include this after any other GL header, it has to see the real
+//       declarations first.
+//
+
+#include <GL/glew.h>
+
+//
+// Mark the frame loop, e.g. around input and render.
+//
+void query_check_begin_frame();
+void query_check_end_frame();
+
+//
+// Report a query made at file:line if a frame is in progress.
+//
+void query_check_report(const char *name, const char *file, int line);
+
+//
+// Number of queries made inside frames so far.
+//
+unsigned long query_check_count();
+
+#ifdef QUERY_CHECK_FRAMES
+
+// Wrap a GL entry point. The inline function still sees the original name
+// (which GLEW may itself define as a macro), the macro replaces every use
+// after this header.
+#define QUERY_CHECK_WRAP(ret, name, params, args) \
+	inline ret query_check_##name params { return name args; }
+
+QUERY_CHECK_WRAP(GLenum, glGetError, (), ())
+QUERY_CHECK_WRAP(void, glGetBooleanv, (GLenum p, GLboolean *v), (p, v))
+QUERY_CHECK_WRAP(void, glGetIntegerv, (GLenum p, GLint *v), (p, v))
+QUERY_CHECK_WRAP(void, glGetFloatv, (GLenum p, GLfloat *v), (p, v))
+QUERY_CHECK_WRAP(const GLubyte *, glGetString, (GLenum p), (p))
+QUERY_CHECK_WRAP(void, glGetBufferParameteriv,
+		(GLenum t, GLenum p, GLint *v), (t, p, v))
+QUERY_CHECK_WRAP(void, glGetBufferSubData,
+		(GLenum t, GLintptr o, GLsizeiptr s, void *d), (t, o, s, d))
+QUERY_CHECK_WRAP(void, glGetShaderiv, (GLuint s, GLenum p, GLint *v), (s, p, v))
+QUERY_CHECK_WRAP(void, glGetProgramiv,
+		(GLuint s, GLenum p, GLint *v), (s, p, v))
+QUERY_CHECK_WRAP(GLint, glGetAttribLocation,
+		(GLuint s, const GLchar *n), (s, n))
+QUERY_CHECK_WRAP(GLint, glGetUniformLocation,
+		(GLuint s, const GLchar *n), (s, n))
+QUERY_CHECK_WRAP(void, glGetVertexAttribiv,
+		(GLuint i, GLenum p, GLint *v), (i, p, v))
+QUERY_CHECK_WRAP(void, glGetQueryObjectiv,
+		(GLuint q, GLenum p, GLint *v), (q, p, v))
+QUERY_CHECK_WRAP(void, glGetQueryObjectuiv,
+		(GLuint q, GLenum p, GLuint *v), (q, p, v))
+
+#undef glGetError
+#undef glGetBooleanv
+#undef glGetIntegerv
+#undef glGetFloatv
+#undef glGetString
+#undef glGetBufferParameteriv
+#undef glGetBufferSubData
+#undef glGetShaderiv
+#undef glGetProgramiv
+#undef glGetAttribLocation
+#undef glGetUniformLocation
+#undef glGetVertexAttribiv
+#undef glGetQueryObjectiv
+#undef glGetQueryObjectuiv
+
+#define QUERY_CHECK_CALL(name, ...) \
+	(query_check_report(#name, __FILE__, __LINE__), \
+	query_check_##name(__VA_ARGS__))
+
+#define glGetError() \
+	(query_check_report("glGetError", __FILE__, __LINE__), \
+	query_check_glGetError())
+#define glGetBooleanv(...) QUERY_CHECK_CALL(glGetBooleanv, __VA_ARGS__)
+#define glGetIntegerv(...) QUERY_CHECK_CALL(glGetIntegerv, __VA_ARGS__)
+#define glGetFloatv(...) QUERY_CHECK_CALL(glGetFloatv, __VA_ARGS__)
+#define glGetString(...) QUERY_CHECK_CALL(glGetString, __VA_ARGS__)
+#define glGetBufferParameteriv(...) \
+	QUERY_CHECK_CALL(glGetBufferParameteriv, __VA_ARGS__)
+#define glGetBufferSubData(...) \
+	QUERY_CHECK_CALL(glGetBufferSubData, __VA_ARGS__)
+#define glGetShaderiv(...) QUERY_CHECK_CALL(glGetShaderiv, __VA_ARGS__)
+#define glGetProgramiv(...) QUERY_CHECK_CALL(glGetProgramiv, __VA_ARGS__)
+#define glGetAttribLocation(...) \
+	QUERY_CHECK_CALL(glGetAttribLocation, __VA_ARGS__)
+#define glGetUniformLocation(...) \
+	QUERY_CHECK_CALL(glGetUniformLocation, __VA_ARGS__)
+#define glGetVertexAttribiv(...) \
+	QUERY_CHECK_CALL(glGetVertexAttribiv, __VA_ARGS__)
+#define glGetQueryObjectiv(...) \
+	QUERY_CHECK_CALL(glGetQueryObjectiv, __VA_ARGS__)
+#define glGetQueryObjectuiv(...) \
+	QUERY_CHECK_CALL(glGetQueryObjectuiv, __VA_ARGS__)
+
+#endif // QUERY_CHECK_FRAMES
+
+#endif // QUERY_CHECK
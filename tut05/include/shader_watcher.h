@@ -0,0 +1,108 @@
+#ifndef SHADER_WATCHER
+#define SHADER_WATCHER
+
+//
+// Header file for GLSL hot reload.
+//
+// A background thread blocks on inotify and turns every write to a shader
+// file into an SDL event, so the main loop picks changes up from its usual
+// SDL_PollEvent() pass without any filesystem polling of its own. Only the
+// changed stage (or the stages #including the changed file) is recompiled
+// and only the programs using it are relinked; a stage or program that
+// fails to build leaves the old program in use.
+//
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Called with a freshly linked program to look its attributes and uniforms
+// up again. Returning false rejects the program and keeps the old one.
+//
+typedef bool (*relink_callback)(GLuint program);
+
+class shader_watcher {
+public:
+	shader_watcher();
+	~shader_watcher();
+
+	shader_watcher(const shader_watcher &) = delete;
+	shader_watcher &operator=(const shader_watcher &) = delete;
+
+	//
+	// Start watching a directory of shaders. Returns false (and keeps
+	// running without hot reload) when the platform has no inotify.
+	//
+	bool start(const char *directory);
+
+	//
+	// Stop the thread and release the stages kept for relinking.
+	// Must be called while the GL context is still current.
+	//
+	void stop();
+
+	//
+	// Register a program; *program is replaced in place on reload.
+	//
+	void add_program(GLuint *program,
+			const char *vs_filename,
+			const char *fs_filename,
+			relink_callback on_relink);
+
+	//
+	// Give every SDL event to this first. Returns true when the event was
+	// a shader change, which is then handled before the next frame.
+	//
+	bool handle_event(const SDL_Event &ev);
+
+	//
+	// Free a shader change that will never be handled. Other events are
+	// left alone.
+	//
+	void discard_event(const SDL_Event &ev) const;
+
+	//
+	// Whether ev is a shader change, without handling it; for a thread
+	// without the GL context to pass it on to the one with.
+	//
+	bool is_change(const SDL_Event &ev) const
+	{
+		return event_type != 0 && ev.type == event_type;
+	}
+
+private:
+	struct watched_program {
+		GLuint *program;
+		std::string vs_filename;
+		std::string fs_filename;
+		// Every file each stage reads, itself and its #includes.
+		std::vector<std::string> vs_files;
+		std::vector<std::string> fs_files;
+		relink_callback on_relink;
+	};
+
+	void watch();
+	void reload(const std::string &filename);
+	bool rebuild(const std::string &filename,
+			GLenum type,
+			std::map<std::string, bool> &rebuilt);
+
+	void relink(watched_program &p);
+	GLuint stage(const std::string &filename, GLenum type);
+
+	std::string directory;
+	std::vector<watched_program> programs;
+	// Compiled stages by filename, kept so one stage can change alone.
+	std::map<std::string, GLuint> stages;
+	std::thread thread;
+	Uint32 event_type;
+	int inotify_fd;
+	int wake_pipe[2];
+};
+
+#endif // SHADER_WATCHER
@@ -0,0 +1,179 @@
+#ifndef SOFT_RASTER
+#define SOFT_RASTER
+
+//
+// Header file for the software rasterizer.
+//
+// A CPU stand-in for the GL pipeline the tutorials use, for hosts with no
+// GPU and as a reference to check GL output against. Meshes are described
+// as glVertexAttribPointer would (positions and colors with a stride, plus
+// optional 32-bit indices) and drawn with an MVP matrix: the positions are
+// clipped against the near and far planes, colors are interpolated
+// perspective-correct, and the fragments go through a GL_LESS depth test
+// and, when enabled, GL_SRC_ALPHA / GL_ONE_MINUS_SRC_ALPHA blending with a
+// constant alpha per draw, which is all the tutorials' shaders do.
+//
+// draw() only queues. finish() runs the frame on a pool of worker threads
+// in two passes: each worker sets up a contiguous share of the triangles
+// and bins them into 64x64 pixel tiles, then the workers take whole tiles
+// and rasterize every triangle binned there, in submission order, four
+// pixels at a time with SSE edge functions. No two workers touch the same
+// pixel, and the result is the same for any number of threads.
+//
+// Pixels are RGBA bytes with the rows bottom to top, as glReadPixels
+// returns them, so they can be dumped or shown like a GL frame.
+//
+
+#include "worker_pool.h"
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+//
+// Vertex data of one draw, as it would be handed to GL. Strides are in
+// bytes, 0 meaning tightly packed. Without indices, count vertices are
+// drawn in order.
+//
+struct soft_mesh {
+	const GLfloat *positions;
+	GLint position_size; // 2 or 3; z is 0 when there are only two.
+	GLsizei position_stride;
+	const GLfloat *colors; // r, g, b.
+	GLsizei color_stride;
+	const GLuint *indices;
+	GLsizei count; // indices, or vertices without them; three a triangle.
+};
+
+class soft_raster {
+public:
+	soft_raster();
+	~soft_raster();
+
+	soft_raster(const soft_raster &) = delete;
+	soft_raster &operator=(const soft_raster &) = delete;
+
+	//
+	// Start the workers, the calling thread being one of them. With 0,
+	// one per core.
+	//
+	void start(int threads = 0);
+
+	//
+	// Size of the color and depth buffers, and of the viewport.
+	//
+	void resize(int new_width, int new_height);
+
+	//
+	// Clear the color to the given one and the depth to 1.
+	//
+	void clear(float r, float g, float b, float a);
+
+	//
+	// State for the draws that follow, both off to start with.
+	//
+	void set_depth_test(bool enabled) { depth_test = enabled; }
+	void set_blend(bool enabled) { blend = enabled; }
+
+	//
+	// Queue the triangles of mesh, transformed by mvp, with alpha as the
+	// alpha of every fragment. The vertex data must stay put until
+	// finish().
+	//
+	void draw(const soft_mesh &mesh, const glm::mat4 &mvp,
+			float alpha = 1.0f);
+
+	//
+	// Rasterize everything queued since the last finish().
+	//
+	void finish();
+
+	const GLubyte *pixels() const;
+	int frame_width() const { return width; }
+	int frame_height() const { return height; }
+	int threads() const { return pool.threads(); }
+
+	//
+	// Triangles set up and actually rasterized (left after clipping and
+	// dropping the empty ones) since the start.
+	//
+	size_t triangles() const { return total_triangles; }
+
+	//
+	// Print the thread count, the triangles drawn so far and how many a
+	// second finish() got through.
+	//
+	void print_report() const;
+
+	//
+	// Stop the workers.
+	//
+	void stop();
+
+private:
+	struct command {
+		soft_mesh mesh;
+		glm::mat4 mvp;
+		float alpha;
+		bool depth_test;
+		bool blend;
+		// Index of its first triangle among the frame's.
+		size_t first;
+	};
+
+	//
+	// A triangle ready to rasterize. Edges and planes are a * x + b * y
+	// + c over pixel coordinates, centers already folded in; a pixel is
+	// inside when all three edges are positive, or zero on a top or left
+	// edge. The planes are z, 1 / w and r / w, g / w, b / w.
+	//
+	struct setup {
+		int min_x, min_y, max_x, max_y;
+		float edge[3][3];
+		bool top_left[3];
+		float plane[5][3];
+		float alpha;
+		bool depth_test;
+		bool blend;
+	};
+
+	//
+	// Per worker output of the setup pass: the triangles set up, and for
+	// each tile the indices of those touching it.
+	//
+	struct worker_bins {
+		std::vector<setup> triangles;
+		std::vector<std::vector<GLuint> > tiles;
+	};
+
+	void setup_pass(int worker);
+	void raster_pass(int worker);
+	void setup_triangle(const command &draw, size_t triangle,
+			worker_bins &bins);
+	void add_triangle(const glm::vec4 *clip, const glm::vec3 *color,
+			const command &draw, worker_bins &bins);
+	void raster_triangle(const setup &triangle, int x0, int y0, int x1,
+			int y1);
+
+	int width, height;
+	int tiles_x, tiles_y;
+	std::vector<GLuint> color;
+	std::vector<GLfloat> depth;
+	bool depth_test, blend;
+	std::vector<command> commands;
+	size_t queued;
+	size_t total_triangles;
+	size_t frames;
+	// Time spent in finish(), in seconds.
+	double seconds;
+	std::vector<worker_bins> bins;
+	std::atomic<int> next_tile;
+	worker_pool pool;
+};
+
+#endif // SOFT_RASTER
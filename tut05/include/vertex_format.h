@@ -0,0 +1,135 @@
+#ifndef VERTEX_FORMAT
+#define VERTEX_FORMAT
+
+//
+// Header file for compact vertex formats.
+//
+// Meshes load as three floats a position and three a color, 24 bytes a
+// vertex. Packing interleaves both into one buffer of smaller types that
+// the vertex fetch expands back for free:
+//
+// - positions as 16-bit SNORM, every axis mapped from the mesh's bounding
+//   box to -1..1 and put back by a per-mesh dequantization matrix, to be
+//   folded into the model matrix; or as half floats, which need no matrix
+//   but keep only 11 bits of mantissa. Either is padded to 8 bytes.
+// - colors as normalized unsigned bytes, alpha included, 4 bytes.
+//
+// That makes 12 bytes a vertex, half of the floats. Normals, which the
+// tutorials' meshes don't have yet, take two SNORM16 (4 bytes against 12)
+// with the octahedral encoding below.
+//
+// The conversions go 4 floats at a step with SSE2, and to half floats with
+// F16C when the CPU has it. Every packed vertex is then decoded again and
+// checked against its source: one off by more than the format allows
+// fails the packing, rather than drawing a mesh that moved.
+//
+
+#include "mesh_file.h"
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+enum position_format {
+	POSITION_FLOAT,
+	POSITION_HALF,
+	POSITION_SNORM16
+};
+
+enum color_format {
+	COLOR_FLOAT,
+	COLOR_UNORM8
+};
+
+struct vertex_format {
+	position_format position;
+	color_format color;
+};
+
+// What meshes load as, and the smallest packing.
+const vertex_format FLOAT_VERTEX_FORMAT = { POSITION_FLOAT, COLOR_FLOAT };
+const vertex_format COMPACT_VERTEX_FORMAT = {
+	POSITION_SNORM16, COLOR_UNORM8
+};
+
+//
+// Where an attribute is in its buffer, as glVertexAttribPointer takes it.
+//
+struct attribute_layout {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	size_t offset;
+};
+
+// Tightly packed floats, the layout of unpacked meshes.
+const attribute_layout FLOAT3_LAYOUT = { 3, GL_FLOAT, GL_FALSE, 0, 0 };
+
+struct packed_mesh {
+	// stride bytes a vertex, both attributes interleaved.
+	std::vector<GLubyte> vertices;
+	GLsizei stride;
+	attribute_layout position;
+	attribute_layout color;
+	// From packed positions to the mesh's, identity but for SNORM16.
+	glm::mat4 dequantize;
+	// Largest difference between a decoded value and its source.
+	float position_error;
+	float color_error;
+};
+
+//
+// "float" keeps the floats, "half" and "snorm16" pack the positions so
+// and the colors as UNORM8. Returns false for any other name.
+//
+bool parse_vertex_format(const char *name, vertex_format &format);
+
+const char *vertex_format_name(const vertex_format &format);
+
+//
+// Bytes a vertex takes in format, padding included.
+//
+GLsizei vertex_format_stride(const vertex_format &format);
+
+//
+// Whether GL can fetch the format: half floats need OpenGL 3.0 or
+// ARB_half_float_vertex, the rest is OpenGL 2.0.
+//
+bool vertex_format_supported(const vertex_format &format);
+
+//
+// Pack the vertices of mesh into format and check every one of them
+// within the format's error: half an SNORM16 step of the bounding box on
+// each axis, half a half-float ulp, and half a 255th for colors, which
+// must be in 0..1. GL before 4.2 decodes SNORM a little differently, up
+// to one more step off, and is checked within one and a half steps.
+// Errors are printed.
+//
+bool pack_vertices(const mesh_view &mesh, const vertex_format &format,
+		packed_mesh &packed);
+
+//
+// Unit normal to two SNORM16 through the octahedral mapping (Meyer et
+// al., "On Floating-Point Normal Vectors"), and back. The round trip is
+// off by less than a tenth of a degree.
+//
+void encode_octahedral(const glm::vec3 &normal, GLshort encoded[2]);
+glm::vec3 decode_octahedral(const GLshort encoded[2]);
+
+//
+// Name of the conversion path pack_vertices() takes for format on this
+// CPU.
+//
+const char *vertex_format_simd_name(const vertex_format &format);
+
+//
+// Print the vertices packed so far, the bytes they save and the largest
+// errors.
+//
+void print_vertex_format_report();
+
+#endif // VERTEX_FORMAT
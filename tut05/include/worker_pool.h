@@ -0,0 +1,63 @@
+#ifndef WORKER_POOL
+#define WORKER_POOL
+
+//
+// Header file for a pool of worker threads running passes.
+//
+// The thread calling run() is worker 0 and the pool's threads are workers
+// 1 and up: every one of them runs the pass once with its own number, and
+// run() returns when all have. Workers wait on a condition variable
+// between passes, each new pass being a new generation, so nothing spins.
+//
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class worker_pool {
+public:
+	worker_pool();
+	~worker_pool();
+
+	worker_pool(const worker_pool &) = delete;
+	worker_pool &operator=(const worker_pool &) = delete;
+
+	//
+	// Start threads - 1 threads, the caller of run() making up the
+	// count. With 0, one a core.
+	//
+	void start(int threads = 0);
+
+	int threads() const { return workers.size() + 1; }
+
+	//
+	// Run pass on every worker and wait for all of them. Without
+	// threads, only on the caller.
+	//
+	void run(const std::function<void(int)> &pass);
+
+	//
+	// Stop the threads, between passes.
+	//
+	void stop();
+
+	//
+	// Cores of the host, at least 1.
+	//
+	static int cores();
+
+private:
+	void work(int worker, unsigned long seen);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable started, finished;
+	const std::function<void(int)> *pass;
+	unsigned long generation;
+	int running;
+	bool stopping;
+};
+
+#endif // WORKER_POOL
@@ -0,0 +1,162 @@
+//
+// Source implementation file for the read-only asset reader.
+//
+
+#include "../include/asset_file.h"
+
+#include "SDL.h"
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ASSET_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+asset_file::asset_file()
+	: bytes(""), length(0), opened(false), mapped(false)
+{
+}
+
+//
+// Map the file if possible and fall back to SDL_RWops otherwise.
+//
+asset_file::asset_file(const char *filename)
+	: bytes(""), length(0), opened(false), mapped(false)
+{
+	opened = map_file(filename) || read_file(filename);
+}
+
+asset_file::~asset_file()
+{
+	close();
+}
+
+asset_file::asset_file(asset_file &&other)
+	: bytes(""), length(0), opened(false), mapped(false)
+{
+	*this = std::move(other);
+}
+
+asset_file &asset_file::operator=(asset_file &&other)
+{
+	if (this == &other)
+		return *this;
+
+	close();
+	bytes = other.bytes;
+	length = other.length;
+	opened = other.opened;
+	mapped = other.mapped;
+	fallback = std::move(other.fallback);
+	if (!mapped && length > 0)
+		bytes = fallback.data();
+
+	// The mapping now belongs to this object.
+	other.bytes = "";
+	other.length = 0;
+	other.opened = false;
+	other.mapped = false;
+
+	return *this;
+}
+
+asset_view asset_file::view() const
+{
+	asset_view res = { bytes, length };
+
+	return res;
+}
+
+//
+// Map the whole file read-only. Empty files are not mapped.
+//
+bool asset_file::map_file(const char *filename)
+{
+#ifdef ASSET_FILE_MMAP
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return false;
+	}
+
+	if (st.st_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed.
+	::close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+
+	bytes = static_cast<const char *>(addr);
+	length = st.st_size;
+	mapped = true;
+
+	return true;
+#else
+	(void)filename;
+	return false;
+#endif
+}
+
+//
+// Read the file by chunks through SDL_RWops for Android asset support.
+//
+bool asset_file::read_file(const char *filename)
+{
+	SDL_RWops *rw = SDL_RWFromFile(filename, "rb");
+	if (rw == nullptr)
+		return false;
+
+	Sint64 res_size = SDL_RWsize(rw);
+	if (res_size < 0) {
+		SDL_RWclose(rw);
+		return false;
+	}
+
+	fallback.resize(res_size);
+	Sint64 nb_read_total = 0, nb_read = 1;
+	while (nb_read_total < res_size && nb_read != 0) {
+		nb_read = SDL_RWread(rw,
+				fallback.data() + nb_read_total,
+				1,
+				res_size - nb_read_total);
+
+		nb_read_total += nb_read;
+	}
+
+	SDL_RWclose(rw);
+	// If the whole file wasn't read, error out.
+	if (nb_read_total != res_size) {
+		fallback.clear();
+		return false;
+	}
+
+	bytes = res_size > 0 ? fallback.data() : "";
+	length = res_size;
+
+	return true;
+}
+
+void asset_file::close()
+{
+#ifdef ASSET_FILE_MMAP
+	if (mapped)
+		munmap(const_cast<char *>(bytes), length);
+#endif
+
+	fallback.clear();
+	bytes = "";
+	length = 0;
+	opened = false;
+	mapped = false;
+}
@@ -0,0 +1,151 @@
+//
+// Microbenchmark: asset_file against the old chunked SDL_RWread path.
+// Build with `make bench_asset_file` and run it from a writable directory.
+//
+
+#include "../include/asset_file.h"
+
+#include "SDL.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const char * const BENCH_FILENAME = "bench_asset_file.tmp";
+const size_t BENCH_SIZES[] = {
+	1 << 10, 16 << 10, 256 << 10, 4 << 20, 64 << 20
+};
+// Roughly this many bytes are loaded per size and reader.
+const size_t BENCH_BYTES = 256 << 20;
+
+//
+// The reader shader_utils used before asset_file, kept as the baseline.
+// NOTE: Make sure to delete[] the returned buffer.
+//
+char *file_read(const char *filename)
+{
+	SDL_RWops *rw = SDL_RWFromFile(filename, "rb");
+	if (rw == nullptr)
+		return nullptr;
+
+	Sint64 res_size = SDL_RWsize(rw);
+	char *res = new char[res_size + 1];
+
+	Sint64 nb_read_total = 0, nb_read = 1;
+	char *buf = res;
+	// Read the file by chunks until its all read.
+	while (nb_read_total < res_size && nb_read != 0) {
+		nb_read = SDL_RWread(rw, buf, 1, (res_size - nb_read_total));
+		nb_read_total += nb_read;
+		buf += nb_read;
+	}
+
+	SDL_RWclose(rw);
+	// If the whole file wasn't read, error out.
+	if (nb_read_total != res_size) {
+		delete[] res;
+		return nullptr;
+	}
+
+	res[nb_read_total] = '\0';
+
+	return res;
+}
+
+bool write_file(const char *filename, size_t size)
+{
+	std::vector<char> data(size);
+	for (size_t i = 0; i < size; ++i)
+		data[i] = 'a' + i % 26;
+
+	SDL_RWops *rw = SDL_RWFromFile(filename, "wb");
+	if (rw == nullptr)
+		return false;
+
+	bool write_ok = SDL_RWwrite(rw, data.data(), size, 1) == 1;
+	SDL_RWclose(rw);
+
+	return write_ok;
+}
+
+//
+// Touch every page so lazily mapped files are charged their faults too.
+//
+unsigned checksum(const char *data, size_t size)
+{
+	unsigned sum = 0;
+	for (size_t i = 0; i < size; i += 64)
+		sum += (unsigned char)data[i];
+
+	return sum;
+}
+
+double elapsed_ms(Uint64 start)
+{
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency();
+}
+
+// End of anon namespace.
+}
+
+int main()
+{
+	cout << "size_bytes,iterations,chunked_us,mapped_us,"
+		<< "chunked_mb_s,mapped_mb_s,mapped" << endl;
+
+	for (size_t size : BENCH_SIZES) {
+		if (!write_file(BENCH_FILENAME, size)) {
+			cerr << "Error writing " << BENCH_FILENAME << ": "
+				<< SDL_GetError() << endl;
+
+			return EXIT_FAILURE;
+		}
+
+		size_t iterations = BENCH_BYTES / size;
+		if (iterations < 8)
+			iterations = 8;
+
+		unsigned sum = 0;
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (size_t i = 0; i < iterations; ++i) {
+			char *data = file_read(BENCH_FILENAME);
+			sum += checksum(data, size);
+			delete[] data;
+		}
+		double chunked_ms = elapsed_ms(start);
+
+		bool mapped = false;
+		start = SDL_GetPerformanceCounter();
+		for (size_t i = 0; i < iterations; ++i) {
+			asset_file file(BENCH_FILENAME);
+			sum += checksum(file.data(), file.size());
+			mapped = file.is_mapped();
+		}
+		double mapped_ms = elapsed_ms(start);
+
+		double mb = (double)size * iterations / (1 << 20);
+		cout << size << "," << iterations << ","
+			<< chunked_ms * 1000.0 / iterations << ","
+			<< mapped_ms * 1000.0 / iterations << ","
+			<< mb / (chunked_ms / 1000.0) << ","
+			<< mb / (mapped_ms / 1000.0) << ","
+			<< mapped << endl;
+
+		// Keep the checksums alive.
+		if (sum == 1)
+			cerr << sum;
+	}
+
+	std::remove(BENCH_FILENAME);
+
+	return EXIT_SUCCESS;
+}
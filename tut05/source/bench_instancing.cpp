@@ -0,0 +1,230 @@
+//
+// Benchmark: frame time of a field of N cubes drawn with one instanced call
+// against N separate draws, for N from 1 to 1,000,000.
+// Build with `make bench_instancing` and run it from tut05, it uses the
+// cube shaders.
+//
+
+#include "../include/cube_field.h"
+#include "../include/gl_state.h"
+#include "../include/mesh.h"
+#include "../include/shader_queue.h"
+
+#include <SDL.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const char * const CUBE_VERTEX_SHADER = "glsl/cube.v.glsl";
+const char * const CUBE_INSTANCED_VERTEX_SHADER =
+	"glsl/cube_instanced.v.glsl";
+const char * const CUBE_FRAGMENT_SHADER = "glsl/cube.f.glsl";
+const int WIDTH = 800, HEIGHT = 600;
+const GLsizei MAX_CUBES = 1000000;
+// Draws timed per mode and size, fewer frames are run for big fields.
+const double DRAWS_PER_SIZE = 200000.0;
+const int MAX_FRAMES = 20;
+
+const GLfloat CUBE_VERTICES[] = {
+	-1.0, -1.0, 1.0, 1.0, -1.0, 1.0, 1.0, 1.0, 1.0, -1.0, 1.0, 1.0,
+	-1.0, -1.0, -1.0, 1.0, -1.0, -1.0, 1.0, 1.0, -1.0, -1.0, 1.0, -1.0
+};
+const GLfloat CUBE_COLORS[] = {
+	1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0,
+	1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0
+};
+const GLushort CUBE_ELEMENTS[] = {
+	0, 1, 2, 2, 3, 0, 1, 5, 6, 6, 2, 1, 7, 6, 5, 5, 4, 7,
+	4, 0, 3, 3, 7, 4, 4, 5, 1, 1, 0, 4, 3, 2, 6, 6, 7, 3
+};
+
+gl_state state;
+
+GLuint upload(const void *data, GLsizeiptr size)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+
+	return buffer;
+}
+
+//
+// Average milliseconds per frame, including the wait for the GPU.
+//
+template <typename F>
+double time_frames(int frames, F draw_frame)
+{
+	// One untimed frame first, for lazily created driver state.
+	draw_frame();
+	glFinish();
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < frames; ++i) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		draw_frame();
+		glFinish();
+	}
+
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency() / frames;
+}
+
+// End of anon namespace.
+}
+
+int main()
+{
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow("bench_instancing",
+						SDL_WINDOWPOS_CENTERED,
+						SDL_WINDOWPOS_CENTERED,
+						WIDTH,
+						HEIGHT,
+						SDL_WINDOW_HIDDEN |
+						SDL_WINDOW_OPENGL);
+
+	if (window == nullptr) {
+		cerr << "Error: can't create window: " << SDL_GetError()
+			<< endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (SDL_GL_CreateContext(window) == nullptr) {
+		cerr << "Error: SDL_GL_CreateContext: "
+			<< SDL_GetError() << endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (glewInit() != GLEW_OK || !GLEW_VERSION_2_0) {
+		cerr << "Error: OpenGL 2.0 is required" << endl;
+		return EXIT_FAILURE;
+	}
+
+	bool instanced = mesh::instancing_supported();
+	if (!instanced)
+		cerr << "No instancing support, timing separate draws only"
+			<< endl;
+
+	GLuint program = create_program(CUBE_VERTEX_SHADER,
+					CUBE_FRAGMENT_SHADER);
+	GLuint instanced_program = 0;
+	if (instanced) {
+		instanced_program = create_program(CUBE_INSTANCED_VERTEX_SHADER,
+						CUBE_FRAGMENT_SHADER);
+	}
+
+	if (program == 0 || (instanced && instanced_program == 0))
+		return EXIT_FAILURE;
+
+	GLuint vbo_vertices = upload(CUBE_VERTICES, sizeof(CUBE_VERTICES));
+	GLuint vbo_colors = upload(CUBE_COLORS, sizeof(CUBE_COLORS));
+	GLuint ibo;
+	glGenBuffers(1, &ibo);
+	draw_descriptor cube_draw = upload_elements(state, ibo, GL_TRIANGLES,
+					CUBE_ELEMENTS,
+					sizeof(CUBE_ELEMENTS) / sizeof(GLushort));
+
+	mesh cube;
+	cube.attribute(glGetAttribLocation(program, "coord3d"),
+			vbo_vertices, 3, GL_FLOAT);
+	cube.attribute(glGetAttribLocation(program, "v_color"),
+			vbo_colors, 3, GL_FLOAT);
+	cube.elements(ibo, cube_draw);
+	cube.build(state);
+
+	// The camera of cube.cpp, frozen at 45 degrees.
+	glm::mat4 mvp = glm::perspective(45.0f, 1.0f * WIDTH / HEIGHT,
+					0.1f, 10.0f) *
+			glm::lookAt(glm::vec3(0.0, 2.0, 0.0),
+					glm::vec3(0.0, 0.0, -4.0),
+					glm::vec3(0.0, 1.0, 0.0)) *
+			glm::translate(glm::mat4(1.0f),
+					glm::vec3(0.0, 0.0, -4.0)) *
+			glm::rotate(glm::mat4(1.0f),
+					glm::radians(45.0f),
+					glm::vec3(0, 1, 0));
+
+	GLint uniform_mvp = glGetUniformLocation(program, "mvp");
+	GLint uniform_field_mvp = -1;
+	if (instanced)
+		uniform_field_mvp = glGetUniformLocation(instanced_program, "mvp");
+
+	state.viewport(0, 0, WIDTH, HEIGHT);
+	state.enable(GL_DEPTH_TEST);
+	state.clear_color(1.0, 1.0, 1.0, 1.0);
+
+	cout << "cubes,frames,instanced_ms,separate_ms" << endl;
+
+	cube_field field;
+	for (GLsizei n = 1; n <= MAX_CUBES; n *= 10) {
+		int frames = DRAWS_PER_SIZE / n;
+		if (frames > MAX_FRAMES)
+			frames = MAX_FRAMES;
+		else if (frames < 2)
+			frames = 2;
+
+		field.layout(state, n);
+		double instanced_ms = 0.0;
+		if (instanced) {
+			state.use_program(instanced_program);
+			glUniformMatrix4fv(uniform_field_mvp, 1, GL_FALSE,
+					glm::value_ptr(mvp));
+
+			field.build(state,
+					glGetAttribLocation(instanced_program,
+							"coord3d"),
+					vbo_vertices,
+					glGetAttribLocation(instanced_program,
+							"v_color"),
+					vbo_colors,
+					glGetAttribLocation(instanced_program,
+							"instance_model"),
+					ibo, cube_draw);
+
+			instanced_ms = time_frames(frames, [&] {
+				field.draw(state);
+			});
+		}
+
+		state.use_program(program);
+		double separate_ms = time_frames(frames, [&] {
+			for (GLsizei i = 0; i < field.size(); ++i) {
+				glm::mat4 m = mvp * field.model(i);
+				glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE,
+						glm::value_ptr(m));
+
+				cube.draw(state);
+			}
+		});
+
+		cout << n << "," << frames << "," << instanced_ms << ","
+			<< separate_ms << endl;
+	}
+
+	state.bind_vertex_array(0);
+	field.clear();
+	cube.clear();
+	glDeleteBuffers(1, &vbo_vertices);
+	glDeleteBuffers(1, &vbo_colors);
+	glDeleteBuffers(1, &ibo);
+	glDeleteProgram(program);
+	glDeleteProgram(instanced_program);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+//
+// Microbenchmark: CPU time to submit draws of many small meshes, with the
+// per-frame attribute setup cube.cpp used to do against mesh::draw().
+// Build with `make bench_mesh` and run it from tut05, it uses the cube
+// shaders. The first argument overrides the number of meshes.
+//
+
+#include "../include/gl_state.h"
+#include "../include/mesh.h"
+#include "../include/shader_queue.h"
+
+#include <SDL.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const char * const CUBE_VERTEX_SHADER = "glsl/cube.v.glsl";
+const char * const CUBE_FRAGMENT_SHADER = "glsl/cube.f.glsl";
+const int DEFAULT_MESHES = 4096;
+const int WARMUP_FRAMES = 3;
+const int FRAMES = 20;
+
+const GLfloat CUBE_VERTICES[] = {
+	-1.0, -1.0, 1.0, 1.0, -1.0, 1.0, 1.0, 1.0, 1.0, -1.0, 1.0, 1.0,
+	-1.0, -1.0, -1.0, 1.0, -1.0, -1.0, 1.0, 1.0, -1.0, -1.0, 1.0, -1.0
+};
+const GLfloat CUBE_COLORS[] = {
+	1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0,
+	1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0
+};
+const GLushort CUBE_ELEMENTS[] = {
+	0, 1, 2, 2, 3, 0, 1, 5, 6, 6, 2, 1, 7, 6, 5, 5, 4, 7,
+	4, 0, 3, 3, 7, 4, 4, 5, 1, 1, 0, 4, 3, 2, 6, 6, 7, 3
+};
+const GLsizei CUBE_INDEX_COUNT = sizeof(CUBE_ELEMENTS) / sizeof(GLushort);
+
+// Buffers of one cube, each mesh gets its own like separate models would.
+struct cube_buffers {
+	GLuint vertices;
+	GLuint colors;
+	GLuint elements;
+};
+
+gl_state state;
+GLint attribute_coord3d, attribute_v_color;
+
+GLuint upload(GLenum target, const void *data, GLsizeiptr size)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	glBufferData(target, size, data, GL_STATIC_DRAW);
+
+	return buffer;
+}
+
+//
+// The old render() path: set up and tear down every attribute per draw.
+//
+void draw_immediate(const cube_buffers &b)
+{
+	glEnableVertexAttribArray(attribute_coord3d);
+	state.bind_buffer(GL_ARRAY_BUFFER, b.vertices);
+	glVertexAttribPointer(attribute_coord3d, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(attribute_v_color);
+	state.bind_buffer(GL_ARRAY_BUFFER, b.colors);
+	glVertexAttribPointer(attribute_v_color, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, b.elements);
+	glDrawElements(GL_TRIANGLES, CUBE_INDEX_COUNT, GL_UNSIGNED_SHORT, 0);
+	glDisableVertexAttribArray(attribute_coord3d);
+	glDisableVertexAttribArray(attribute_v_color);
+}
+
+//
+// Average microseconds spent submitting one frame of draws. The GPU is
+// drained between frames and not timed.
+//
+template <typename F>
+double time_frames(F draw_frame)
+{
+	double total = 0.0;
+	for (int i = 0; i < WARMUP_FRAMES + FRAMES; ++i) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		draw_frame();
+		Uint64 end = SDL_GetPerformanceCounter();
+		glFinish();
+		if (i >= WARMUP_FRAMES)
+			total += end - start;
+	}
+
+	return total * 1000000.0 / SDL_GetPerformanceFrequency() / FRAMES;
+}
+
+void print_row(const char *mode, int meshes, double frame_us)
+{
+	cout << mode << "," << meshes << "," << frame_us << ","
+		<< frame_us * 1000.0 / meshes << endl;
+}
+
+// End of anon namespace.
+}
+
+int main(int argc, char *argv[])
+{
+	int meshes = DEFAULT_MESHES;
+	if (argc > 1)
+		meshes = atoi(argv[1]);
+
+	if (meshes <= 0) {
+		cerr << "Usage: bench_mesh [meshes]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow("bench_mesh",
+						SDL_WINDOWPOS_CENTERED,
+						SDL_WINDOWPOS_CENTERED,
+						64,
+						64,
+						SDL_WINDOW_HIDDEN |
+						SDL_WINDOW_OPENGL);
+
+	if (window == nullptr) {
+		cerr << "Error: can't create window: " << SDL_GetError()
+			<< endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (SDL_GL_CreateContext(window) == nullptr) {
+		cerr << "Error: SDL_GL_CreateContext: "
+			<< SDL_GetError() << endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (glewInit() != GLEW_OK || !GLEW_VERSION_2_0) {
+		cerr << "Error: OpenGL 2.0 is required" << endl;
+		return EXIT_FAILURE;
+	}
+
+	GLuint program = create_program(CUBE_VERTEX_SHADER,
+					CUBE_FRAGMENT_SHADER);
+	if (program == 0)
+		return EXIT_FAILURE;
+
+	attribute_coord3d = glGetAttribLocation(program, "coord3d");
+	attribute_v_color = glGetAttribLocation(program, "v_color");
+	state.use_program(program);
+	// A zero MVP collapses every cube to a point, so the GPU has almost
+	// nothing to rasterize and the timings are submission cost.
+	GLfloat zero[16] = { 0 };
+	glUniformMatrix4fv(glGetUniformLocation(program, "mvp"), 1, GL_FALSE,
+			zero);
+
+	draw_descriptor cube_draw;
+	std::vector<cube_buffers> buffers(meshes);
+	for (cube_buffers &b : buffers) {
+		b.vertices = upload(GL_ARRAY_BUFFER, CUBE_VERTICES,
+					sizeof(CUBE_VERTICES));
+		b.colors = upload(GL_ARRAY_BUFFER, CUBE_COLORS,
+					sizeof(CUBE_COLORS));
+		glGenBuffers(1, &b.elements);
+		cube_draw = upload_elements(state, b.elements, GL_TRIANGLES,
+					CUBE_ELEMENTS, CUBE_INDEX_COUNT);
+	}
+
+	state.invalidate();
+
+	cout << "mode,meshes,frame_us,mesh_ns" << endl;
+
+	print_row("immediate", meshes, time_frames([&] {
+		for (const cube_buffers &b : buffers)
+			draw_immediate(b);
+	}));
+
+	// The emulated path always runs, the vertex array one only if the
+	// context has them.
+	for (int emulate = 1; emulate >= 0; --emulate) {
+		if (!emulate && !mesh::vertex_arrays_supported())
+			break;
+
+		std::vector<mesh> cubes(meshes);
+		for (int i = 0; i < meshes; ++i) {
+			cubes[i].attribute(attribute_coord3d,
+					buffers[i].vertices, 3, GL_FLOAT);
+
+			cubes[i].attribute(attribute_v_color,
+					buffers[i].colors, 3, GL_FLOAT);
+
+			cubes[i].elements(buffers[i].elements, cube_draw);
+			cubes[i].build(state, emulate);
+		}
+
+		print_row(emulate ? "emulated" : "vertex_array", meshes,
+			time_frames([&] {
+				for (const mesh &m : cubes)
+					m.draw(state);
+			}));
+
+		if (!emulate)
+			state.bind_vertex_array(0);
+	}
+
+	for (cube_buffers &b : buffers) {
+		glDeleteBuffers(1, &b.vertices);
+		glDeleteBuffers(1, &b.colors);
+		glDeleteBuffers(1, &b.elements);
+	}
+
+	glDeleteProgram(program);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+//
+// Benchmark: importing an OBJ file against mapping its mesh cache.
+// Build with `make bench_mesh_file` and run it from a writable directory,
+// optionally with the number of triangles, 10 million by default.
+//
+
+#include "../include/mesh_file.h"
+
+#include "SDL.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const char * const BENCH_FILENAME = "bench_mesh_file.obj";
+const long DEFAULT_TRIANGLES = 10000000;
+
+//
+// A side by side grid of quads, bent into a wave so the positions aren't
+// all round numbers, with two triangles a quad and colored vertices.
+//
+bool write_obj(const char *filename, long side, Uint64 &bytes)
+{
+	SDL_RWops *rw = SDL_RWFromFile(filename, "wb");
+	if (rw == nullptr)
+		return false;
+
+	bool write_ok = true;
+	std::string chunk;
+	char line[128];
+	bytes = 0;
+	for (long y = 0; y <= side && write_ok; ++y) {
+		chunk.clear();
+		for (long x = 0; x <= side; ++x) {
+			double u = (double)x / side, v = (double)y / side;
+			snprintf(line, sizeof(line),
+				"v %.6f %.6f %.6f %.3f %.3f %.3f\n",
+				u, v, 0.1 * std::sin(10.0 * u) *
+					std::cos(10.0 * v),
+				u, v, 1.0 - u);
+
+			chunk += line;
+		}
+
+		bytes += chunk.size();
+		write_ok = SDL_RWwrite(rw, chunk.data(), chunk.size(), 1) == 1;
+	}
+
+	for (long y = 0; y < side && write_ok; ++y) {
+		chunk.clear();
+		for (long x = 0; x < side; ++x) {
+			long a = y * (side + 1) + x + 1, b = a + 1;
+			long c = a + side + 1, d = c + 1;
+			snprintf(line, sizeof(line), "f %ld %ld %ld\nf %ld %ld %ld\n",
+				a, b, d, a, d, c);
+
+			chunk += line;
+		}
+
+		bytes += chunk.size();
+		write_ok = SDL_RWwrite(rw, chunk.data(), chunk.size(), 1) == 1;
+	}
+
+	SDL_RWclose(rw);
+
+	return write_ok;
+}
+
+//
+// Touch every page so lazily mapped files are charged their faults too.
+//
+unsigned checksum(const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	unsigned sum = 0;
+	for (size_t i = 0; i < size; i += 64)
+		sum += bytes[i];
+
+	return sum;
+}
+
+double elapsed_ms(Uint64 start)
+{
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency();
+}
+
+// End of anon namespace.
+}
+
+int main(int argc, char *argv[])
+{
+	long triangles = argc > 1 ? atol(argv[1]) : DEFAULT_TRIANGLES;
+	long side = std::max(1L, (long)std::sqrt(triangles / 2.0));
+
+	Uint64 obj_bytes;
+	if (!write_obj(BENCH_FILENAME, side, obj_bytes)) {
+		cerr << "Error writing " << BENCH_FILENAME << ": "
+			<< SDL_GetError() << endl;
+
+		return EXIT_FAILURE;
+	}
+
+	// Parsing, fitting and optimizing, as the first load does.
+	mesh_data imported;
+	Uint64 start = SDL_GetPerformanceCounter();
+	if (!import_mesh(BENCH_FILENAME, imported))
+		return EXIT_FAILURE;
+
+	double import_ms = elapsed_ms(start);
+
+	// The first load writes the cache, the second only maps it.
+	mesh_file mesh;
+	if (!mesh.load(BENCH_FILENAME))
+		return EXIT_FAILURE;
+
+	start = SDL_GetPerformanceCounter();
+	if (!mesh.load(BENCH_FILENAME) || !mesh.from_cache()) {
+		cerr << "Error: the mesh cache wasn't used" << endl;
+		return EXIT_FAILURE;
+	}
+
+	const mesh_view &view = mesh.view();
+	unsigned sum = checksum(view.positions,
+				view.vertices * 3 * sizeof(GLfloat)) +
+		checksum(view.colors, view.vertices * 3 * sizeof(GLfloat)) +
+		checksum(view.indices, view.count * sizeof(GLuint));
+
+	double cache_ms = elapsed_ms(start);
+
+	cout << "triangles,obj_bytes,import_ms,cache_ms,speedup" << endl;
+	cout << view.count / 3 << "," << obj_bytes << "," << import_ms << ","
+		<< cache_ms << "," << import_ms / cache_ms << endl;
+
+	// Keep the checksum alive.
+	if (sum == 1)
+		cerr << sum;
+
+	std::remove(BENCH_FILENAME);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+//
+// Microbenchmark: MVP for N transforms with scalar glm against the SoA
+// SIMD batch of transform_array, for N from 10,000 to 1,000,000.
+// Build with `make bench_transform`; the Makefile builds without
+// optimization, so for numbers that mean something add -O2 to CFLAGS.
+//
+
+#include "../include/camera.h"
+
+#include <SDL.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const size_t BENCH_COUNTS[] = { 10000, 100000, 1000000 };
+// Roughly this many transforms are timed per count and path.
+const double TRANSFORMS_PER_COUNT = 20000000.0;
+
+double elapsed_ms(Uint64 start)
+{
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency();
+}
+
+//
+// Largest difference of any element between the two sets of matrices.
+//
+float max_error(const std::vector<glm::mat4> &a,
+		const std::vector<glm::mat4> &b)
+{
+	float error = 0.0f;
+	for (size_t i = 0; i < a.size(); ++i) {
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 4; ++r) {
+				error = std::max(error,
+						std::fabs(a[i][c][r] -
+							b[i][c][r]));
+			}
+		}
+	}
+
+	return error;
+}
+
+// End of anon namespace.
+}
+
+int main()
+{
+	camera view;
+	view.set_viewport(800, 600);
+	view.look_at(glm::vec3(0.0, 2.0, 0.0), glm::vec3(0.0, 0.0, -4.0),
+		glm::vec3(0.0, 1.0, 0.0));
+
+	glm::mat4 frame = view.view_projection() *
+		glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0, 1, 0));
+
+	cout << "count,iterations,scalar_ms,simd_ms,scalar_mt_s,simd_mt_s,"
+		<< "simd,max_error" << endl;
+
+	for (size_t count : BENCH_COUNTS) {
+		std::vector<glm::mat4> models(count);
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec3 position(i % 100, i / 100 % 100,
+					i / 10000.0f);
+
+			models[i] = glm::translate(glm::mat4(1.0f), position);
+		}
+
+		transform_array transforms;
+		transforms.assign(models.data(), count);
+
+		size_t iterations = TRANSFORMS_PER_COUNT / count;
+		std::vector<glm::mat4> scalar(count), simd(count);
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (size_t n = 0; n < iterations; ++n) {
+			for (size_t i = 0; i < count; ++i)
+				scalar[i] = frame * models[i];
+		}
+		double scalar_ms = elapsed_ms(start);
+
+		start = SDL_GetPerformanceCounter();
+		for (size_t n = 0; n < iterations; ++n)
+			transforms.multiply(frame, simd.data());
+		double simd_ms = elapsed_ms(start);
+
+		double millions = (double)count * iterations / 1000000.0;
+		cout << count << "," << iterations << ","
+			<< scalar_ms / iterations << ","
+			<< simd_ms / iterations << ","
+			<< millions / (scalar_ms / 1000.0) << ","
+			<< millions / (simd_ms / 1000.0) << ","
+			<< transform_array::simd_name() << ","
+			<< max_error(scalar, simd) << endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+//
+// Benchmark: vertex bandwidth of a large mesh stored as floats, half
+// floats and SNORM16 positions (with UNORM8 colors). The mesh is drawn
+// many times a frame into a tiny viewport, so that fetching and shading
+// the vertices is most of the frame, and the vertex bytes read per second
+// come out of the frame time.
+// Build with `make bench_vertex_format` and run it from tut05, it uses the
+// cube shaders, optionally with the number of triangles, 4 million by
+// default.
+//
+
+#include "../include/gl_state.h"
+#include "../include/mesh.h"
+#include "../include/mesh_file.h"
+#include "../include/mesh_optimizer.h"
+#include "../include/shader_queue.h"
+#include "../include/vertex_format.h"
+
+#include <SDL.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const char * const CUBE_VERTEX_SHADER = "glsl/cube.v.glsl";
+const char * const CUBE_FRAGMENT_SHADER = "glsl/cube.f.glsl";
+// Small enough that rasterizing costs next to nothing.
+const int WIDTH = 64, HEIGHT = 64;
+const long DEFAULT_TRIANGLES = 4000000;
+const int DRAWS_PER_FRAME = 8;
+const int FRAMES = 20;
+const char * const FORMATS[] = { "float", "half", "snorm16" };
+
+gl_state state;
+
+//
+// A side by side grid of quads over -1..1, bent into a wave, with two
+// triangles a quad and colored vertices.
+//
+void build_grid(long side, mesh_data &grid)
+{
+	for (long y = 0; y <= side; ++y) {
+		for (long x = 0; x <= side; ++x) {
+			float u = (float)x / side, v = (float)y / side;
+			grid.positions.push_back(2.0f * u - 1.0f);
+			grid.positions.push_back(2.0f * v - 1.0f);
+			grid.positions.push_back(0.1f * std::sin(10.0f * u) *
+						std::cos(10.0f * v));
+
+			grid.colors.push_back(u);
+			grid.colors.push_back(v);
+			grid.colors.push_back(1.0f - u);
+		}
+	}
+
+	for (long y = 0; y < side; ++y) {
+		for (long x = 0; x < side; ++x) {
+			GLuint a = y * (side + 1) + x, b = a + 1;
+			GLuint c = a + side + 1, d = c + 1;
+			GLuint quad[] = { a, b, d, a, d, c };
+			grid.indices.insert(grid.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+//
+// Average milliseconds per frame, including the wait for the GPU.
+//
+template <typename F>
+double time_frames(int frames, F draw_frame)
+{
+	// One untimed frame first, for lazily created driver state.
+	draw_frame();
+	glFinish();
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < frames; ++i) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		draw_frame();
+		glFinish();
+	}
+
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency() / frames;
+}
+
+// End of anon namespace.
+}
+
+int main(int argc, char *argv[])
+{
+	long triangles = argc > 1 ? atol(argv[1]) : DEFAULT_TRIANGLES;
+	long side = std::max(1L, (long)std::sqrt(triangles / 2.0));
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow("bench_vertex_format",
+						SDL_WINDOWPOS_CENTERED,
+						SDL_WINDOWPOS_CENTERED,
+						WIDTH,
+						HEIGHT,
+						SDL_WINDOW_HIDDEN |
+						SDL_WINDOW_OPENGL);
+
+	if (window == nullptr) {
+		cerr << "Error: can't create window: " << SDL_GetError()
+			<< endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (SDL_GL_CreateContext(window) == nullptr) {
+		cerr << "Error: SDL_GL_CreateContext: "
+			<< SDL_GetError() << endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if (glewInit() != GLEW_OK || !GLEW_VERSION_2_0) {
+		cerr << "Error: OpenGL 2.0 is required" << endl;
+		return EXIT_FAILURE;
+	}
+
+	GLuint program = create_program(CUBE_VERTEX_SHADER,
+					CUBE_FRAGMENT_SHADER);
+	if (program == 0)
+		return EXIT_FAILURE;
+
+	// Reordered as cube.cpp loads meshes, so every vertex is fetched
+	// about once a draw.
+	mesh_data grid;
+	build_grid(side, grid);
+	optimize_mesh(grid);
+	mesh_view view = view_mesh(grid);
+
+	GLuint ibo;
+	glGenBuffers(1, &ibo);
+	draw_descriptor grid_draw = upload_elements(state, ibo, GL_TRIANGLES,
+						view.indices, view.count);
+
+	GLint coord3d = glGetAttribLocation(program, "coord3d");
+	GLint v_color = glGetAttribLocation(program, "v_color");
+	GLint uniform_mvp = glGetUniformLocation(program, "mvp");
+
+	state.viewport(0, 0, WIDTH, HEIGHT);
+	state.enable(GL_DEPTH_TEST);
+	state.clear_color(1.0, 1.0, 1.0, 1.0);
+	state.use_program(program);
+
+	cout << "format,vertices,bytes_per_vertex,buffer_mb,pack_ms,frame_ms,"
+		<< "vertex_gb_per_s" << endl;
+
+	for (const char *name : FORMATS) {
+		vertex_format format;
+		parse_vertex_format(name, format);
+		if (!vertex_format_supported(format)) {
+			cerr << "No " << name << " vertex support, skipped"
+				<< endl;
+
+			continue;
+		}
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		packed_mesh packed;
+		if (!pack_vertices(view, format, packed))
+			return EXIT_FAILURE;
+
+		double pack_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+			SDL_GetPerformanceFrequency();
+
+		GLuint vbo;
+		glGenBuffers(1, &vbo);
+		state.bind_buffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, packed.vertices.size(),
+				packed.vertices.data(), GL_STATIC_DRAW);
+
+		mesh layout;
+		layout.attribute(coord3d, vbo, packed.position.size,
+				packed.position.type, packed.position.normalized,
+				packed.position.stride, packed.position.offset);
+		layout.attribute(v_color, vbo, packed.color.size,
+				packed.color.type, packed.color.normalized,
+				packed.color.stride, packed.color.offset);
+		layout.elements(ibo, grid_draw);
+		layout.build(state);
+
+		// The grid is already in clip space once dequantized.
+		glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE,
+				glm::value_ptr(packed.dequantize));
+
+		double frame_ms = time_frames(FRAMES, [&] {
+			for (int i = 0; i < DRAWS_PER_FRAME; ++i)
+				layout.draw(state);
+		});
+
+		double bytes = (double)packed.vertices.size() * DRAWS_PER_FRAME;
+		cout << name << "," << view.vertices << "," << packed.stride
+			<< "," << packed.vertices.size() / 1048576.0 << ","
+			<< pack_ms << "," << frame_ms << ","
+			<< bytes / (frame_ms * 1e6) << endl;
+
+		state.bind_vertex_array(0);
+		layout.clear();
+		glDeleteBuffers(1, &vbo);
+	}
+
+	print_vertex_format_report();
+
+	glDeleteBuffers(1, &ibo);
+	glDeleteProgram(program);
+
+	return EXIT_SUCCESS;
+}
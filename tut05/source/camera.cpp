@@ -0,0 +1,235 @@
+//
+// Source implementation file for the camera and batched transforms.
+//
+
+#include "../include/camera.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE__)
+#define TRANSFORM_SSE
+#include <immintrin.h>
+#endif
+
+// AVX is picked at run time, the rest of the build doesn't assume it.
+#if defined(TRANSFORM_SSE) && defined(__GNUC__) && defined(__x86_64__)
+#define TRANSFORM_AVX
+#endif
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Matrices per SoA row are padded to this.
+const size_t SOA_ALIGN = 8;
+
+//
+// Element (c, r) of left * matrix i, summed in the same order as glm so
+// that every path gives the same bits.
+//
+void multiply_scalar(const float *a, const float *soa, size_t stride,
+		size_t i, glm::mat4 &out)
+{
+	for (int c = 0; c < 4; ++c) {
+		for (int r = 0; r < 4; ++r) {
+			const float *b = soa + c * 4 * stride + i;
+			out[c][r] = a[r] * b[0] + a[4 + r] * b[stride] +
+				a[8 + r] * b[2 * stride] +
+				a[12 + r] * b[3 * stride];
+		}
+	}
+}
+
+#ifdef TRANSFORM_SSE
+
+//
+// Four matrices from i on: each element of the product is four lanes of
+// multiply-adds, then every column is transposed back into the matrices.
+//
+void multiply_sse(const __m128 *a, const float *soa, size_t stride,
+		size_t i, glm::mat4 *out)
+{
+	__m128 b[16];
+	for (int e = 0; e < 16; ++e)
+		b[e] = _mm_loadu_ps(soa + e * stride + i);
+
+	for (int c = 0; c < 4; ++c) {
+		__m128 column[4];
+		for (int r = 0; r < 4; ++r) {
+			__m128 sum = _mm_mul_ps(a[r], b[c * 4]);
+			for (int k = 1; k < 4; ++k) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(
+						a[k * 4 + r], b[c * 4 + k]));
+			}
+
+			column[r] = sum;
+		}
+
+		// Lane k of row r becomes row r of matrix k.
+		_MM_TRANSPOSE4_PS(column[0], column[1], column[2], column[3]);
+		for (int k = 0; k < 4; ++k)
+			_mm_storeu_ps(&out[i + k][c][0], column[k]);
+	}
+}
+
+#endif // TRANSFORM_SSE
+
+#ifdef TRANSFORM_AVX
+
+//
+// Eight matrices at a time, as multiply_sse() with twice the lanes, for
+// as many as there are whole groups of. Returns where it stopped.
+//
+__attribute__((target("avx")))
+size_t multiply_avx(const float *left, const float *soa, size_t stride,
+		size_t count, glm::mat4 *out)
+{
+	__m256 a[16];
+	for (int e = 0; e < 16; ++e)
+		a[e] = _mm256_set1_ps(left[e]);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 b[16];
+		for (int e = 0; e < 16; ++e)
+			b[e] = _mm256_loadu_ps(soa + e * stride + i);
+
+		for (int c = 0; c < 4; ++c) {
+			__m128 low[4], high[4];
+			for (int r = 0; r < 4; ++r) {
+				__m256 sum = _mm256_mul_ps(a[r], b[c * 4]);
+				for (int k = 1; k < 4; ++k) {
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(
+							a[k * 4 + r],
+							b[c * 4 + k]));
+				}
+
+				low[r] = _mm256_castps256_ps128(sum);
+				high[r] = _mm256_extractf128_ps(sum, 1);
+			}
+
+			_MM_TRANSPOSE4_PS(low[0], low[1], low[2], low[3]);
+			_MM_TRANSPOSE4_PS(high[0], high[1], high[2], high[3]);
+			for (int k = 0; k < 4; ++k) {
+				_mm_storeu_ps(&out[i + k][c][0], low[k]);
+				_mm_storeu_ps(&out[i + 4 + k][c][0], high[k]);
+			}
+		}
+	}
+
+	return i;
+}
+
+bool has_avx()
+{
+	static bool avx = __builtin_cpu_supports("avx");
+	return avx;
+}
+
+#endif // TRANSFORM_AVX
+
+// End of anon namespace.
+}
+
+camera::camera()
+	: view(1.0f), projection(1.0f), product(1.0f), width(1), height(1),
+	fov(45.0f), near_plane(0.1f), far_plane(10.0f),
+	stale_projection(true), stale_product(true)
+{
+}
+
+void camera::set_viewport(int new_width, int new_height)
+{
+	if (new_width == width && new_height == height)
+		return;
+
+	width = new_width;
+	height = new_height;
+	stale_projection = true;
+}
+
+void camera::set_lens(float new_fov, float z_near, float z_far)
+{
+	if (new_fov == fov && z_near == near_plane && z_far == far_plane)
+		return;
+
+	fov = new_fov;
+	near_plane = z_near;
+	far_plane = z_far;
+	stale_projection = true;
+}
+
+void camera::look_at(const glm::vec3 &eye, const glm::vec3 &center,
+		const glm::vec3 &up)
+{
+	view = glm::lookAt(eye, center, up);
+	stale_product = true;
+}
+
+const glm::mat4 &camera::view_projection()
+{
+	if (stale_projection) {
+		projection = glm::perspective(fov, 1.0f * width / height,
+					near_plane, far_plane);
+
+		stale_projection = false;
+		stale_product = true;
+	}
+
+	if (stale_product) {
+		product = projection * view;
+		stale_product = false;
+	}
+
+	return product;
+}
+
+void transform_array::assign(const glm::mat4 *matrices, size_t n)
+{
+	count = n;
+	stride = (n + SOA_ALIGN - 1) / SOA_ALIGN * SOA_ALIGN;
+	elements.assign(16 * stride, 0.0f);
+	for (size_t i = 0; i < n; ++i) {
+		const float *m = glm::value_ptr(matrices[i]);
+		for (int e = 0; e < 16; ++e)
+			elements[e * stride + i] = m[e];
+	}
+}
+
+void transform_array::multiply(const glm::mat4 &left, glm::mat4 *out) const
+{
+	const float *a = glm::value_ptr(left);
+	const float *soa = elements.data();
+	size_t i = 0;
+
+#ifdef TRANSFORM_AVX
+	if (has_avx())
+		i = multiply_avx(a, soa, stride, count, out);
+#endif
+
+#ifdef TRANSFORM_SSE
+	__m128 broadcast[16];
+	for (int e = 0; e < 16; ++e)
+		broadcast[e] = _mm_set1_ps(a[e]);
+
+	for (; i + 4 <= count; i += 4)
+		multiply_sse(broadcast, soa, stride, i, out);
+#endif
+
+	for (; i < count; ++i)
+		multiply_scalar(a, soa, stride, i, out[i]);
+}
+
+const char *transform_array::simd_name()
+{
+#ifdef TRANSFORM_AVX
+	if (has_avx())
+		return "avx";
+#endif
+
+#ifdef TRANSFORM_SSE
+	return "sse";
+#else
+	return "scalar";
+#endif
+}
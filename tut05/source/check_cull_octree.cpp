@@ -0,0 +1,169 @@
+//
+// Check: cull_octree against testing every box on its own, while boxes
+// drift, jump across the tree, change size and leave the root cell
+// through update() every frame. Any object one keeps and the other
+// doesn't is a mismatch, and the check fails.
+// Build and run with `make check_cull`, optionally with the number of
+// objects, 100,000 by default.
+//
+
+#include "../include/cull_octree.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const GLuint DEFAULT_OBJECTS = 100000;
+const int FRAMES = 120;
+// Objects are placed in the cube this far out from the origin each way,
+// and move up to a little past it.
+const float WORLD = 50.0f;
+const float OUTSIDE = 60.0f;
+
+// Same numbers on every run.
+std::minstd_rand random_engine(1);
+
+float random_float(float low, float high)
+{
+	float unit = (float)(random_engine() - random_engine.min()) /
+		(random_engine.max() - random_engine.min());
+
+	return low + (high - low) * unit;
+}
+
+//
+// Coordinates drawn one after the other, as the order arguments are
+// evaluated in isn't fixed.
+//
+glm::vec3 random_vec3(float low, float high)
+{
+	glm::vec3 res;
+	for (int a = 0; a < 3; ++a)
+		res[a] = random_float(low, high);
+
+	return res;
+}
+
+glm::vec3 random_point(float half_size)
+{
+	return random_vec3(-half_size, half_size);
+}
+
+//
+// Mostly small boxes, with now and then one as wide as a top level cell.
+//
+glm::vec3 random_extent()
+{
+	if (random_engine() % 100 == 0)
+		return glm::vec3(random_float(5.0f, 20.0f));
+
+	return random_vec3(0.05f, 1.0f);
+}
+
+//
+// Move one box of every twenty: most drift a little, some jump anywhere,
+// out of the root cell included, some change size.
+//
+size_t move_boxes(cull_octree &tree, std::vector<glm::vec3> &centers,
+		std::vector<glm::vec3> &extents)
+{
+	size_t moved = centers.size() / 20;
+	for (size_t n = 0; n < moved; ++n) {
+		GLuint id = random_engine() % centers.size();
+		switch (random_engine() % 10) {
+		case 0:
+			centers[id] = random_point(OUTSIDE);
+			break;
+		case 1:
+			extents[id] = random_extent();
+			break;
+		default:
+			centers[id] += random_point(0.5f);
+			break;
+		}
+
+		tree.update(id, centers[id], extents[id]);
+	}
+
+	return moved;
+}
+
+// End of anon namespace.
+}
+
+int main(int argc, char *argv[])
+{
+	GLuint count = argc > 1 ? atoi(argv[1]) : DEFAULT_OBJECTS;
+
+	cull_octree tree;
+	tree.reset(glm::vec3(0.0f), WORLD);
+	std::vector<glm::vec3> centers(count), extents(count);
+	for (GLuint i = 0; i < count; ++i) {
+		centers[i] = random_point(WORLD);
+		extents[i] = random_extent();
+		tree.insert(centers[i], extents[i]);
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f),
+						16.0f / 9.0f, 0.5f, 80.0f);
+	size_t updates = 0, mismatches = 0;
+	std::vector<GLuint> visible, expected;
+	for (int frame = 0; frame < FRAMES; ++frame) {
+		updates += move_boxes(tree, centers, extents);
+
+		// Around the field, looking somewhere inside it.
+		float angle = frame * 0.1f;
+		float height = random_float(-20.0f, 20.0f);
+		glm::vec3 eye(40.0f * std::cos(angle), height,
+			40.0f * std::sin(angle));
+		glm::vec3 target = random_point(20.0f);
+		glm::mat4 view = glm::lookAt(eye, target,
+					glm::vec3(0.0f, 1.0f, 0.0f));
+		frustum planes = frustum_from_matrix(projection * view);
+
+		tree.cull(planes, visible);
+		expected.clear();
+		for (GLuint i = 0; i < count; ++i) {
+			if (classify_box(planes, centers[i], extents[i]) >= 0)
+				expected.push_back(i);
+		}
+
+		// Both sorted, an object kept twice is a mismatch too.
+		std::sort(visible.begin(), visible.end());
+		std::vector<GLuint> different;
+		std::set_symmetric_difference(visible.begin(), visible.end(),
+					expected.begin(), expected.end(),
+					std::back_inserter(different));
+		mismatches += different.size();
+	}
+
+	cout << "Culling check: " << count << " objects over " << FRAMES
+		<< " frames, " << updates << " updates, " << mismatches
+		<< " mismatches" << endl;
+	tree.print_report();
+
+	if (mismatches > 0) {
+		cerr << "Error: cull_octree disagrees with testing every box"
+			<< endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,4 +1,25 @@
-#include "../include/shader_utils.h"
+#include "../include/camera.h"
+#include "../include/cube_field.h"
+#include "../include/cull_octree.h"
+#include "../include/display.h"
+#include "../include/draw_batch.h"
+#include "../include/fixed_step.h"
+#include "../include/frame_profile.h"
+#include "../include/gl_state.h"
+#include "../include/gpu_profile.h"
+#include "../include/mesh.h"
+#include "../include/mesh_file.h"
+#include "../include/mesh_optimizer.h"
+#include "../include/occlusion_culler.h"
+#include "../include/packet_ring.h"
+#include "../include/program_cache.h"
+#include "../include/query_check.h"
+#include "../include/shader_program.h"
+#include "../include/shader_queue.h"
+#include "../include/shader_watcher.h"
+#include "../include/soft_raster.h"
+#include "../include/vertex_format.h"
+#include "../include/worker_pool.h"
 
 #include <SDL.h> // SDL2 for base window and OpenGL context init.
 #define GLM_FORCE_RADIANS
@@ -9,9 +30,15 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 using std::cerr;
+using std::cout;
 using std::endl;
 
 // Anon namespace for internal linkage.
@@ -20,193 +47,725 @@ namespace {
 // Constants.
 const char * const CUBE_VERTEX_SHADER = "glsl/cube.v.glsl";
 const char * const CUBE_FRAGMENT_SHADER = "glsl/cube.f.glsl";
+const char * const CUBE_INSTANCED_VERTEX_SHADER =
+	"glsl/cube_instanced.v.glsl";
+const char * const CUBE_SHADER_DIRECTORY = "glsl";
+// Packets between the threads. Two lets the main thread build a frame while
+// the render thread draws the last one; three would let it get one more
+// frame ahead, at a frame more of latency.
+const unsigned FRAME_PACKETS = 2;
+// With the software backend, the occlusion pass runs while the rasterizer
+// draws the frame before: it gets one in this many of the threads, the
+// rasterizer the rest.
+const int OCCLUSION_THREAD_SHARE = 4;
+
+const GLfloat CUBE_VERTICES[] = {
+	// front of the cube.
+	-1.0, -1.0, 1.0,
+	1.0, -1.0, 1.0,
+	1.0, 1.0, 1.0,
+	-1.0, 1.0, 1.0,
+	// back of the cube.
+	-1.0, -1.0, -1.0,
+	1.0, -1.0, -1.0,
+	1.0, 1.0, -1.0,
+	-1.0, 1.0, -1.0
+};
+const GLfloat CUBE_COLORS[] = {
+	// front colors of the cube.
+	1.0, 0.0, 0.0,
+	0.0, 1.0, 0.0,
+	0.0, 0.0, 1.0,
+	1.0, 1.0, 1.0,
+	// back colors of the cube.
+	1.0, 0.0, 0.0,
+	0.0, 1.0, 0.0,
+	0.0, 0.0, 1.0,
+	1.0, 1.0, 1.0
+};
+// Specify the triangles using the index of the vertices in the array.
+const GLushort CUBE_ELEMENTS[] = {
+	// front
+	0, 1, 2,
+	2, 3, 0,
+	// top
+	1, 5, 6,
+	6, 2, 1,
+	// back
+	7, 6, 5,
+	5, 4, 7,
+	// bottom,
+	4, 0, 3,
+	3, 7, 4,
+	// left
+	4, 5, 1,
+	1, 0, 4,
+	// right
+	3, 2, 6,
+	6, 7, 3
+};
+const GLsizei CUBE_ELEMENT_COUNT =
+	sizeof(CUBE_ELEMENTS) / sizeof(GLushort);
+
+// Square based pyramid, to have two different meshes in the batch.
+const GLfloat PYRAMID_VERTICES[] = {
+	-1.0, -1.0, 1.0,
+	1.0, -1.0, 1.0,
+	1.0, -1.0, -1.0,
+	-1.0, -1.0, -1.0,
+	0.0, 1.0, 0.0
+};
+const GLfloat PYRAMID_COLORS[] = {
+	1.0, 0.0, 0.0,
+	0.0, 1.0, 0.0,
+	0.0, 0.0, 1.0,
+	1.0, 1.0, 0.0,
+	1.0, 1.0, 1.0
+};
+const GLushort PYRAMID_ELEMENTS[] = {
+	// bottom
+	0, 3, 2,
+	2, 1, 0,
+	// sides
+	0, 1, 4,
+	1, 2, 4,
+	2, 3, 4,
+	3, 0, 4
+};
+const GLsizei PYRAMID_ELEMENT_COUNT =
+	sizeof(PYRAMID_ELEMENTS) / sizeof(GLushort);
+
+//
+// Everything the render thread needs for one frame. The main thread fills
+// it in, and once published it is read-only until the render thread is
+// done with it.
+//
+struct frame_packet {
+	// Frame number, for the dumps.
+	int frame;
+	// Viewport size.
+	int width, height;
+	// Camera and animation of this frame, before any per-cube model.
+	glm::mat4 mvp;
+	// Alpha of every object, below 1 only with --fade.
+	float alpha;
+	// Objects of the field left after culling, by number.
+	std::vector<GLuint> visible;
+	// One matrix per visible cube, when the cubes are drawn one by one.
+	std::vector<glm::mat4> cube_mvps;
+	// Shader changes to apply before drawing.
+	std::vector<SDL_Event> shader_changes;
+};
 
 // GLSL program handle
 GLuint program;
-// Cube vertices buffer handles.
+// Drops binds and state changes that are already in effect.
+gl_state state;
+// Window, or offscreen framebuffer when running headless.
+display screen;
+// Steps the animation at a fixed rate, whatever the frame rate.
+fixed_step simulation;
+// Rotation of the cube in degrees, before and after the last step.
+double previous_angle, current_angle;
+// With --fade, everything fades in and out as tut04's triangle does,
+// blended the same on both backends. Phase of the fade in radians.
+bool fading = false;
+double previous_phase, current_phase;
+// Cube vertices buffer handles, the same buffer when packed.
 GLuint vbo_cube_vertices, vbo_cube_colors;
+// How the cube's vertices are stored on GL, from --vertex-format=NAME.
+vertex_format cube_format = FLOAT_VERTEX_FORMAT;
+// Where its attributes are in those buffers.
+attribute_layout cube_position = FLOAT3_LAYOUT, cube_color = FLOAT3_LAYOUT;
+// From packed positions back to the mesh's, part of every model matrix.
+glm::mat4 cube_dequantize(1.0f);
 // Input variables for the vertex shader.
 GLint attribute_coord3d, attribute_v_color;
 // IBO handle.
 GLuint ibo_cube_elements;
+// Index count, type and topology of ibo_cube_elements.
+draw_descriptor cube_draw;
+// Vertex layout of the cube, recorded once.
+mesh cube_mesh;
+// Active attributes and uniforms of the GLSL program.
+shader_program cube_program;
 // Uniform used to pass MVP matrix.
-GLint uniform_mvp;
+uniform<glm::mat4> uniform_mvp;
+uniform<GLfloat> uniform_fade;
 // Define the aspect ratio.
 int screen_width = 800, screen_height = 600;
+// View and projection, rebuilt only when the window is resized.
+camera scene_camera;
+// Rebuilds the program when a file under glsl/ is saved.
+shader_watcher watcher;
+// Number of cubes to draw, from the command line.
+GLsizei cube_count = 1;
+// Grid of cubes drawn when more than one is asked for.
+cube_field field;
+// Program drawing the whole field in one call, 0 without instancing.
+GLuint instanced_program;
+// Active attributes and uniforms of the instanced program.
+shader_program field_program;
+uniform<glm::mat4> uniform_field_mvp;
+uniform<GLfloat> uniform_field_fade;
+// Draw the field as cubes and pyramids packed into one batch instead.
+bool batching = false;
+draw_batch batch;
+// Model matrices of the cubes drawn one by one, with a matrix each from
+// the packet; empty otherwise. Set before the render thread starts.
+transform_array cube_models;
+// Every one of those times the frame's mvp, before culling.
+std::vector<glm::mat4> all_cube_mvps;
+// Bounds of the field's objects, culled before every frame unless
+// --no-cull.
+bool culling = true;
+cull_octree scene_tree;
+// With --occlusion, objects hidden behind the nearest ones are left out
+// too, found on threads of their own while the frustum culling runs.
+bool occlusion_culling = false;
+occlusion_culler occlusion;
+// Frames on their way from the main thread to the render thread.
+packet_ring<frame_packet, FRAME_PACKETS> packets;
+// Shader changes seen by the main thread since the last packet.
+std::vector<SDL_Event> shader_changes;
+// Set by the render thread when it can't draw at all.
+std::atomic<bool> render_failed(false);
+// The cube and the pyramid, reordered by the mesh optimizer once loaded.
+std::vector<mesh_data> meshes;
+const size_t CUBE_MESH = 0, PYRAMID_MESH = 1;
+// OBJ or PLY file drawn in place of the cube, from --mesh=FILE.
+const char *model_filename = nullptr;
+mesh_file model;
+// What both backends draw as the cube and as the pyramid.
+mesh_view cube_geometry, pyramid_geometry;
+// Draws the frames on the CPU instead, with --backend=soft.
+soft_raster raster;
+// The cube and the pyramid as the rasterizer takes them.
+soft_mesh soft_cube, soft_pyramid;
 
 //
-// Initiate resources.
-// NOTE: I probably would have done something like write my own shader
-//       class that has the program as a static member variable,
-//       like a singleton. Each instance of the class would be either
-//       a vertex, fragment, or geometry shader.
-//       Or something along those lines.
-//       This is likely to change as I learn more about this.
+// Copy a mesh out of the arrays it is written in.
 //
-bool init_resources()
+mesh_data load_mesh(const GLfloat *positions, const GLfloat *colors,
+		GLuint vertices, const GLushort *indices, GLsizei count)
 {
-	GLfloat cube_vertices[] = {
-		// front of the cube.
-		-1.0, -1.0, 1.0,
-		1.0, -1.0, 1.0,
-		1.0, 1.0, 1.0,
-		-1.0, 1.0, 1.0,
-		// back of the cube.
-		-1.0, -1.0, -1.0,
-		1.0, -1.0, -1.0,
-		1.0, 1.0, -1.0,
-		-1.0, 1.0, -1.0
-	};
-	glGenBuffers(1, &vbo_cube_vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_vertices);
-	glBufferData(GL_ARRAY_BUFFER,
-			sizeof(cube_vertices),
-			cube_vertices,
-			GL_STATIC_DRAW);
-
-	GLfloat cube_colors[] = {
-		// front colors of the cube.
-		1.0, 0.0, 0.0,
-		0.0, 1.0, 0.0,
-		0.0, 0.0, 1.0,
-		1.0, 1.0, 1.0,
-		// back colors of the cube.
-		1.0, 0.0, 0.0,
-		0.0, 1.0, 0.0,
-		0.0, 0.0, 1.0,
-		1.0, 1.0, 1.0
-	};
-	glGenBuffers(1, &vbo_cube_colors);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_colors);
-	glBufferData(GL_ARRAY_BUFFER,
-			sizeof(cube_colors),
-			cube_colors,
-			GL_STATIC_DRAW);
-
-	// Specify the triangles using the index of the vertices in the array.
-	GLushort cube_elements[] = {
-		// front
-		0, 1, 2,
-		2, 3, 0,
-		// top
-		1, 5, 6,
-		6, 2, 1,
-		// back
-		7, 6, 5,
-		5, 4, 7,
-		// bottom,
-		4, 0, 3,
-		3, 7, 4,
-		// left
-		4, 5, 1,
-		1, 0, 4,
-		// right
-		3, 2, 6,
-		6, 7, 3
+	mesh_data res;
+	res.positions.assign(positions, positions + 3 * vertices);
+	res.colors.assign(colors, colors + 3 * vertices);
+	res.indices.assign(indices, indices + count);
+
+	return res;
+}
+
+//
+// Load both meshes and optimize them for the vertex cache, in parallel,
+// then the --mesh file if any. Returns false when that can't be loaded.
+//
+bool load_meshes()
+{
+	meshes.push_back(load_mesh(CUBE_VERTICES, CUBE_COLORS, 8,
+				CUBE_ELEMENTS, CUBE_ELEMENT_COUNT));
+
+	meshes.push_back(load_mesh(PYRAMID_VERTICES, PYRAMID_COLORS, 5,
+				PYRAMID_ELEMENTS, PYRAMID_ELEMENT_COUNT));
+
+	optimize_meshes(meshes);
+	cube_geometry = view_mesh(meshes[CUBE_MESH]);
+	pyramid_geometry = view_mesh(meshes[PYRAMID_MESH]);
+	if (model_filename != nullptr) {
+		if (!model.load(model_filename))
+			return false;
+
+		cube_geometry = model.view();
+		cout << "Mesh " << model_filename << ": "
+			<< cube_geometry.count / 3 << " triangles "
+			<< (model.from_cache() ? "mapped from the cache"
+						: "imported")
+			<< " in " << model.load_ms() << " ms" << endl;
+	}
+
+	// After the import, which optimizes the mesh and counts it in.
+	print_mesh_optimizer_report();
+
+	return true;
+}
+
+//
+// Take --mesh=FILE, --vertex-format=NAME, --no-cull, --occlusion and
+// --fade out of the arguments, before the display sees them. Returns
+// false for an unknown format.
+//
+bool parse_cube_flags(int &argc, char *argv[])
+{
+	const char * const format_flag = "--vertex-format=";
+	const size_t format_flag_length = strlen(format_flag);
+	bool parsed = true;
+	int kept = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--mesh=", 7) == 0 && argv[i][7] != '\0') {
+			model_filename = argv[i] + 7;
+		} else if (strcmp(argv[i], "--no-cull") == 0) {
+			culling = false;
+		} else if (strcmp(argv[i], "--occlusion") == 0) {
+			occlusion_culling = true;
+		} else if (strcmp(argv[i], "--fade") == 0) {
+			fading = true;
+		} else if (strncmp(argv[i], format_flag,
+				format_flag_length) == 0) {
+
+			const char *name = argv[i] + format_flag_length;
+			if (!parse_vertex_format(name, cube_format)) {
+				cerr << "Unknown vertex format " << name << endl;
+				parsed = false;
+			}
+		} else {
+			argv[kept++] = argv[i];
+		}
+	}
+
+	argv[kept] = nullptr;
+	argc = kept;
+
+	return parsed;
+}
+
+//
+// A loaded mesh as the rasterizer takes it.
+//
+soft_mesh soft_view(const mesh_view &loaded)
+{
+	soft_mesh res = {
+		loaded.positions, 3, 0, loaded.colors, 0, loaded.indices,
+		loaded.count
 	};
 
-	glGenBuffers(1, &ibo_cube_elements);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			sizeof(cube_elements),
-			cube_elements,
-			GL_STATIC_DRAW);
-
-	GLuint vs, fs;
-	if ((vs = create_shader(CUBE_VERTEX_SHADER, GL_VERTEX_SHADER)) == 0)
-		return false;
+	return res;
+}
+
+//
+// Grow low and high to take in the positions of a mesh.
+//
+void add_mesh_bounds(const mesh_view &loaded, glm::vec3 &low, glm::vec3 &high)
+{
+	for (GLuint v = 0; v < loaded.vertices; ++v) {
+		for (int a = 0; a < 3; ++a) {
+			low[a] = std::min(low[a], loaded.positions[3 * v + a]);
+			high[a] = std::max(high[a], loaded.positions[3 * v + a]);
+		}
+	}
+}
 
-	if ((fs = create_shader(CUBE_FRAGMENT_SHADER,
-				GL_FRAGMENT_SHADER)) == 0) {
+//
+// Threads of the software rasterizer and of the occlusion pass: --threads
+// (one a core if unset) between them, as both pools run at once on the
+// software backend. On GL the occlusion pass has them all.
+//
+int thread_budget()
+{
+	int threads = screen.raster_threads();
+	return threads > 0 ? threads : worker_pool::cores();
+}
 
-		return false;
+int occlusion_threads()
+{
+	if (!screen.software())
+		return thread_budget();
+
+	return std::max(1, thread_budget() / OCCLUSION_THREAD_SHARE);
+}
+
+int soft_raster_threads()
+{
+	if (!occlusion_culling)
+		return thread_budget();
+
+	return std::max(1, thread_budget() - occlusion_threads());
+}
+
+//
+// Put the bounds of every object of the field in the octree, and with
+// --occlusion in the occlusion culler along with the mesh it draws. They
+// are kept in the field's space, where nothing moves: the camera and the
+// animation only move the frustum.
+//
+void build_cull_tree()
+{
+	if (field.size() == 0)
+		return;
+
+	// Both meshes, as either may be drawn anywhere, in the space of the
+	// vertices on GL.
+	glm::vec3 low(cube_geometry.positions[0], cube_geometry.positions[1],
+			cube_geometry.positions[2]);
+	glm::vec3 high = low;
+	add_mesh_bounds(cube_geometry, low, high);
+	if (batching)
+		add_mesh_bounds(pyramid_geometry, low, high);
+
+	glm::vec3 mesh_center = 0.5f * (low + high);
+	glm::vec3 mesh_extent = 0.5f * (high - low);
+	transform_bounds(glm::inverse(cube_dequantize), mesh_center,
+			mesh_extent, mesh_center, mesh_extent);
+
+	std::vector<glm::vec3> centers(field.size()), extents(field.size());
+	for (GLsizei i = 0; i < field.size(); ++i) {
+		transform_bounds(field.model(i), mesh_center, mesh_extent,
+				centers[i], extents[i]);
+
+		low = i == 0 ? centers[i] - extents[i] :
+			glm::min(low, centers[i] - extents[i]);
+		high = i == 0 ? centers[i] + extents[i] :
+			glm::max(high, centers[i] + extents[i]);
 	}
 
-	// Create the GLSL program by linking the vertex
-	// and the fragment shaders.
-	program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	GLint link_ok = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-	if (link_ok == GL_FALSE) {
-		cerr << "glLinkProgram: ";
-		print_log(program);
-		return false;
-	}	
+	glm::vec3 size = high - low;
+	scene_tree.reset(0.5f * (low + high),
+			0.5f * std::max(size.x, std::max(size.y, size.z)));
+	for (GLsizei i = 0; i < field.size(); ++i)
+		scene_tree.insert(centers[i], extents[i]);
+
+	if (!occlusion_culling)
+		return;
+
+	// The meshes as loaded, before packing.
+	std::vector<occluder_mesh> occluder_meshes = {
+		{ cube_geometry.positions, cube_geometry.indices,
+			cube_geometry.count },
+		{ pyramid_geometry.positions, pyramid_geometry.indices,
+			pyramid_geometry.count }
+	};
+
+	glm::mat4 unpacked = glm::inverse(cube_dequantize);
+	std::vector<occlusion_object> objects(field.size());
+	for (GLsizei i = 0; i < field.size(); ++i) {
+		objects[i].center = centers[i];
+		objects[i].extent = extents[i];
+		objects[i].model = field.model(i) * unpacked;
+		objects[i].mesh = batching && i % 2 == 1 ? PYRAMID_MESH :
+			CUBE_MESH;
+	}
+
+	occlusion.set_scene(occluder_meshes, objects);
+	occlusion.start(occlusion_threads());
+}
+
+//
+// Look up the attributes and uniforms of a newly linked program.
+// The handles are only updated when every lookup succeeds, so a hot
+// reloaded program that lost one leaves the current handles untouched.
+//
+bool bind_locations(GLuint new_program)
+{
+	shader_program reflected;
+	reflected.reflect(new_program);
 
 	// Bind attribute names for the GLSL program
 	// NOTE: all of the names should be global constants in this case..
 	const char *attribute_name = "coord3d";
-	attribute_coord3d = glGetAttribLocation(program, attribute_name);
-	if (attribute_coord3d == -1) {
+	GLint new_coord3d = reflected.attribute(attribute_name);
+	if (new_coord3d == -1) {
 		cerr << "Could not bind attribute " << attribute_name << endl;
 		return false;
 	}
 
 	attribute_name = "v_color";
-	attribute_v_color = glGetAttribLocation(program, attribute_name);
-	if (attribute_v_color == -1) {
+	GLint new_v_color = reflected.attribute(attribute_name);
+	if (new_v_color == -1) {
 		cerr << "Could not bind attribute " << attribute_name << endl;
 		return false;
 	}
 
 	const char *uniform_name = "mvp";
-	uniform_mvp = glGetUniformLocation(program, uniform_name);
-	if (uniform_mvp == -1) {
+	if (!reflected.get_uniform<glm::mat4>(uniform_name).valid()) {
 		cerr << "Could not bind uniform " << uniform_name << endl;
 		return false;
 	}
 
+	const char *fade_name = "fade";
+	if (!reflected.get_uniform<GLfloat>(fade_name).valid()) {
+		cerr << "Could not bind uniform " << fade_name << endl;
+		return false;
+	}
+
+	attribute_coord3d = new_coord3d;
+	attribute_v_color = new_v_color;
+	cube_program = reflected;
+	uniform_mvp = cube_program.get_uniform<glm::mat4>(uniform_name);
+	uniform_fade = cube_program.get_uniform<GLfloat>(fade_name);
+	// A relinked program may reuse the id of the one it replaced.
+	state.invalidate();
+
+	// Attribute locations can move on relink, so record the layout again.
+	cube_mesh.clear();
+	cube_mesh.attribute(attribute_coord3d, vbo_cube_vertices,
+			cube_position.size, cube_position.type,
+			cube_position.normalized, cube_position.stride,
+			cube_position.offset);
+	cube_mesh.attribute(attribute_v_color, vbo_cube_colors,
+			cube_color.size, cube_color.type,
+			cube_color.normalized, cube_color.stride,
+			cube_color.offset);
+	cube_mesh.elements(ibo_cube_elements, cube_draw);
+	cube_mesh.build(state);
+	if (batch.objects() > 0)
+		batch.build(state, attribute_coord3d, attribute_v_color);
+
 	return true;
 }
 
 //
-// Render all in window.
+// Same as bind_locations, for the instanced program drawing the field.
 //
-void render(SDL_Window *window)
+bool bind_field_locations(GLuint new_program)
 {
-	// Make the background white to start.
-	glClearColor(1.0, 1.0, 1.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	shader_program reflected;
+	reflected.reflect(new_program);
 
-	// Tell it to use the GLSL program that we made.
-	glUseProgram(program);
+	const char *attribute_names[] = {
+		"coord3d", "v_color", "instance_model"
+	};
+	GLint locations[3];
+	for (int i = 0; i < 3; ++i) {
+		locations[i] = reflected.attribute(attribute_names[i]);
+		if (locations[i] == -1) {
+			cerr << "Could not bind attribute " << attribute_names[i]
+				<< endl;
 
-	// Pass all of the triangle information into the GLSL program.
-	glEnableVertexAttribArray(attribute_coord3d);
+			return false;
+		}
+	}
+
+	const char *uniform_name = "mvp";
+	if (!reflected.get_uniform<glm::mat4>(uniform_name).valid()) {
+		cerr << "Could not bind uniform " << uniform_name << endl;
+		return false;
+	}
+
+	const char *fade_name = "fade";
+	if (!reflected.get_uniform<GLfloat>(fade_name).valid()) {
+		cerr << "Could not bind uniform " << fade_name << endl;
+		return false;
+	}
+
+	field_program = reflected;
+	uniform_field_mvp = field_program.get_uniform<glm::mat4>(uniform_name);
+	uniform_field_fade = field_program.get_uniform<GLfloat>(fade_name);
+	state.invalidate();
+	field.build(state,
+			locations[0], vbo_cube_vertices,
+			locations[1], vbo_cube_colors,
+			locations[2],
+			ibo_cube_elements, cube_draw,
+			cube_position, cube_color);
+
+	return true;
+}
+
+//
+// Initiate resources.
+// NOTE: I probably would have done something like write my own shader
+//       class that has the program as a static member variable,
+//       like a singleton. Each instance of the class would be either
+//       a vertex, fragment, or geometry shader.
+//       Or something along those lines.
+//       This is likely to change as I learn more about this.
+//
+bool init_resources()
+{
+	// Start building the GLSL program first, so that compiling and linking
+	// overlap with the buffer uploads below.
+	shader_queue queue;
+	int cube_program = queue.add_program(CUBE_VERTEX_SHADER,
+						CUBE_FRAGMENT_SHADER);
+	bool instanced = cube_count > 1 && !batching &&
+		mesh::instancing_supported();
+	int field_ticket = -1;
+	if (instanced) {
+		field_ticket = queue.add_program(CUBE_INSTANCED_VERTEX_SHADER,
+						CUBE_FRAGMENT_SHADER);
+	} else if (cube_count > 1 && !batching) {
+		cerr << "No instancing support, drawing the cubes one by one"
+			<< endl;
+	}
+
+	queue.submit();
+
+	const mesh_view &cube = cube_geometry;
+	const mesh_view &pyramid = pyramid_geometry;
+	if (!vertex_format_supported(cube_format)) {
+		cerr << "No " << vertex_format_name(cube_format)
+			<< " vertex support, using floats" << endl;
+
+		cube_format = FLOAT_VERTEX_FORMAT;
+	}
+
+	// Batches copy the floats into buffers of their own.
+	if (batching)
+		cube_format = FLOAT_VERTEX_FORMAT;
+
+	packed_mesh packed;
+	if (cube_format.position != POSITION_FLOAT &&
+		!pack_vertices(cube, cube_format, packed)) {
+
+		cerr << "Can't pack the mesh, using floats" << endl;
+		cube_format = FLOAT_VERTEX_FORMAT;
+	}
+
+	glGenBuffers(1, &vbo_cube_vertices);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_vertices);
-	glVertexAttribPointer(attribute_coord3d, // attribute
-				3, // number of elements for the input.
-				GL_FLOAT, // type of each element.
-				GL_FALSE, // take the values as-is.
-				0, // stride.
-				0); // offset of the first element.
-
-	glEnableVertexAttribArray(attribute_v_color);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_colors);
-	glVertexAttribPointer(attribute_v_color, // attribute
-				3, // number of elements for the input.
-				GL_FLOAT,
-				GL_FALSE,
-				0,
-				0); // offset.
-
-	// Give denoting which vertices make the triangles that are to be drawn.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
-	int size;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	glDrawElements(GL_TRIANGLES,
-			size/sizeof(GLushort),
-			GL_UNSIGNED_SHORT,
-			0);
-
-	glDisableVertexAttribArray(attribute_coord3d);
-	glDisableVertexAttribArray(attribute_v_color);
-
-	// Display the result.
-	SDL_GL_SwapWindow(window);
+	if (cube_format.position != POSITION_FLOAT) {
+		// Both attributes interleaved in one buffer.
+		glBufferData(GL_ARRAY_BUFFER,
+				packed.vertices.size(),
+				packed.vertices.data(),
+				GL_STATIC_DRAW);
+
+		vbo_cube_colors = vbo_cube_vertices;
+		cube_position = packed.position;
+		cube_color = packed.color;
+		cube_dequantize = packed.dequantize;
+		print_vertex_format_report();
+	} else {
+		// A --mesh file goes to GL straight from its cache mapping.
+		glBufferData(GL_ARRAY_BUFFER,
+				cube.vertices * 3 * sizeof(GLfloat),
+				cube.positions,
+				GL_STATIC_DRAW);
+
+		glGenBuffers(1, &vbo_cube_colors);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_colors);
+		glBufferData(GL_ARRAY_BUFFER,
+				cube.vertices * 3 * sizeof(GLfloat),
+				cube.colors,
+				GL_STATIC_DRAW);
+	}
+
+	glGenBuffers(1, &ibo_cube_elements);
+	cube_draw = upload_elements(state,
+				ibo_cube_elements,
+				GL_TRIANGLES,
+				cube.indices,
+				cube.count);
+
+	if (cube_count > 1)
+		field.layout(state, cube_count, cube_dequantize);
+
+	// Every other object of the field is a pyramid.
+	for (GLsizei i = 0; batching && i < field.size(); ++i) {
+		if (i % 2 == 0) {
+			batch.add(cube.positions, cube.colors,
+				cube.vertices,
+				cube.indices,
+				cube.count,
+				field.model(i));
+		} else {
+			batch.add(pyramid.positions, pyramid.colors,
+				pyramid.vertices,
+				pyramid.indices,
+				pyramid.count,
+				field.model(i));
+		}
+	}
+
+	// First use of the program, which waits for the driver if needed.
+	program = queue.program(cube_program);
+	if (program == 0 || !bind_locations(program))
+		return false;
+
+	if (batch.objects() > 0) {
+		cout << "Draws per frame: " << batch.objects()
+			<< " without batching, 1 batched with "
+			<< (batch.is_indirect() ? "glMultiDrawElementsIndirect"
+						: "glMultiDrawElements")
+			<< endl;
+	}
+
+	if (instanced) {
+		instanced_program = queue.program(field_ticket);
+		if (instanced_program == 0 ||
+			!bind_field_locations(instanced_program)) {
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// Render all in window, as the packet says. Render thread only.
+//
+void render(const frame_packet &packet)
+{
+	FRAME_PROFILE_SCOPE(PHASE_RENDER);
+	GPU_PROFILE_SCOPE("render");
+
+	state.viewport(0, 0, packet.width, packet.height);
+
+	// Make the background white to start.
+	{
+		GPU_PROFILE_SCOPE("clear");
+		state.clear_color(1.0, 1.0, 1.0, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	GPU_PROFILE_SCOPE("draw");
+	if (instanced_program != 0) {
+		// Every cube in one call, the model matrices are attributes.
+		// Unchanged values are not sent to the driver again.
+		state.use_program(instanced_program);
+		uniform_field_mvp.set(packet.mvp);
+		uniform_field_fade.set(packet.alpha);
+		field.draw(state, packet.visible);
+	} else if (batch.objects() > 0) {
+		// Every object in one call, their vertices are in world space.
+		state.use_program(program);
+		uniform_mvp.set(packet.mvp);
+		uniform_fade.set(packet.alpha);
+		batch.draw(state, packet.visible);
+	} else {
+		// Tell it to use the GLSL program that we made.
+		state.use_program(program);
+		uniform_fade.set(packet.alpha);
+
+		// Both attributes, the element buffer and the index count come
+		// with the mesh.
+		if (field.size() == 0) {
+			uniform_mvp.set(packet.mvp * cube_dequantize);
+			cube_mesh.draw(state);
+		}
+
+		// Without instancing, one draw and one mvp upload per visible
+		// cube.
+		for (const glm::mat4 &mvp : packet.cube_mvps) {
+			uniform_mvp.set(mvp);
+			cube_mesh.draw(state);
+		}
+	}
+}
+
+//
+// Same as render, on the CPU. The field is drawn one object at a time
+// however it would be drawn on GL, pyramids included when batching.
+//
+void render_software(const frame_packet &packet)
+{
+	FRAME_PROFILE_SCOPE(PHASE_RENDER);
+
+	raster.resize(packet.width, packet.height);
+	raster.clear(1.0, 1.0, 1.0, 1.0);
+	if (field.size() == 0)
+		raster.draw(soft_cube, packet.mvp, packet.alpha);
+
+	for (size_t i = 0; i < packet.cube_mvps.size(); ++i) {
+		bool pyramid = batching && packet.visible[i] % 2 == 1;
+		raster.draw(pyramid ? soft_pyramid : soft_cube,
+				packet.cube_mvps[i], packet.alpha);
+	}
+
+	raster.finish();
+	screen.set_pixels(raster.pixels(), raster.frame_width(),
+			raster.frame_height());
 }
 
 //
@@ -214,123 +773,358 @@ void render(SDL_Window *window)
 //
 void free_resources()
 {
+	watcher.stop();
 	glDeleteProgram(program);
+	glDeleteProgram(instanced_program);
+	cube_mesh.clear();
+	field.clear();
+	batch.clear();
 	glDeleteBuffers(1, &vbo_cube_vertices);
-	glDeleteBuffers(1, &vbo_cube_colors);
+	if (vbo_cube_colors != vbo_cube_vertices)
+		glDeleteBuffers(1, &vbo_cube_colors);
+
 	glDeleteBuffers(1, &ibo_cube_elements);
 }
 
 //
-// Have the triangle rotate and translate in oscillation.
+// Advance the animation by one fixed step.
 //
-void input_logic()
+void step_simulation(double seconds)
 {
+	previous_angle = current_angle;
+	current_angle += 45 * seconds; // 45 degree per second.
+	previous_phase = current_phase;
+	current_phase += seconds * (2 * 3.14) / 5;
+}
+
+//
+// Have the triangle rotate and translate in oscillation, and put the
+// matrices for drawing it into the packet.
+//
+void input_logic(frame_packet &packet)
+{
+	FRAME_PROFILE_SCOPE(PHASE_LOGIC);
+
+	int steps = simulation.advance(screen.time_ns());
+	for (int i = 0; i < steps; ++i)
+		step_simulation(simulation.step_seconds());
+
 	// Create the MVP matrix
 	// Model: Going to world coordinates, pushing the cube back.
 	glm::mat4 model = glm::translate(glm::mat4(1.0f),
 						glm::vec3(0.0, 0.0, -4.0));
 
-	// View: Positioning the camera. (A little up and facing straight)
-	glm::mat4 view = glm::lookAt(glm::vec3(0.0, 2.0, 0.0),
-					glm::vec3(0.0, 0.0, -4.0),
-					glm::vec3(0.0, 1.0, 0.0));
-
-	// Projection: Project into the camera plane.
-	glm::mat4 projection = glm::perspective(45.0f,
-						1.0f*screen_width/screen_height,
-						0.1f,
-						10.0f);
-
-	// Create the matrix for the animation this frame.
-	float angle = SDL_GetTicks() / 1000.0 * 45; // 45 degree per second.
+	// Create the matrix for the animation this frame, drawn between the
+	// last two steps.
+	float angle = fmod(simulation.blend(previous_angle, current_angle),
+			360.0);
 	glm::vec3 axis_y(0, 1, 0);
 	glm::mat4 anim = glm::rotate(glm::mat4(1.0f),
 					glm::radians(angle),
 					axis_y);
 
-	glm::mat4 mvp = projection * view * model * anim;
+	// View and projection come from the camera, only rebuilt on resize.
+	packet.mvp = scene_camera.view_projection() * model * anim;
+
+	// alpha 0->1->0 every 5 seconds.
+	packet.alpha = fading ? sin(simulation.blend(previous_phase,
+						current_phase)) / 2 + 0.5 : 1.0;
+	packet.width = screen_width;
+	packet.height = screen_height;
 
-	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
-	glUseProgram(program);
+	// The render thread has the context, so it builds the shaders.
+	packet.shader_changes.swap(shader_changes);
+	shader_changes.clear();
 }
 
 //
-// Change the size of the viewport.
+// Keep the objects of the field that the packet's view can see, and the
+// matrices of those that are drawn one by one. Runs after input_logic(),
+// on the main thread.
+//
+void cull_scene(frame_packet &packet)
+{
+	FRAME_PROFILE_SCOPE(PHASE_CULL);
+
+	// Occlusion runs on its threads until the rest is done here.
+	if (occlusion_culling && field.size() > 0)
+		occlusion.begin(packet.mvp);
+
+	// The bounds are in the field's space, so the frustum of the whole
+	// mvp is in there too.
+	if (culling) {
+		scene_tree.cull(frustum_from_matrix(packet.mvp), packet.visible);
+	} else {
+		packet.visible.resize(field.size());
+		for (GLsizei i = 0; i < field.size(); ++i)
+			packet.visible[i] = i;
+	}
+
+	// The per-cube matrices, several at a time, leaving the render
+	// thread only the draws.
+	all_cube_mvps.resize(cube_models.size());
+	if (cube_models.size() > 0)
+		cube_models.multiply(packet.mvp, all_cube_mvps.data());
+
+	// Then leave out what the occlusion pass found hidden.
+	if (occlusion_culling && field.size() > 0) {
+		occlusion.end();
+		packet.visible.erase(std::remove_if(packet.visible.begin(),
+				packet.visible.end(), [](GLuint i) {
+			return occlusion.occluded(i);
+		}), packet.visible.end());
+	}
+
+	packet.cube_mvps.clear();
+	if (cube_models.size() == 0)
+		return;
+
+	for (GLuint i : packet.visible)
+		packet.cube_mvps.push_back(all_cube_mvps[i]);
+}
+
+//
+// Change the size of the viewport, from the next packet on.
 //
 void on_resize(int width, int height)
 {
 	screen_width = width;
-	screen_height = height;	
-	glViewport(0, 0, screen_width, screen_height);
+	screen_height = height;
+	scene_camera.set_viewport(screen_width, screen_height);
 }
 
 //
-// Main loop that keeps rendering.
+// Handle the events queued since the last frame. Returns false on quit.
 //
-void main_loop(SDL_Window *window)
+bool handle_events()
 {
-	while (true) {
-		SDL_Event ev;
-		while (SDL_PollEvent(&ev)) {
-			if (ev.type == SDL_QUIT)
-				return;
-
-			// Check if there was a size change of the window.
-			if (ev.type == SDL_WINDOWEVENT &&
-				ev.window.event ==
-					SDL_WINDOWEVENT_SIZE_CHANGED) {
-
-				on_resize(ev.window.data1, ev.window.data2);
-			}
+	FRAME_PROFILE_SCOPE(PHASE_EVENTS);
+
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev)) {
+		if (ev.type == SDL_QUIT)
+			return false;
+
+		// Shader edits arrive as events, handled by the render thread
+		// before its next frame.
+		if (watcher.is_change(ev)) {
+			shader_changes.push_back(ev);
+			continue;
+		}
+
+		// Check if there was a size change of the window.
+		if (ev.type == SDL_WINDOWEVENT &&
+			ev.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+
+			on_resize(ev.window.data1, ev.window.data2);
 		}
 
-		input_logic();
-		render(window);
+		// P writes out the frame profile so far.
+		if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_p)
+			FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
 	}
+
+	return true;
+}
+
+//
+// Render thread: make the context current and draw the packets as they
+// come, until the main thread closes the ring.
+//
+void render_loop()
+{
+	if (!screen.make_current()) {
+		cerr << "Error: can't make the context current to render"
+			<< endl;
+
+		// Keep taking packets, so the main thread doesn't wait forever,
+		// and free the shader changes they carry.
+		render_failed = true;
+		const frame_packet *packet;
+		while ((packet = packets.begin_read()) != nullptr) {
+			for (const SDL_Event &ev : packet->shader_changes)
+				watcher.discard_event(ev);
+
+			packets.end_read();
+		}
+
+		return;
+	}
+
+	for (;;) {
+		const frame_packet *packet;
+		{
+			FRAME_PROFILE_SCOPE(PHASE_WAIT);
+			packet = packets.begin_read();
+		}
+
+		if (packet == nullptr)
+			break;
+
+		// Shader edits passed on by the main thread, before any program
+		// is used and outside the span the query checker looks at, as
+		// reloading reads the compile and link status back.
+		for (const SDL_Event &ev : packet->shader_changes)
+			watcher.handle_event(ev);
+
+		// Reads back an older frame's queries, before the query checker
+		// starts looking.
+		GPU_PROFILE_BEGIN_FRAME();
+		query_check_begin_frame();
+		if (screen.software())
+			render_software(*packet);
+		else
+			render(*packet);
+
+		// GL has everything it needs from the packet by now, so the
+		// main thread can refill it during the swap.
+		int frame = packet->frame;
+		packets.end_read();
+
+		// Display the result.
+		screen.present(frame);
+		query_check_end_frame();
+		GPU_PROFILE_END_FRAME();
+		FRAME_PROFILE_END_FRAME();
+	}
+
+	screen.release_current();
+}
+
+//
+// Main loop that keeps rendering. Events and the simulation stay on this
+// thread and the GL work goes to a render thread, so frame N + 1 is built
+// while frame N is drawn and swapped. Returns false when rendering failed.
+//
+bool main_loop()
+{
+	screen.release_current();
+	std::thread renderer(render_loop);
+
+	for (int frame = 0; !screen.done() && !render_failed &&
+		handle_events(); ++frame) {
+
+		frame_packet *packet;
+		{
+			FRAME_PROFILE_SCOPE(PHASE_WAIT);
+			packet = &packets.begin_write();
+		}
+
+		packet->frame = frame;
+		input_logic(*packet);
+		cull_scene(*packet);
+		packets.end_write();
+		screen.advance();
+	}
+
+	packets.close();
+	renderer.join();
+
+	// Shader changes that came too late for a packet, or are still
+	// queued, are never handled.
+	for (const SDL_Event &ev : shader_changes)
+		watcher.discard_event(ev);
+
+	shader_changes.clear();
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev))
+		watcher.discard_event(ev);
+
+	if (!screen.make_current()) {
+		cerr << "Error: can't take the context back from the render "
+			<< "thread" << endl;
+
+		return false;
+	}
+
+	return !render_failed;
 }
 
 // End of anon namespace.
 }
 
 //
-// Driver.
+// Driver. An optional argument is the number of cubes to draw, followed
+// by "batch" to draw them (and pyramids) as one batch. --mesh=FILE draws
+// an OBJ or PLY file in place of the cube, and --vertex-format=NAME (float,
+// half or snorm16) stores its vertices on GL so. --no-cull draws the whole
+// field without frustum culling, and --occlusion leaves out what the
+// nearest objects hide, on --threads threads. --fade blends everything in
+// and out, on either backend. The flags can come anywhere.
 //
-int main()
+int main(int argc, char *argv[])
 {
-	// SDL initialization.
-	SDL_Init(SDL_INIT_VIDEO);
-	// Window initialization.
-	SDL_Window *window = SDL_CreateWindow("My First Triangle",
-						SDL_WINDOWPOS_CENTERED,
-						SDL_WINDOWPOS_CENTERED,
-						screen_width,
-						screen_height,
-						SDL_WINDOW_RESIZABLE |
-						SDL_WINDOW_OPENGL);
-
-	// Some SDL error handling.
-	if (window == nullptr) {
-		cerr << "Error: can't create window: " << SDL_GetError()
-			<< endl;
+	if (!parse_cube_flags(argc, argv) || !screen.parse_args(argc, argv))
+		argc = 0;
+
+	if (argc > 1)
+		cube_count = atoi(argv[1]);
+
+	if (argc > 2)
+		batching = strcmp(argv[2], "batch") == 0;
+
+	if (argc == 0 || cube_count < 1 || (argc > 2 && !batching)) {
+		cerr << "Usage: cube [cubes [batch]] [--mesh=FILE] "
+			<< "[--vertex-format=float|half|snorm16] [--no-cull] "
+			<< "[--occlusion] [--fade] "
+			<< display::usage() << endl;
 
 		return EXIT_FAILURE;
 	}
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 1);
+	simulation.set_rate(screen.sim_hz());
 
-	if (SDL_GL_CreateContext(window) == nullptr) {
-		cerr << "Error: SDL_GL_CreateContext: " 
-			<< SDL_GetError() << endl;
+	// See-through objects hide nothing.
+	if (fading)
+		occlusion_culling = false;
 
+	// Window (or offscreen framebuffer), context and extensions.
+	if (!screen.open("My First Triangle", screen_width, screen_height))
 		return EXIT_FAILURE;
-	}
 
-	// Extension wrangler initializing.
-	GLenum glew_status = glewInit();
-	if (glew_status != GLEW_OK) {
-		cerr << "Error: glewInit: " << endl;
+	// The display flags may have asked for another size.
+	on_resize(screen.frame_width(), screen.frame_height());
+
+	// Projection: Project into the camera plane.
+	scene_camera.set_lens(45.0f, 0.1f, 10.0f);
+
+	// View: Positioning the camera. (A little up and facing straight)
+	scene_camera.look_at(glm::vec3(0.0, 2.0, 0.0),
+			glm::vec3(0.0, 0.0, -4.0),
+			glm::vec3(0.0, 1.0, 0.0));
+
+	// Both backends draw the optimized meshes.
+	if (!load_meshes())
 		return EXIT_FAILURE;
+
+	if (screen.software()) {
+		// Nothing to set up on GL, every object gets its own matrix.
+		soft_cube = soft_view(cube_geometry);
+		soft_pyramid = soft_view(pyramid_geometry);
+		raster.start(soft_raster_threads());
+		raster.set_depth_test(true);
+		raster.set_blend(fading);
+		if (cube_count > 1)
+			field.place(cube_count);
+
+		if (field.size() > 0)
+			cube_models.assign(&field.model(0), field.size());
+
+		build_cull_tree();
+		if (!main_loop())
+			return EXIT_FAILURE;
+
+		screen.print_report();
+		simulation.print_report();
+		raster.print_report();
+		scene_tree.print_report();
+		occlusion.print_report();
+		FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+		occlusion.stop();
+		raster.stop();
+		screen.close();
+
+		return EXIT_SUCCESS;
 	}
 
 	if (!GLEW_VERSION_2_0) {
@@ -345,14 +1139,57 @@ int main()
 	if (!init_resources())
 		return EXIT_FAILURE;
 
-	glEnable(GL_DEPTH_TEST);
+	print_program_cache_report();
+
+	// Hot reload the cube shaders while running.
+	if (watcher.start(CUBE_SHADER_DIRECTORY)) {
+		watcher.add_program(&program,
+				CUBE_VERTEX_SHADER,
+				CUBE_FRAGMENT_SHADER,
+				bind_locations);
+
+		if (instanced_program != 0) {
+			watcher.add_program(&instanced_program,
+					CUBE_INSTANCED_VERTEX_SHADER,
+					CUBE_FRAGMENT_SHADER,
+					bind_field_locations);
+		}
+	}
+
+	state.enable(GL_DEPTH_TEST);
+	if (fading) {
+		state.enable(GL_BLEND);
+		state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	GPU_PROFILE_INIT();
+	if (instanced_program == 0 && batch.objects() == 0 &&
+		field.size() > 0) {
+
+		cube_models.assign(&field.model(0), field.size());
+	}
+
+	build_cull_tree();
 
 	// If everything has gone okay, we can display something.
-	main_loop(window);
+	if (!main_loop())
+		return EXIT_FAILURE;
+
+	print_uniform_upload_report();
+	state.print_report();
+	screen.print_report();
+	simulation.print_report();
+	scene_tree.print_report();
+	occlusion.print_report();
+	FRAME_PROFILE_WRITE(FRAME_PROFILE_FILE);
+	GPU_PROFILE_WRITE(GPU_PROFILE_FILE);
+	occlusion.stop();
 
 	// If the program exits in the usual way, free resources
 	// and exit success.
 	free_resources();
+	GPU_PROFILE_DESTROY();
+	screen.close();
 
 	return EXIT_SUCCESS;
 }
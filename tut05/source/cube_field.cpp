@@ -0,0 +1,152 @@
+//
+// Source implementation file for fields of identical cubes.
+//
+
+#include "../include/cube_field.h"
+#include "../include/query_check.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+cube_field::cube_field()
+	: vbo_models(0), models_in_order(false)
+{
+}
+
+cube_field::~cube_field()
+{
+	clear();
+}
+
+void cube_field::layout(gl_state &state, GLsizei count,
+		const glm::mat4 &mesh_transform)
+{
+	place(count);
+	if (models.empty())
+		return;
+
+	for (glm::mat4 &model : models)
+		model = model * mesh_transform;
+
+	if (vbo_models == 0)
+		glGenBuffers(1, &vbo_models);
+
+	// Rewritten whenever culling leaves a subset, so streamed.
+	state.bind_buffer(GL_ARRAY_BUFFER, vbo_models);
+	glBufferData(GL_ARRAY_BUFFER,
+			models.size() * sizeof(glm::mat4),
+			models.data(),
+			GL_STREAM_DRAW);
+
+	models_in_order = true;
+}
+
+void cube_field::place(GLsizei count)
+{
+	models.clear();
+	if (count <= 0)
+		return;
+
+	// Smallest grid side holding count cubes, each cell twice as wide as
+	// the cube in it so they don't touch.
+	int side = 1;
+	while ((GLsizei)side * side * side < count)
+		++side;
+
+	float cell = 2.0f / side;
+	glm::mat4 scale = glm::scale(glm::mat4(1.0f),
+					glm::vec3(cell / 4.0f));
+
+	models.reserve(count);
+	for (GLsizei i = 0; i < count; ++i) {
+		int x = i % side;
+		int y = i / side % side;
+		int z = i / (side * side);
+		glm::vec3 center(-1.0f + cell * (x + 0.5f),
+				-1.0f + cell * (y + 0.5f),
+				-1.0f + cell * (z + 0.5f));
+
+		models.push_back(glm::translate(glm::mat4(1.0f), center) * scale);
+	}
+}
+
+void cube_field::build(gl_state &state,
+		GLint coord3d, GLuint vbo_vertices,
+		GLint v_color, GLuint vbo_colors,
+		GLint model_location,
+		GLuint ibo, const draw_descriptor &draw,
+		const attribute_layout &position,
+		const attribute_layout &color)
+{
+	instanced.clear();
+	instanced.attribute(coord3d, vbo_vertices, position.size, position.type,
+			position.normalized, position.stride,
+			position.offset);
+	instanced.attribute(v_color, vbo_colors, color.size, color.type,
+			color.normalized, color.stride, color.offset);
+	// A mat4 attribute is four vec4 columns on consecutive locations.
+	for (GLint column = 0; model_location >= 0 && column < 4; ++column) {
+		instanced.attribute(model_location + column,
+				vbo_models,
+				4,
+				GL_FLOAT,
+				GL_FALSE,
+				sizeof(glm::mat4),
+				column * sizeof(glm::vec4),
+				1);
+	}
+
+	instanced.elements(ibo, draw);
+	instanced.build(state);
+}
+
+void cube_field::draw(gl_state &state) const
+{
+	instanced.draw_instanced(state, models.size());
+}
+
+void cube_field::draw(gl_state &state, const std::vector<GLuint> &visible)
+{
+	const std::vector<glm::mat4> *source = &models;
+	if (visible.size() != models.size()) {
+		visible_models.clear();
+		for (GLuint i : visible)
+			visible_models.push_back(models[i]);
+
+		source = &visible_models;
+	} else if (models_in_order) {
+		draw(state);
+		return;
+	}
+
+	if (source->empty())
+		return;
+
+	// Orphan the storage a frame still in flight may be reading, so the
+	// upload neither waits for it nor makes the driver copy it.
+	state.bind_buffer(GL_ARRAY_BUFFER, vbo_models);
+	glBufferData(GL_ARRAY_BUFFER,
+			models.size() * sizeof(glm::mat4),
+			nullptr,
+			GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0,
+			source->size() * sizeof(glm::mat4),
+			source->data());
+
+	models_in_order = source == &models;
+	instanced.draw_instanced(state, source->size());
+}
+
+void cube_field::clear()
+{
+	instanced.clear();
+	if (vbo_models != 0)
+		glDeleteBuffers(1, &vbo_models);
+
+	vbo_models = 0;
+	models.clear();
+	visible_models.clear();
+	models_in_order = false;
+}
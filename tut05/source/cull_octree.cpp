@@ -0,0 +1,421 @@
+//
+// Source implementation file for frustum culling over a loose octree.
+//
+
+#include "../include/cull_octree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE__)
+#define CULL_SSE
+#include <xmmintrin.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Floats of a block of 4 boxes.
+const size_t BLOCK_FLOATS = 24;
+const GLuint NO_NODE = (GLuint)-1;
+
+#ifdef CULL_SSE
+
+//
+// Append the ids of the boxes not outside any plane, four boxes a plane
+// at a time.
+//
+void test_boxes(const float *boxes, const GLuint *ids, size_t count,
+		const frustum &view, std::vector<GLuint> &visible)
+{
+	__m128 normal[6][3], abs_normal[6][3], distance[6];
+	for (int p = 0; p < 6; ++p) {
+		for (int a = 0; a < 3; ++a) {
+			normal[p][a] = _mm_set1_ps(view.planes[p][a]);
+			abs_normal[p][a] = _mm_set1_ps(std::fabs(
+							view.planes[p][a]));
+		}
+
+		distance[p] = _mm_set1_ps(view.planes[p].w);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t first = 0; first < count; first += 4) {
+		const float *block = boxes + first / 4 * BLOCK_FLOATS;
+		__m128 center[3], extent[3];
+		for (int a = 0; a < 3; ++a) {
+			center[a] = _mm_loadu_ps(block + 4 * a);
+			extent[a] = _mm_loadu_ps(block + 12 + 4 * a);
+		}
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; ++p) {
+			// Summed in the order classify_box() does, so both
+			// round the same.
+			__m128 d = _mm_mul_ps(normal[p][0], center[0]);
+			__m128 r = _mm_mul_ps(abs_normal[p][0], extent[0]);
+			for (int a = 1; a < 3; ++a) {
+				d = _mm_add_ps(d, _mm_mul_ps(normal[p][a],
+								center[a]));
+				r = _mm_add_ps(r, _mm_mul_ps(abs_normal[p][a],
+								extent[a]));
+			}
+
+			d = _mm_add_ps(d, distance[p]);
+			inside = _mm_and_ps(inside,
+					_mm_cmpge_ps(_mm_add_ps(d, r), zero));
+		}
+
+		int lanes = _mm_movemask_ps(inside);
+		size_t last = std::min(count, first + 4);
+		for (size_t i = first; i < last; ++i) {
+			if (lanes & (1 << (i - first)))
+				visible.push_back(ids[i]);
+		}
+	}
+}
+
+#else
+
+void test_boxes(const float *boxes, const GLuint *ids, size_t count,
+		const frustum &view, std::vector<GLuint> &visible)
+{
+	for (size_t i = 0; i < count; ++i) {
+		const float *block = boxes + i / 4 * BLOCK_FLOATS + i % 4;
+		glm::vec3 center(block[0], block[4], block[8]);
+		glm::vec3 extent(block[12], block[16], block[20]);
+		if (classify_box(view, center, extent) >= 0)
+			visible.push_back(ids[i]);
+	}
+}
+
+#endif // CULL_SSE
+
+// End of anon namespace.
+}
+
+frustum frustum_from_matrix(const glm::mat4 &mvp)
+{
+	// Rows of the matrix; glm indexes columns first.
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; ++r)
+		rows[r] = glm::vec4(mvp[0][r], mvp[1][r], mvp[2][r], mvp[3][r]);
+
+	frustum res;
+	for (int axis = 0; axis < 3; ++axis) {
+		res.planes[2 * axis] = rows[3] + rows[axis];
+		res.planes[2 * axis + 1] = rows[3] - rows[axis];
+	}
+
+	return res;
+}
+
+int classify_box(const frustum &view, const glm::vec3 &center,
+		const glm::vec3 &extent)
+{
+	int result = 1;
+	for (const glm::vec4 &plane : view.planes) {
+		float d = plane.x * center.x + plane.y * center.y +
+			plane.z * center.z + plane.w;
+		float r = std::fabs(plane.x) * extent.x +
+			std::fabs(plane.y) * extent.y +
+			std::fabs(plane.z) * extent.z;
+
+		if (d + r < 0.0f)
+			return -1;
+
+		if (d - r < 0.0f)
+			result = 0;
+	}
+
+	return result;
+}
+
+void transform_bounds(const glm::mat4 &model, const glm::vec3 &center,
+		const glm::vec3 &extent, glm::vec3 &out_center,
+		glm::vec3 &out_extent)
+{
+	// Both computed before either output is written, so that they may
+	// be the inputs.
+	glm::vec4 moved = model * glm::vec4(center, 1.0f);
+	glm::vec3 moved_extent;
+	for (int r = 0; r < 3; ++r) {
+		moved_extent[r] = std::fabs(model[0][r]) * extent.x +
+			std::fabs(model[1][r]) * extent.y +
+			std::fabs(model[2][r]) * extent.z;
+	}
+
+	out_center = glm::vec3(moved);
+	out_extent = moved_extent;
+}
+
+cull_octree::cull_octree()
+	: origin(0.0f), root_size(0.0f), level_count(0), frames(0),
+	visible_total(0), visible_min(0), visible_max(0), ms(0.0), updates(0),
+	moves(0)
+{
+}
+
+void cull_octree::reset(const glm::vec3 &center, float half_size,
+			int levels)
+{
+	origin = center - glm::vec3(half_size);
+	root_size = 2.0f * half_size;
+	level_count = std::max(1, levels);
+	locations.clear();
+	level_start.clear();
+	nodes.clear();
+
+	GLuint total = 0;
+	for (int level = 0; level < level_count; ++level) {
+		level_start.push_back(total);
+		GLuint side = 1u << level;
+		total += side * side * side;
+	}
+
+	nodes.resize(total);
+	for (int level = 0; level < level_count; ++level) {
+		int side = 1 << level;
+		float cell = cell_size(level);
+		for (int z = 0; z < side; ++z) {
+			for (int y = 0; y < side; ++y) {
+				for (int x = 0; x < side; ++x) {
+					node &n = nodes[node_index(level, x, y, z)];
+					n.subtree = 0;
+					n.level = level;
+					n.parent = level == 0 ? NO_NODE :
+						node_index(level - 1, x / 2,
+							y / 2, z / 2);
+
+					n.center = origin + cell *
+						glm::vec3(x + 0.5f, y + 0.5f,
+							z + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+GLuint cull_octree::insert(const glm::vec3 &center, const glm::vec3 &extent)
+{
+	GLuint id = locations.size();
+	location none = { 0, 0 };
+	locations.push_back(none);
+	add_to_node(pick_node(center, extent), id, center, extent);
+
+	return id;
+}
+
+void cull_octree::update(GLuint id, const glm::vec3 &center,
+			const glm::vec3 &extent)
+{
+	++updates;
+	GLuint current = locations[id].node;
+	GLuint target = pick_node(center, extent);
+
+	// A box that crossed into a neighbouring cell still fits the loose
+	// bounds of the old one, unless it went far or changed size.
+	if (target == current || (nodes[target].level == nodes[current].level &&
+				fits(current, center, extent))) {
+
+		store(current, locations[id].slot, center, extent);
+		return;
+	}
+
+	++moves;
+	remove_from_node(id);
+	add_to_node(target, id, center, extent);
+}
+
+void cull_octree::cull(const frustum &view, std::vector<GLuint> &visible)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	visible.clear();
+	if (!nodes.empty())
+		cull_node(0, 0, 0, 0, view, false, visible);
+
+	ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	GLuint kept = visible.size();
+	visible_min = frames == 0 ? kept : std::min(visible_min, kept);
+	visible_max = frames == 0 ? kept : std::max(visible_max, kept);
+	visible_total += kept;
+	++frames;
+}
+
+const char *cull_octree::simd_name()
+{
+#ifdef CULL_SSE
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+void cull_octree::print_report() const
+{
+	if (frames == 0)
+		return;
+
+	cout << "Culling: " << size() << " objects, "
+		<< (double)visible_total / frames
+		<< " visible a frame on average (" << visible_min << " to "
+		<< visible_max << "), " << ms / frames << " ms a frame ("
+		<< simd_name() << "), " << updates << " updates of which "
+		<< moves << " changed node" << endl;
+}
+
+GLuint cull_octree::node_index(int level, int x, int y, int z) const
+{
+	GLuint side = 1u << level;
+	return level_start[level] + (z * side + y) * side + x;
+}
+
+float cull_octree::cell_size(int level) const
+{
+	return root_size / (1 << level);
+}
+
+GLuint cull_octree::pick_node(const glm::vec3 &center,
+			const glm::vec3 &extent) const
+{
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	glm::vec3 local = (center - origin) / root_size;
+	for (int a = 0; a < 3; ++a) {
+		// Outside the root cell, NaN included.
+		if (!(local[a] >= 0.0f && local[a] < 1.0f))
+			return 0;
+	}
+
+	// Down while the box is no wider than a cell of the next level.
+	int level = 0;
+	while (level + 1 < level_count && 2.0f * size <= cell_size(level + 1))
+		++level;
+
+	int side = 1 << level;
+	int cell[3];
+	for (int a = 0; a < 3; ++a)
+		cell[a] = std::min(side - 1, (int)(local[a] * side));
+
+	return node_index(level, cell[0], cell[1], cell[2]);
+}
+
+bool cull_octree::fits(GLuint n, const glm::vec3 &center,
+		const glm::vec3 &extent) const
+{
+	// The root is never tested, anything fits.
+	if (n == 0)
+		return true;
+
+	float loose = cell_size(nodes[n].level);
+	for (int a = 0; a < 3; ++a) {
+		if (!(std::fabs(center[a] - nodes[n].center[a]) + extent[a] <=
+			loose)) {
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void cull_octree::store(GLuint n, GLuint slot, const glm::vec3 &center,
+			const glm::vec3 &extent)
+{
+	float *block = &nodes[n].boxes[slot / 4 * BLOCK_FLOATS];
+	GLuint lane = slot % 4;
+	for (int a = 0; a < 3; ++a) {
+		block[4 * a + lane] = center[a];
+		block[12 + 4 * a + lane] = extent[a];
+	}
+}
+
+void cull_octree::add_to_node(GLuint n, GLuint id, const glm::vec3 &center,
+			const glm::vec3 &extent)
+{
+	node &target = nodes[n];
+	GLuint slot = target.ids.size();
+	target.ids.push_back(id);
+	if (slot % 4 == 0)
+		target.boxes.resize(target.boxes.size() + BLOCK_FLOATS, 0.0f);
+
+	store(n, slot, center, extent);
+	locations[id].node = n;
+	locations[id].slot = slot;
+	count_subtree(n, 1);
+}
+
+void cull_octree::remove_from_node(GLuint id)
+{
+	location at = locations[id];
+	node &from = nodes[at.node];
+	GLuint last = from.ids.size() - 1;
+
+	// The last box of the node takes the place of the one leaving.
+	if (at.slot != last) {
+		const float *block = &from.boxes[last / 4 * BLOCK_FLOATS];
+		GLuint lane = last % 4;
+		glm::vec3 center(block[lane], block[4 + lane], block[8 + lane]);
+		glm::vec3 extent(block[12 + lane], block[16 + lane],
+				block[20 + lane]);
+
+		store(at.node, at.slot, center, extent);
+		from.ids[at.slot] = from.ids[last];
+		locations[from.ids[at.slot]].slot = at.slot;
+	}
+
+	from.ids.pop_back();
+	from.boxes.resize((from.ids.size() + 3) / 4 * BLOCK_FLOATS);
+	count_subtree(at.node, -1);
+}
+
+void cull_octree::count_subtree(GLuint n, int change)
+{
+	for (; n != NO_NODE; n = nodes[n].parent)
+		nodes[n].subtree += change;
+}
+
+void cull_octree::cull_node(int level, int x, int y, int z,
+			const frustum &view, bool inside,
+			std::vector<GLuint> &visible) const
+{
+	const node &n = nodes[node_index(level, x, y, z)];
+	if (n.subtree == 0)
+		return;
+
+	// The root holds what is outside of it, so it is never tested.
+	if (!inside && level > 0) {
+		int side = classify_box(view, n.center,
+					glm::vec3(cell_size(level)));
+		if (side < 0)
+			return;
+
+		inside = side > 0;
+	}
+
+	if (inside) {
+		visible.insert(visible.end(), n.ids.begin(), n.ids.end());
+	} else if (!n.ids.empty()) {
+		test_boxes(n.boxes.data(), n.ids.data(), n.ids.size(), view,
+			visible);
+	}
+
+	if (level + 1 == level_count)
+		return;
+
+	for (int child = 0; child < 8; ++child) {
+		cull_node(level + 1,
+			2 * x + (child & 1),
+			2 * y + (child >> 1 & 1),
+			2 * z + (child >> 2),
+			view, inside, visible);
+	}
+}
@@ -0,0 +1,215 @@
+//
+// Source implementation file for batches of static meshes.
+//
+
+#include "../include/draw_batch.h"
+#include "../include/query_check.h"
+
+#include <cstddef>
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Floats per packed vertex: position then color.
+const GLsizei VERTEX_FLOATS = 6;
+
+// End of anon namespace.
+}
+
+draw_batch::draw_batch()
+	: vertex_buffer(0), index_buffer(0), indirect_buffer(0),
+	visible_buffer(0)
+{
+	all_elements.mode = GL_TRIANGLES;
+	all_elements.count = 0;
+	all_elements.type = GL_UNSIGNED_INT;
+}
+
+draw_batch::~draw_batch()
+{
+	clear();
+}
+
+GLsizei draw_batch::add(const GLfloat *coords,
+		const GLfloat *colors,
+		GLsizei vertices,
+		const GLuint *indices,
+		GLsizei count,
+		const glm::mat4 &model)
+{
+	GLuint first_vertex = vertex_data.size() / VERTEX_FLOATS;
+	for (GLsizei i = 0; i < vertices; ++i) {
+		glm::vec4 p = model * glm::vec4(coords[3 * i],
+						coords[3 * i + 1],
+						coords[3 * i + 2],
+						1.0f);
+
+		vertex_data.push_back(p.x);
+		vertex_data.push_back(p.y);
+		vertex_data.push_back(p.z);
+		vertex_data.push_back(colors[3 * i]);
+		vertex_data.push_back(colors[3 * i + 1]);
+		vertex_data.push_back(colors[3 * i + 2]);
+	}
+
+	offsets.push_back((const GLvoid *)(index_data.size() * sizeof(GLuint)));
+	counts.push_back(count);
+	for (GLsizei i = 0; i < count; ++i)
+		index_data.push_back(first_vertex + indices[i]);
+
+	return counts.size() - 1;
+}
+
+void draw_batch::build(gl_state &state, GLint coord3d, GLint v_color,
+		bool indirect)
+{
+	if (vertex_buffer == 0) {
+		glGenBuffers(1, &vertex_buffer);
+		state.bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER,
+				vertex_data.size() * sizeof(GLfloat),
+				vertex_data.data(),
+				GL_STATIC_DRAW);
+
+		glGenBuffers(1, &index_buffer);
+		all_elements = upload_elements(state,
+					index_buffer,
+					GL_TRIANGLES,
+					index_data.data(),
+					index_data.size());
+	}
+
+	if (indirect && indirect_buffer == 0 && indirect_supported()) {
+		commands.resize(counts.size());
+		for (size_t i = 0; i < commands.size(); ++i) {
+			commands[i].count = counts[i];
+			commands[i].instance_count = 1;
+			commands[i].first_index =
+				(size_t)offsets[i] / sizeof(GLuint);
+			commands[i].base_vertex = 0;
+			commands[i].base_instance = 0;
+		}
+
+		glGenBuffers(1, &indirect_buffer);
+		state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER,
+				commands.size() * sizeof(draw_command),
+				commands.data(),
+				GL_STATIC_DRAW);
+
+		// Filled by every draw of a subset.
+		glGenBuffers(1, &visible_buffer);
+	}
+
+	layout.clear();
+	GLsizei stride = VERTEX_FLOATS * sizeof(GLfloat);
+	layout.attribute(coord3d, vertex_buffer, 3, GL_FLOAT, GL_FALSE,
+			stride, 0);
+	layout.attribute(v_color, vertex_buffer, 3, GL_FLOAT, GL_FALSE,
+			stride, 3 * sizeof(GLfloat));
+	layout.elements(index_buffer, all_elements);
+	layout.build(state);
+}
+
+void draw_batch::draw(gl_state &state) const
+{
+	if (counts.empty())
+		return;
+
+	layout.bind(state);
+	if (indirect_buffer != 0) {
+		state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES,
+					GL_UNSIGNED_INT,
+					0,
+					counts.size(),
+					0);
+	} else {
+		glMultiDrawElements(GL_TRIANGLES,
+				counts.data(),
+				GL_UNSIGNED_INT,
+				offsets.data(),
+				counts.size());
+	}
+}
+
+void draw_batch::draw(gl_state &state, const std::vector<GLuint> &visible)
+{
+	if (visible.size() == counts.size()) {
+		draw(state);
+		return;
+	}
+
+	if (visible.empty())
+		return;
+
+	layout.bind(state);
+	if (indirect_buffer != 0) {
+		visible_commands.clear();
+		for (GLuint i : visible)
+			visible_commands.push_back(commands[i]);
+
+		// Orphan the storage the previous frame may still be reading,
+		// then fill the new one.
+		GLsizeiptr size = visible_commands.size() *
+				sizeof(draw_command);
+		state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, visible_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER,
+				commands.size() * sizeof(draw_command),
+				nullptr,
+				GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size,
+				visible_commands.data());
+		glMultiDrawElementsIndirect(GL_TRIANGLES,
+					GL_UNSIGNED_INT,
+					0,
+					visible_commands.size(),
+					0);
+		return;
+	}
+
+	visible_counts.clear();
+	visible_offsets.clear();
+	for (GLuint i : visible) {
+		visible_counts.push_back(counts[i]);
+		visible_offsets.push_back(offsets[i]);
+	}
+
+	glMultiDrawElements(GL_TRIANGLES,
+			visible_counts.data(),
+			GL_UNSIGNED_INT,
+			visible_offsets.data(),
+			visible_counts.size());
+}
+
+void draw_batch::clear()
+{
+	layout.clear();
+	if (vertex_buffer != 0) {
+		glDeleteBuffers(1, &vertex_buffer);
+		glDeleteBuffers(1, &index_buffer);
+	}
+
+	if (indirect_buffer != 0) {
+		glDeleteBuffers(1, &indirect_buffer);
+		glDeleteBuffers(1, &visible_buffer);
+	}
+
+	vertex_buffer = 0;
+	index_buffer = 0;
+	indirect_buffer = 0;
+	visible_buffer = 0;
+	vertex_data.clear();
+	index_data.clear();
+	counts.clear();
+	offsets.clear();
+	visible_counts.clear();
+	visible_offsets.clear();
+	commands.clear();
+	visible_commands.clear();
+}
+
+bool draw_batch::indirect_supported()
+{
+	return GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+}
@@ -0,0 +1,190 @@
+//
+// Source implementation file for the GL state cache.
+//
+
+#include "../include/gl_state.h"
+#include "../include/query_check.h"
+
+#include <iostream>
+
+using std::cout;
+using std::endl;
+
+gl_state::gl_state()
+{
+	counters.issued = 0;
+	counters.dropped = 0;
+	invalidate();
+}
+
+bool gl_state::changed(bool differs)
+{
+	if (differs)
+		++counters.issued;
+	else
+		++counters.dropped;
+
+	return differs;
+}
+
+void gl_state::use_program(GLuint new_program)
+{
+	if (changed(!valid_program || program != new_program)) {
+		glUseProgram(new_program);
+		program = new_program;
+		valid_program = true;
+	}
+}
+
+void gl_state::bind_buffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ARRAY_BUFFER) {
+		if (changed(!valid_array_buffer || array_buffer != buffer)) {
+			glBindBuffer(target, buffer);
+			array_buffer = buffer;
+			valid_array_buffer = true;
+		}
+	} else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+		if (changed(!valid_element_buffer ||
+				element_buffer != buffer)) {
+
+			glBindBuffer(target, buffer);
+			element_buffer = buffer;
+			valid_element_buffer = true;
+		}
+	} else {
+		changed(true);
+		glBindBuffer(target, buffer);
+	}
+}
+
+void gl_state::bind_vertex_array(GLuint new_vertex_array)
+{
+	if (changed(!valid_vertex_array || vertex_array != new_vertex_array)) {
+		glBindVertexArray(new_vertex_array);
+		vertex_array = new_vertex_array;
+		valid_vertex_array = true;
+		valid_element_buffer = false;
+	}
+}
+
+void gl_state::set_cap(GLenum cap, bool on)
+{
+	int *state = nullptr;
+	if (cap == GL_BLEND)
+		state = &blend;
+	else if (cap == GL_DEPTH_TEST)
+		state = &depth_test;
+
+	if (state != nullptr && !changed(*state != (int)on))
+		return;
+
+	if (state == nullptr)
+		changed(true);
+	else
+		*state = on;
+
+	if (on)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void gl_state::enable(GLenum cap)
+{
+	set_cap(cap, true);
+}
+
+void gl_state::disable(GLenum cap)
+{
+	set_cap(cap, false);
+}
+
+void gl_state::blend_func(GLenum src, GLenum dst)
+{
+	if (changed(!valid_blend_func || blend_src != src ||
+			blend_dst != dst)) {
+
+		glBlendFunc(src, dst);
+		blend_src = src;
+		blend_dst = dst;
+		valid_blend_func = true;
+	}
+}
+
+void gl_state::depth_func(GLenum func)
+{
+	if (changed(!valid_depth_func || depth != func)) {
+		glDepthFunc(func);
+		depth = func;
+		valid_depth_func = true;
+	}
+}
+
+void gl_state::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (changed(!valid_viewport || view[0] != x || view[1] != y ||
+			view[2] != width || view[3] != height)) {
+
+		glViewport(x, y, width, height);
+		view[0] = x;
+		view[1] = y;
+		view[2] = width;
+		view[3] = height;
+		valid_viewport = true;
+	}
+}
+
+void gl_state::clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	if (changed(!valid_clear_color || clear[0] != r || clear[1] != g ||
+			clear[2] != b || clear[3] != a)) {
+
+		glClearColor(r, g, b, a);
+		clear[0] = r;
+		clear[1] = g;
+		clear[2] = b;
+		clear[3] = a;
+		valid_clear_color = true;
+	}
+}
+
+void gl_state::invalidate()
+{
+	valid_program = false;
+	program = 0;
+	valid_array_buffer = false;
+	array_buffer = 0;
+	valid_element_buffer = false;
+	element_buffer = 0;
+	valid_vertex_array = false;
+	vertex_array = 0;
+	blend = -1;
+	depth_test = -1;
+	valid_blend_func = false;
+	blend_src = GL_ONE;
+	blend_dst = GL_ZERO;
+	valid_depth_func = false;
+	depth = GL_LESS;
+	valid_viewport = false;
+	for (GLint &v : view)
+		v = 0;
+
+	valid_clear_color = false;
+	for (GLfloat &c : clear)
+		c = 0.0;
+}
+
+void gl_state::invalidate_buffer(GLenum target)
+{
+	if (target == GL_ARRAY_BUFFER)
+		valid_array_buffer = false;
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		valid_element_buffer = false;
+}
+
+void gl_state::print_report() const
+{
+	cout << "GL state changes: " << counters.issued << " issued, "
+		<< counters.dropped << " dropped" << endl;
+}
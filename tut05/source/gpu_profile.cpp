@@ -0,0 +1,319 @@
+//
+// Source implementation file for the GPU timer markers.
+//
+
+#include "../include/gpu_profile.h"
+#include "../include/query_check.h"
+
+#ifdef GPU_PROFILE_MARKERS
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const size_t MAX_EVENTS = 1 << 20;
+// Trace threads of the timelines: the first CPU thread, the GPU, then
+// any other CPU threads.
+const int CPU_TRACK = 1;
+const int GPU_TRACK = 2;
+
+struct trace_event {
+	const char *name;
+	double start_us, end_us;
+	int track;
+};
+
+//
+// Queries of one frame: a start and an end timestamp per marker.
+//
+struct frame_queries {
+	GLuint queries[2 * GPU_PROFILE_MARKERS_PER_FRAME];
+	const char *names[GPU_PROFILE_MARKERS_PER_FRAME];
+	int count;
+	// Queries complete in order, so this one being done means all are.
+	GLuint last;
+	bool pending;
+};
+
+bool initialized;
+// Whether the context has timer queries at all.
+bool timers;
+frame_queries frames[GPU_PROFILE_FRAMES];
+unsigned long frame;
+frame_queries *current;
+// Open markers of the frame, -1 for one that didn't fit, and how many
+// more are open past the bottom of the stack.
+int open_markers[GPU_PROFILE_MARKERS_PER_FRAME];
+int depth;
+int overflow;
+// Both clocks read at the same moment, the trace starts there.
+GLint64 gpu_origin;
+Uint64 cpu_origin;
+// Events come from every thread that times something.
+std::mutex events_mutex;
+std::vector<trace_event> events;
+// CPU threads in order of their first event, for their tracks.
+std::vector<std::thread::id> cpu_threads;
+unsigned long dropped_frames;
+
+void add_event(const char *name, double start_us, double end_us, int track)
+{
+	std::lock_guard<std::mutex> lock(events_mutex);
+	if (events.size() < MAX_EVENTS)
+		events.push_back({name, start_us, end_us, track});
+}
+
+//
+// Track of the calling thread. Needs events_mutex held.
+//
+int cpu_track()
+{
+	std::thread::id id = std::this_thread::get_id();
+	auto found = std::find(cpu_threads.begin(), cpu_threads.end(), id);
+	int index = found - cpu_threads.begin();
+	if (found == cpu_threads.end())
+		cpu_threads.push_back(id);
+
+	return index == 0 ? CPU_TRACK : GPU_TRACK + index;
+}
+
+double gpu_us(GLuint64 timestamp)
+{
+	return ((GLint64)timestamp - gpu_origin) / 1000.0;
+}
+
+//
+// Turn a frame's timestamps into events. Without wait, a frame the GPU
+// hasn't finished yet is dropped instead.
+//
+void collect(frame_queries &queries, bool wait)
+{
+	if (!queries.pending)
+		return;
+
+	queries.pending = false;
+	GLint available = GL_TRUE;
+	if (!wait) {
+		glGetQueryObjectiv(queries.last, GL_QUERY_RESULT_AVAILABLE,
+				&available);
+	}
+
+	if (!available) {
+		++dropped_frames;
+		return;
+	}
+
+	for (int i = 0; i < queries.count; ++i) {
+		GLuint64 start, end;
+		glGetQueryObjectui64v(queries.queries[2 * i], GL_QUERY_RESULT,
+				&start);
+
+		glGetQueryObjectui64v(queries.queries[2 * i + 1],
+				GL_QUERY_RESULT, &end);
+
+		add_event(queries.names[i], gpu_us(start), gpu_us(end),
+			GPU_TRACK);
+	}
+}
+
+void write_event(std::ostringstream &json, const trace_event &event)
+{
+	const char *category = event.track == GPU_TRACK ? "gpu" : "cpu";
+	json << ",\n{\"name\": \"" << event.name
+		<< "\", \"cat\": \"" << category
+		<< "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.track
+		<< ", \"ts\": " << event.start_us
+		<< ", \"dur\": " << event.end_us - event.start_us << "}";
+}
+
+//
+// Metadata event naming a track in the trace viewer.
+//
+void write_track_name(std::ostringstream &json, int track,
+		const std::string &name)
+{
+	json << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+		<< "\"tid\": " << track << ", \"args\": {\"name\": \"" << name
+		<< "\"}}";
+}
+
+// End of anon namespace.
+}
+
+void gpu_profile_init()
+{
+	timers = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if (timers) {
+		for (frame_queries &queries : frames) {
+			glGenQueries(2 * GPU_PROFILE_MARKERS_PER_FRAME,
+					queries.queries);
+		}
+
+		glGetInteger64v(GL_TIMESTAMP, &gpu_origin);
+	} else {
+		cerr << "No timer queries, tracing the CPU only" << endl;
+	}
+
+	cpu_origin = SDL_GetPerformanceCounter();
+	initialized = true;
+}
+
+void gpu_profile_begin_frame()
+{
+	if (!timers)
+		return;
+
+	current = &frames[frame % GPU_PROFILE_FRAMES];
+	collect(*current, false);
+	current->count = 0;
+	depth = 0;
+	overflow = 0;
+}
+
+void gpu_profile_end_frame()
+{
+	if (current == nullptr)
+		return;
+
+	// Close what is still open so every start has an end.
+	while (depth > 0)
+		gpu_profile_pop();
+
+	current->pending = current->count > 0;
+	current = nullptr;
+	++frame;
+}
+
+void gpu_profile_push(const char *name)
+{
+	if (current == nullptr)
+		return;
+
+	if (depth == GPU_PROFILE_MARKERS_PER_FRAME) {
+		++overflow;
+		return;
+	}
+
+	int marker = -1;
+	if (current->count < GPU_PROFILE_MARKERS_PER_FRAME) {
+		marker = current->count++;
+		current->names[marker] = name;
+		current->last = current->queries[2 * marker];
+		glQueryCounter(current->last, GL_TIMESTAMP);
+	}
+
+	open_markers[depth++] = marker;
+}
+
+void gpu_profile_pop()
+{
+	if (current == nullptr || depth == 0)
+		return;
+
+	if (overflow > 0) {
+		--overflow;
+		return;
+	}
+
+	int marker = open_markers[--depth];
+	if (marker == -1)
+		return;
+
+	current->last = current->queries[2 * marker + 1];
+	glQueryCounter(current->last, GL_TIMESTAMP);
+}
+
+void gpu_profile_cpu_event(const char *name, Uint64 start, Uint64 end)
+{
+	if (!initialized)
+		return;
+
+	double frequency = SDL_GetPerformanceFrequency();
+	double start_us = (Sint64)(start - cpu_origin) * 1000000.0 / frequency;
+	double end_us = (Sint64)(end - cpu_origin) * 1000000.0 / frequency;
+
+	std::lock_guard<std::mutex> lock(events_mutex);
+	if (events.size() < MAX_EVENTS)
+		events.push_back({name, start_us, end_us, cpu_track()});
+}
+
+bool gpu_profile_write(const char *filename)
+{
+	if (!initialized)
+		return false;
+
+	// Off the frame loop, waiting is fine now.
+	if (timers) {
+		glFinish();
+		for (frame_queries &queries : frames)
+			collect(queries, true);
+	}
+
+	std::ostringstream json;
+	json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+		<< "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+		<< "\"args\": {\"name\": \"frames\"}}";
+
+	std::lock_guard<std::mutex> lock(events_mutex);
+	write_track_name(json, CPU_TRACK, "CPU");
+	write_track_name(json, GPU_TRACK, "GPU");
+	for (size_t i = 1; i < cpu_threads.size(); ++i) {
+		write_track_name(json, GPU_TRACK + i,
+				"CPU " + std::to_string(i + 1));
+	}
+
+	for (const trace_event &event : events)
+		write_event(json, event);
+
+	json << "\n]}\n";
+
+	SDL_RWops *rw = SDL_RWFromFile(filename, "wb");
+	if (rw == nullptr) {
+		cerr << "Error writing " << filename << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	std::string text = json.str();
+	SDL_RWwrite(rw, text.data(), text.size(), 1);
+	SDL_RWclose(rw);
+
+	cout << "Frame trace: " << events.size() << " events, "
+		<< dropped_frames << " GPU frame(s) dropped, written to "
+		<< filename << endl;
+
+	return true;
+}
+
+void gpu_profile_destroy()
+{
+	if (timers) {
+		for (frame_queries &queries : frames) {
+			glDeleteQueries(2 * GPU_PROFILE_MARKERS_PER_FRAME,
+					queries.queries);
+
+			queries.pending = false;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(events_mutex);
+	events.clear();
+	cpu_threads.clear();
+	timers = false;
+	initialized = false;
+}
+
+#endif // GPU_PROFILE_MARKERS
@@ -0,0 +1,262 @@
+//
+// Source implementation file for meshes drawn from vertex array objects.
+//
+
+#include "../include/mesh.h"
+#include "../include/query_check.h"
+
+#include <utility>
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Attributes enabled by emulated meshes, one bit per location, so the next
+// emulated bind only touches the ones that differ.
+unsigned long emulated_enabled = 0;
+// Attributes emulated meshes gave a divisor, which stays until reset.
+unsigned long emulated_divided = 0;
+const GLuint MAX_EMULATED_LOCATION = sizeof(emulated_enabled) * 8;
+
+void set_divisor(GLuint location, GLuint divisor)
+{
+	if (GLEW_VERSION_3_3)
+		glVertexAttribDivisor(location, divisor);
+	else
+		glVertexAttribDivisorARB(location, divisor);
+}
+
+draw_descriptor upload(gl_state &state, GLuint buffer, GLenum mode,
+			const void *indices, GLsizei count, GLenum type,
+			size_t index_size)
+{
+	if (mesh::vertex_arrays_supported())
+		state.bind_vertex_array(0);
+
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+			count * index_size,
+			indices,
+			GL_STATIC_DRAW);
+
+	draw_descriptor res;
+	res.mode = mode;
+	res.count = count;
+	res.type = type;
+
+	return res;
+}
+
+// End of anon namespace.
+}
+
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLubyte *indices, GLsizei count)
+{
+	return upload(state, buffer, mode, indices, count, GL_UNSIGNED_BYTE,
+			sizeof(GLubyte));
+}
+
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLushort *indices, GLsizei count)
+{
+	return upload(state, buffer, mode, indices, count, GL_UNSIGNED_SHORT,
+			sizeof(GLushort));
+}
+
+draw_descriptor upload_elements(gl_state &state, GLuint buffer, GLenum mode,
+				const GLuint *indices, GLsizei count)
+{
+	return upload(state, buffer, mode, indices, count, GL_UNSIGNED_INT,
+			sizeof(GLuint));
+}
+
+mesh::mesh()
+	: element_buffer(0), vertex_array(0)
+{
+	draw_info.mode = GL_TRIANGLES;
+	draw_info.count = 0;
+	draw_info.type = GL_UNSIGNED_SHORT;
+}
+
+mesh::~mesh()
+{
+	clear();
+}
+
+mesh::mesh(mesh &&other)
+	: attributes(std::move(other.attributes)),
+	element_buffer(other.element_buffer),
+	draw_info(other.draw_info),
+	vertex_array(other.vertex_array)
+{
+	other.element_buffer = 0;
+	other.vertex_array = 0;
+}
+
+mesh &mesh::operator=(mesh &&other)
+{
+	if (this != &other) {
+		clear();
+		attributes = std::move(other.attributes);
+		element_buffer = other.element_buffer;
+		draw_info = other.draw_info;
+		vertex_array = other.vertex_array;
+		other.element_buffer = 0;
+		other.vertex_array = 0;
+	}
+
+	return *this;
+}
+
+void mesh::attribute(GLint location, GLuint buffer, GLint size, GLenum type,
+		GLboolean normalized, GLsizei stride, size_t offset,
+		GLuint divisor)
+{
+	if (location < 0)
+		return;
+
+	attribute_info a;
+	a.location = location;
+	a.buffer = buffer;
+	a.size = size;
+	a.type = type;
+	a.normalized = normalized;
+	a.stride = stride;
+	a.offset = offset;
+	a.divisor = divisor;
+	attributes.push_back(a);
+}
+
+void mesh::elements(GLuint buffer, const draw_descriptor &draw)
+{
+	element_buffer = buffer;
+	draw_info = draw;
+}
+
+void mesh::build(gl_state &state, bool emulate)
+{
+	if (vertex_array != 0) {
+		// Unbind through the cache first, the new object may get the
+		// same name.
+		state.bind_vertex_array(0);
+		glDeleteVertexArrays(1, &vertex_array);
+		vertex_array = 0;
+	}
+
+	if (emulate || !vertex_arrays_supported())
+		return;
+
+	glGenVertexArrays(1, &vertex_array);
+	state.bind_vertex_array(vertex_array);
+	for (const attribute_info &a : attributes) {
+		state.bind_buffer(GL_ARRAY_BUFFER, a.buffer);
+		glVertexAttribPointer(a.location, a.size, a.type, a.normalized,
+				a.stride, (const GLvoid *)a.offset);
+
+		glEnableVertexAttribArray(a.location);
+		if (a.divisor != 0)
+			set_divisor(a.location, a.divisor);
+	}
+
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+	// Leave the default vertex array bound, so later element buffer
+	// binds can't end up in this one.
+	state.bind_vertex_array(0);
+}
+
+void mesh::bind(gl_state &state) const
+{
+	if (vertex_array != 0) {
+		state.bind_vertex_array(vertex_array);
+		return;
+	}
+
+	apply(state);
+}
+
+void mesh::draw(gl_state &state) const
+{
+	bind(state);
+	glDrawElements(draw_info.mode, draw_info.count, draw_info.type, 0);
+}
+
+void mesh::draw_instanced(gl_state &state, GLsizei instances) const
+{
+	bind(state);
+	if (GLEW_VERSION_3_1) {
+		glDrawElementsInstanced(draw_info.mode, draw_info.count,
+					draw_info.type, 0, instances);
+	} else {
+		glDrawElementsInstancedARB(draw_info.mode, draw_info.count,
+					draw_info.type, 0, instances);
+	}
+}
+
+//
+// Replay the layout on the default vertex array.
+//
+void mesh::apply(gl_state &state) const
+{
+	if (vertex_arrays_supported())
+		state.bind_vertex_array(0);
+
+	unsigned long wanted = 0, divided = 0;
+	for (const attribute_info &a : attributes) {
+		state.bind_buffer(GL_ARRAY_BUFFER, a.buffer);
+		glVertexAttribPointer(a.location, a.size, a.type, a.normalized,
+				a.stride, (const GLvoid *)a.offset);
+
+		if (a.divisor != 0)
+			set_divisor(a.location, a.divisor);
+
+		if (a.location >= MAX_EMULATED_LOCATION) {
+			glEnableVertexAttribArray(a.location);
+			continue;
+		}
+
+		wanted |= 1UL << a.location;
+		if (a.divisor != 0)
+			divided |= 1UL << a.location;
+
+		if (!(emulated_enabled & (1UL << a.location)))
+			glEnableVertexAttribArray(a.location);
+	}
+
+	unsigned long stale = emulated_enabled & ~wanted;
+	for (GLuint i = 0; stale != 0; ++i, stale >>= 1) {
+		if (stale & 1)
+			glDisableVertexAttribArray(i);
+	}
+
+	stale = emulated_divided & ~divided;
+	for (GLuint i = 0; stale != 0; ++i, stale >>= 1) {
+		if (stale & 1)
+			set_divisor(i, 0);
+	}
+
+	emulated_enabled = wanted;
+	emulated_divided = divided;
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+}
+
+void mesh::clear()
+{
+	if (vertex_array != 0)
+		glDeleteVertexArrays(1, &vertex_array);
+
+	vertex_array = 0;
+	element_buffer = 0;
+	draw_info.count = 0;
+	attributes.clear();
+}
+
+bool mesh::vertex_arrays_supported()
+{
+	return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+}
+
+bool mesh::instancing_supported()
+{
+	return GLEW_VERSION_3_3 ||
+		(GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced);
+}
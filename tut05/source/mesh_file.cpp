@@ -0,0 +1,734 @@
+//
+// Source implementation file for meshes loaded from OBJ and PLY files.
+//
+
+#include "../include/mesh_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using std::cerr;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const Uint32 CACHE_MAGIC = 0x434d4c47; // "GLMC"
+const Uint32 CACHE_VERSION = 1;
+const Uint64 FNV_OFFSET = 14695981039346656037ULL;
+const Uint64 FNV_PRIME = 1099511628211ULL;
+// Color of vertices the file gives none.
+const GLfloat DEFAULT_COLOR = 0.6f;
+
+// Header at the start of every cache file. Offsets are from the start of
+// the file and multiples of MESH_CACHE_ALIGN.
+struct cache_header {
+	Uint32 magic;
+	Uint32 version;
+	Uint64 source_size;
+	Sint64 source_mtime;
+	Uint32 vertices;
+	Uint32 count;
+	Uint64 positions;
+	Uint64 colors;
+	Uint64 indices;
+};
+
+//
+// Parsing over a mapped file, which isn't NUL terminated, so every scan
+// stops at end.
+//
+struct text {
+	const char *p;
+	const char *end;
+};
+
+void skip_blanks(text &t)
+{
+	while (t.p < t.end && (*t.p == ' ' || *t.p == '\t' || *t.p == '\r'))
+		++t.p;
+}
+
+void skip_line(text &t)
+{
+	const char *newline = (const char *)memchr(t.p, '\n', t.end - t.p);
+	t.p = newline != nullptr ? newline + 1 : t.end;
+}
+
+bool at_line_end(text &t)
+{
+	skip_blanks(t);
+
+	return t.p == t.end || *t.p == '\n';
+}
+
+//
+// The next word of the line, empty at its end.
+//
+std::string word(text &t)
+{
+	skip_blanks(t);
+	const char *start = t.p;
+	while (t.p < t.end && *t.p != ' ' && *t.p != '\t' && *t.p != '\r' &&
+		*t.p != '\n') {
+
+		++t.p;
+	}
+
+	return std::string(start, t.p);
+}
+
+bool parse_int(text &t, long &value)
+{
+	skip_blanks(t);
+	bool negative = t.p < t.end && *t.p == '-';
+	if (t.p < t.end && (*t.p == '-' || *t.p == '+'))
+		++t.p;
+
+	if (t.p == t.end || *t.p < '0' || *t.p > '9')
+		return false;
+
+	value = 0;
+	while (t.p < t.end && *t.p >= '0' && *t.p <= '9')
+		value = value * 10 + (*t.p++ - '0');
+
+	if (negative)
+		value = -value;
+
+	return true;
+}
+
+//
+// 10 to the exponent, from a table for the usual ones.
+//
+double power_of_ten(int exponent)
+{
+	static const double table[] = {
+		1e-16, 1e-15, 1e-14, 1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8,
+		1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3,
+		1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+		1e15, 1e16
+	};
+	if (exponent < -16 || exponent > 16)
+		return std::pow(10.0, exponent);
+
+	return table[exponent + 16];
+}
+
+//
+// Decimal floats with an optional exponent, which is all OBJ and ASCII PLY
+// writers put out; strtof would need a NUL terminated copy.
+//
+bool parse_float(text &t, GLfloat &value)
+{
+	skip_blanks(t);
+	bool negative = t.p < t.end && *t.p == '-';
+	if (t.p < t.end && (*t.p == '-' || *t.p == '+'))
+		++t.p;
+
+	double mantissa = 0.0;
+	int digits = 0, exponent = 0;
+	while (t.p < t.end && *t.p >= '0' && *t.p <= '9') {
+		mantissa = mantissa * 10.0 + (*t.p++ - '0');
+		++digits;
+	}
+
+	if (t.p < t.end && *t.p == '.') {
+		++t.p;
+		while (t.p < t.end && *t.p >= '0' && *t.p <= '9') {
+			mantissa = mantissa * 10.0 + (*t.p++ - '0');
+			--exponent;
+			++digits;
+		}
+	}
+
+	if (digits == 0)
+		return false;
+
+	if (t.p < t.end && (*t.p == 'e' || *t.p == 'E')) {
+		++t.p;
+		long e;
+		if (!parse_int(t, e))
+			return false;
+
+		exponent += e;
+	}
+
+	double scaled = mantissa * power_of_ten(exponent);
+	value = negative ? -scaled : scaled;
+
+	return true;
+}
+
+//
+// One "f" line: a fan over its corners, each the position index before
+// any '/', counted from 1 or, when negative, back from the last vertex.
+//
+bool parse_face(text &t, GLuint vertices, std::vector<GLuint> &indices)
+{
+	GLuint corners[3];
+	int count = 0;
+	while (!at_line_end(t)) {
+		long ref;
+		if (!parse_int(t, ref) || ref == 0)
+			return false;
+
+		// Texture coordinates and normals aren't used.
+		while (t.p < t.end && *t.p == '/')
+			word(t);
+
+		GLuint v = ref > 0 ? ref - 1 : vertices + ref;
+		if (count < 2) {
+			corners[count++] = v;
+			continue;
+		}
+
+		corners[2] = v;
+		indices.insert(indices.end(), corners, corners + 3);
+		corners[1] = v;
+	}
+
+	return true;
+}
+
+bool import_obj(text t, mesh_data &mesh)
+{
+	const GLfloat gray[3] = {
+		DEFAULT_COLOR, DEFAULT_COLOR, DEFAULT_COLOR
+	};
+	for (int line = 1; t.p < t.end; ++line) {
+		std::string keyword = word(t);
+		bool parsed = true;
+		if (keyword == "v") {
+			GLfloat xyz[3];
+			for (int i = 0; i < 3 && parsed; ++i)
+				parsed = parse_float(t, xyz[i]);
+
+			mesh.positions.insert(mesh.positions.end(), xyz,
+					xyz + 3);
+
+			// Colors are the last three values of the line when
+			// there are three or more after the position, as a
+			// lone fourth one is w.
+			GLfloat extra[4];
+			int extras = 0;
+			while (parsed && extras < 4 && !at_line_end(t))
+				parsed = parse_float(t, extra[extras++]);
+
+			const GLfloat *rgb = extras >= 3 ? &extra[extras - 3]
+							: gray;
+
+			mesh.colors.insert(mesh.colors.end(), rgb, rgb + 3);
+		} else if (keyword == "f") {
+			parsed = parse_face(t, mesh.vertices(), mesh.indices);
+		}
+
+		if (!parsed) {
+			cerr << "Error: bad OBJ line " << line << endl;
+			return false;
+		}
+
+		skip_line(t);
+	}
+
+	return true;
+}
+
+//
+// An element of a PLY header and its properties, in file order.
+//
+struct ply_element {
+	std::string name;
+	long count;
+	std::vector<std::string> properties;
+	std::vector<std::string> types;
+	// Index of the first list property, -1 without one.
+	int list;
+};
+
+//
+// Skip the values of the first properties of e on a line, lists included.
+//
+bool skip_ply_properties(text &t, const ply_element &e, int properties)
+{
+	for (int i = 0; i < properties; ++i) {
+		long count = 1;
+		if (e.types[i] == "list" && (!parse_int(t, count) || count < 0))
+			return false;
+
+		GLfloat value;
+		for (long k = 0; k < count; ++k) {
+			if (!parse_float(t, value))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool import_ply(text t, mesh_data &mesh)
+{
+	std::vector<ply_element> elements;
+	if (word(t) != "ply") {
+		cerr << "Error: not a PLY file" << endl;
+		return false;
+	}
+
+	for (skip_line(t); t.p < t.end; skip_line(t)) {
+		std::string keyword = word(t);
+		if (keyword == "end_header") {
+			skip_line(t);
+			break;
+		}
+
+		if (keyword == "format" && word(t) != "ascii") {
+			cerr << "Error: only ASCII PLY files are supported"
+				<< endl;
+
+			return false;
+		}
+
+		if (keyword == "element") {
+			ply_element e;
+			e.name = word(t);
+			if (!parse_int(t, e.count) || e.count < 0) {
+				cerr << "Error: bad PLY element" << endl;
+				return false;
+			}
+
+			e.list = -1;
+			elements.push_back(e);
+		} else if (keyword == "property" && !elements.empty()) {
+			ply_element &e = elements.back();
+			std::string type = word(t);
+			if (type == "list") {
+				if (e.list == -1)
+					e.list = e.properties.size();
+
+				// Count and item types.
+				word(t);
+				word(t);
+			}
+
+			e.types.push_back(type);
+			e.properties.push_back(word(t));
+		}
+	}
+
+	for (const ply_element &e : elements) {
+		if (e.name == "vertex") {
+			// Where x, y, z, red, green and blue are on a line.
+			const char *names[6] = {
+				"x", "y", "z", "red", "green", "blue"
+			};
+			int column[6];
+			for (int i = 0; i < 6; ++i) {
+				column[i] = std::find(e.properties.begin(),
+						e.properties.end(),
+						names[i]) -
+					e.properties.begin();
+
+				if (column[i] == (int)e.properties.size())
+					column[i] = -1;
+			}
+
+			if (column[0] < 0 || column[1] < 0 || column[2] < 0 ||
+				e.list != -1) {
+
+				cerr << "Error: PLY vertices need x, y and z"
+					<< endl;
+
+				return false;
+			}
+
+			bool has_color = column[3] >= 0 && column[4] >= 0 &&
+				column[5] >= 0;
+
+			// Byte colors go from 0..255 to 0..1.
+			GLfloat unit = 1.0f;
+			if (has_color && (e.types[column[3]] == "uchar" ||
+					e.types[column[3]] == "uint8")) {
+
+				unit = 1.0f / 255.0f;
+			}
+
+			std::vector<GLfloat> values(e.properties.size());
+			for (long v = 0; v < e.count; ++v, skip_line(t)) {
+				for (GLfloat &value : values) {
+					if (!parse_float(t, value)) {
+						cerr << "Error: bad PLY vertex "
+							<< v << endl;
+
+						return false;
+					}
+				}
+
+				for (int i = 0; i < 3; ++i) {
+					mesh.positions.push_back(
+						values[column[i]]);
+				}
+
+				for (int i = 3; i < 6; ++i) {
+					mesh.colors.push_back(has_color ?
+						values[column[i]] * unit :
+						DEFAULT_COLOR);
+				}
+			}
+		} else if (e.name == "face") {
+			// The vertex list by its usual names, else the first.
+			int column = e.list;
+			for (size_t i = 0; i < e.properties.size(); ++i) {
+				if (e.types[i] == "list" &&
+					(e.properties[i] == "vertex_indices" ||
+					e.properties[i] == "vertex_index")) {
+
+					column = i;
+					break;
+				}
+			}
+
+			if (column < 0) {
+				cerr << "Error: PLY faces need a vertex list"
+					<< endl;
+
+				return false;
+			}
+
+			// The list is all that's read: properties before it are
+			// skipped value by value, those after it with the rest
+			// of the line.
+			for (long f = 0; f < e.count; ++f, skip_line(t)) {
+				long corners, v, first = 0, last = 0;
+				if (!skip_ply_properties(t, e, column) ||
+					!parse_int(t, corners) || corners < 0) {
+
+					cerr << "Error: bad PLY face " << f
+						<< endl;
+
+					return false;
+				}
+
+				for (long k = 0; k < corners; ++k) {
+					if (!parse_int(t, v) || v < 0) {
+						cerr << "Error: bad PLY face "
+							<< f << endl;
+
+						return false;
+					}
+
+					if (k == 0)
+						first = v;
+
+					if (k >= 2) {
+						mesh.indices.push_back(first);
+						mesh.indices.push_back(last);
+						mesh.indices.push_back(v);
+					}
+
+					last = v;
+				}
+			}
+		} else {
+			for (long i = 0; i < e.count; ++i)
+				skip_line(t);
+		}
+	}
+
+	return true;
+}
+
+//
+// Move and scale the positions to fit the -1..1 box, keeping the aspect.
+//
+void fit_to_box(std::vector<GLfloat> &positions)
+{
+	if (positions.empty())
+		return;
+
+	GLfloat low[3], high[3];
+	for (int i = 0; i < 3; ++i)
+		low[i] = high[i] = positions[i];
+
+	for (size_t i = 0; i < positions.size(); ++i) {
+		low[i % 3] = std::min(low[i % 3], positions[i]);
+		high[i % 3] = std::max(high[i % 3], positions[i]);
+	}
+
+	GLfloat extent = 0.0f, center[3];
+	for (int i = 0; i < 3; ++i) {
+		center[i] = (low[i] + high[i]) * 0.5f;
+		extent = std::max(extent, (high[i] - low[i]) * 0.5f);
+	}
+
+	GLfloat scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+	for (size_t i = 0; i < positions.size(); ++i)
+		positions[i] = (positions[i] - center[i % 3]) * scale;
+}
+
+//
+// Size and modification time of a source file, false if it's missing.
+//
+bool source_stamp(const char *filename, Uint64 &size, Sint64 &mtime)
+{
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return false;
+
+	size = info.st_size;
+	mtime = info.st_mtime;
+
+	return true;
+}
+
+//
+// Location of the cache entry of a source file, keyed on its path.
+//
+std::string cache_path(const char *filename)
+{
+	Uint64 key = FNV_OFFSET;
+	for (const char *c = filename; *c != '\0'; ++c) {
+		key ^= (unsigned char)*c;
+		key *= FNV_PRIME;
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)key);
+
+	return std::string(MESH_CACHE_DIR "/") + name;
+}
+
+Uint64 align(Uint64 offset)
+{
+	return (offset + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN *
+		MESH_CACHE_ALIGN;
+}
+
+//
+// Write a section at offset, padding with zeros from where the last one
+// ended.
+//
+bool write_section(SDL_RWops *rw, Uint64 &written, Uint64 offset,
+		const void *data, size_t size)
+{
+	static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+	if (offset > written &&
+		SDL_RWwrite(rw, zeros, offset - written, 1) != 1) {
+
+		return false;
+	}
+
+	written = offset + size;
+
+	return size == 0 || SDL_RWwrite(rw, data, size, 1) == 1;
+}
+
+bool write_cache(const std::string &path, Uint64 source_size,
+		Sint64 source_mtime, const mesh_data &mesh)
+{
+	cache_header header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+	header.vertices = mesh.vertices();
+	header.count = mesh.indices.size();
+	header.positions = align(sizeof(header));
+	header.colors = align(header.positions +
+			mesh.positions.size() * sizeof(GLfloat));
+	header.indices = align(header.colors +
+			mesh.colors.size() * sizeof(GLfloat));
+
+#ifdef _WIN32
+	_mkdir(MESH_CACHE_DIR);
+#else
+	mkdir(MESH_CACHE_DIR, 0755);
+#endif
+
+	SDL_RWops *rw = SDL_RWFromFile(path.c_str(), "wb");
+	if (rw == nullptr) {
+		cerr << "Error writing " << path << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	Uint64 written = 0;
+	bool write_ok = write_section(rw, written, 0, &header,
+				sizeof(header)) &&
+		write_section(rw, written, header.positions,
+			mesh.positions.data(),
+			mesh.positions.size() * sizeof(GLfloat)) &&
+		write_section(rw, written, header.colors, mesh.colors.data(),
+			mesh.colors.size() * sizeof(GLfloat)) &&
+		write_section(rw, written, header.indices,
+			mesh.indices.data(),
+			mesh.indices.size() * sizeof(GLuint));
+
+	SDL_RWclose(rw);
+	if (!write_ok) {
+		cerr << "Error writing " << path << endl;
+		std::remove(path.c_str());
+	}
+
+	return write_ok;
+}
+
+// End of anon namespace.
+}
+
+mesh_view view_mesh(const mesh_data &mesh)
+{
+	mesh_view res = {
+		mesh.positions.data(), mesh.colors.data(), mesh.indices.data(),
+		mesh.vertices(), (GLsizei)mesh.indices.size()
+	};
+
+	return res;
+}
+
+bool import_mesh(const char *filename, mesh_data &mesh)
+{
+	mesh = mesh_data();
+	asset_file source(filename);
+	if (!source.is_open()) {
+		cerr << "Error opening " << filename << ": " << SDL_GetError()
+			<< endl;
+
+		return false;
+	}
+
+	text t = { source.data(), source.data() + source.size() };
+	size_t length = strlen(filename);
+	bool parsed;
+	if (length > 4 && strcmp(filename + length - 4, ".ply") == 0) {
+		parsed = import_ply(t, mesh);
+	} else if (length > 4 && strcmp(filename + length - 4, ".obj") == 0) {
+		parsed = import_obj(t, mesh);
+	} else {
+		cerr << "Error: " << filename << " is neither .obj nor .ply"
+			<< endl;
+
+		return false;
+	}
+
+	if (!parsed)
+		return false;
+
+	if (mesh.indices.empty()) {
+		cerr << "Error: " << filename << " has no triangles" << endl;
+		return false;
+	}
+
+	// OBJ faces may come before the vertices they use.
+	GLuint vertices = mesh.vertices();
+	for (GLuint v : mesh.indices) {
+		if (v >= vertices) {
+			cerr << "Error: " << filename << " uses vertex " << v
+				<< " of " << vertices << endl;
+
+			return false;
+		}
+	}
+
+	fit_to_box(mesh.positions);
+	optimize_mesh(mesh);
+
+	return true;
+}
+
+mesh_file::mesh_file()
+	: cached(false), ms(0.0)
+{
+	current = view_mesh(imported);
+}
+
+bool mesh_file::load(const char *filename)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	cache = asset_file();
+	imported = mesh_data();
+	current = view_mesh(imported);
+	cached = false;
+
+	Uint64 size;
+	Sint64 mtime;
+	if (!source_stamp(filename, size, mtime)) {
+		cerr << "Error: can't find " << filename << endl;
+		return false;
+	}
+
+	std::string path = cache_path(filename);
+	cached = map_cache(path, size, mtime);
+	if (!cached) {
+		if (!import_mesh(filename, imported))
+			return false;
+
+		// Use the mapping from now on, so the import can go.
+		if (write_cache(path, size, mtime, imported) &&
+			map_cache(path, size, mtime)) {
+
+			imported = mesh_data();
+		} else {
+			current = view_mesh(imported);
+		}
+	}
+
+	ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	return true;
+}
+
+//
+// Map the cache entry at path and point the view into it, if it is for
+// this version and this source, and every section fits in the file.
+//
+bool mesh_file::map_cache(const std::string &path, Uint64 size,
+		Sint64 mtime)
+{
+	cache = asset_file(path.c_str());
+	cache_header header;
+	if (!cache.is_open() || cache.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, cache.data(), sizeof(header));
+	Uint64 floats = (Uint64)header.vertices * 3 * sizeof(GLfloat);
+	bool valid = header.magic == CACHE_MAGIC &&
+		header.version == CACHE_VERSION &&
+		header.source_size == size &&
+		header.source_mtime == mtime &&
+		header.positions % MESH_CACHE_ALIGN == 0 &&
+		header.colors % MESH_CACHE_ALIGN == 0 &&
+		header.indices % MESH_CACHE_ALIGN == 0 &&
+		header.positions + floats <= cache.size() &&
+		header.colors + floats <= cache.size() &&
+		header.indices + (Uint64)header.count * sizeof(GLuint) <=
+			cache.size();
+
+	if (!valid) {
+		cache = asset_file();
+		return false;
+	}
+
+	const char *base = cache.data();
+	current.positions = (const GLfloat *)(base + header.positions);
+	current.colors = (const GLfloat *)(base + header.colors);
+	current.indices = (const GLuint *)(base + header.indices);
+	current.vertices = header.vertices;
+	current.count = header.count;
+
+	return true;
+}
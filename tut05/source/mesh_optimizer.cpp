@@ -0,0 +1,371 @@
+//
+// Source implementation file for the mesh optimizer.
+//
+
+#include "../include/mesh_optimizer.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+//
+// Totals of every mesh optimized, for the report.
+//
+struct optimizer_stats {
+	int meshes;
+	size_t triangles;
+	size_t vertices;
+	double misses_before;
+	double misses_after;
+	double ms;
+};
+
+optimizer_stats stats = { 0, 0, 0, 0.0, 0.0, 0.0 };
+std::mutex stats_mutex;
+
+//
+// Triangles around each vertex: those of vertex v are
+// triangles[offsets[v]] to triangles[offsets[v + 1]].
+//
+struct adjacency {
+	std::vector<GLuint> offsets;
+	std::vector<GLuint> triangles;
+};
+
+void build_adjacency(const std::vector<GLuint> &indices, GLuint vertices,
+		adjacency &adjacent)
+{
+	adjacent.offsets.assign(vertices + 1, 0);
+	for (GLuint v : indices)
+		++adjacent.offsets[v + 1];
+
+	for (GLuint v = 0; v < vertices; ++v)
+		adjacent.offsets[v + 1] += adjacent.offsets[v];
+
+	std::vector<GLuint> filled(adjacent.offsets.begin(),
+				adjacent.offsets.end() - 1);
+
+	adjacent.triangles.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i)
+		adjacent.triangles[filled[indices[i]]++] = i / 3;
+}
+
+//
+// Next vertex to fan around when the candidates are all dead: the most
+// recent vertex on the dead-end stack still having triangles, else the
+// next such vertex in index order. -1 once every triangle is out.
+//
+long skip_dead_end(std::vector<GLuint> &dead_end,
+		const std::vector<GLuint> &live, GLuint vertices,
+		GLuint &cursor)
+{
+	while (!dead_end.empty()) {
+		GLuint v = dead_end.back();
+		dead_end.pop_back();
+		if (live[v] > 0)
+			return v;
+	}
+
+	for (; cursor < vertices; ++cursor) {
+		if (live[cursor] > 0)
+			return cursor;
+	}
+
+	return -1;
+}
+
+//
+// Corner of a position array as a vector.
+//
+glm::vec3 position(const std::vector<GLfloat> &positions, GLuint v)
+{
+	return glm::vec3(positions[3 * v], positions[3 * v + 1],
+			positions[3 * v + 2]);
+}
+
+// End of anon namespace.
+}
+
+vertex_cache_stats measure_vertex_cache(const std::vector<GLuint> &indices,
+					GLuint vertices, int cache_size)
+{
+	vertex_cache_stats result = { 0.0, 0.0 };
+	if (indices.empty() || vertices == 0)
+		return result;
+
+	// A vertex is cached while fewer than cache_size vertices went in
+	// after it, so time stamps are all it takes for a FIFO.
+	std::vector<size_t> stamp(vertices, 0);
+	size_t now = cache_size + 1;
+	size_t misses = 0;
+	for (GLuint v : indices) {
+		if (now - stamp[v] > (size_t)cache_size) {
+			stamp[v] = now++;
+			++misses;
+		}
+	}
+
+	result.acmr = (double)misses / (indices.size() / 3);
+	result.atvr = (double)misses / vertices;
+
+	return result;
+}
+
+std::vector<size_t> optimize_vertex_cache(std::vector<GLuint> &indices,
+					GLuint vertices, int cache_size)
+{
+	std::vector<size_t> clusters;
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return clusters;
+
+	adjacency adjacent;
+	build_adjacency(indices, vertices, adjacent);
+
+	std::vector<GLuint> live(vertices);
+	for (GLuint v = 0; v < vertices; ++v)
+		live[v] = adjacent.offsets[v + 1] - adjacent.offsets[v];
+
+	std::vector<size_t> stamp(vertices, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<GLuint> dead_end;
+	std::vector<GLuint> candidates;
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+
+	size_t now = cache_size + 1;
+	GLuint cursor = 0;
+	long fan = skip_dead_end(dead_end, live, vertices, cursor);
+	clusters.push_back(0);
+	while (fan >= 0) {
+		// Every triangle left around the fanning vertex.
+		candidates.clear();
+		for (GLuint a = adjacent.offsets[fan];
+			a < adjacent.offsets[fan + 1]; ++a) {
+
+			GLuint t = adjacent.triangles[a];
+			if (emitted[t])
+				continue;
+
+			for (int k = 0; k < 3; ++k) {
+				GLuint v = indices[3 * t + k];
+				output.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (now - stamp[v] > (size_t)cache_size)
+					stamp[v] = now++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// Next, of the candidates that would still be cached after
+		// their remaining triangles went in, the one cached longest.
+		fan = -1;
+		size_t best = 0;
+		for (GLuint v : candidates) {
+			if (live[v] == 0)
+				continue;
+
+			size_t priority = 0;
+			if (now - stamp[v] + 2 * live[v] <= (size_t)cache_size)
+				priority = now - stamp[v];
+
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+
+		if (fan != -1)
+			continue;
+
+		// Jumping to a vertex out of the cache starts a new cluster.
+		fan = skip_dead_end(dead_end, live, vertices, cursor);
+		if (fan >= 0 && now - stamp[fan] > (size_t)cache_size)
+			clusters.push_back(output.size());
+	}
+
+	indices.swap(output);
+
+	return clusters;
+}
+
+void optimize_overdraw(std::vector<GLuint> &indices,
+		const std::vector<GLfloat> &positions,
+		const std::vector<size_t> &clusters)
+{
+	if (clusters.size() < 2)
+		return;
+
+	// Area weighted centroid and normal of each cluster, and of the mesh.
+	std::vector<glm::vec3> centroids(clusters.size());
+	std::vector<glm::vec3> normals(clusters.size());
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1]
+						: indices.size();
+
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t i = clusters[c]; i < end; i += 3) {
+			glm::vec3 p0 = position(positions, indices[i]);
+			glm::vec3 p1 = position(positions, indices[i + 1]);
+			glm::vec3 p2 = position(positions, indices[i + 2]);
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float weight = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (weight / 3.0f);
+			normal += cross;
+			area += weight;
+		}
+
+		mesh_centroid += centroid;
+		mesh_area += area;
+		centroids[c] = area > 0.0f ? centroid / area : centroid;
+		normals[c] = normal;
+	}
+
+	if (mesh_area > 0.0f)
+		mesh_centroid /= mesh_area;
+
+	std::vector<float> facing(clusters.size());
+	std::vector<size_t> order(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		facing[c] = glm::dot(centroids[c] - mesh_centroid, normals[c]);
+		order[c] = c;
+	}
+
+	std::stable_sort(order.begin(), order.end(),
+			[&facing](size_t a, size_t b) {
+				return facing[a] > facing[b];
+			});
+
+	std::vector<GLuint> sorted;
+	sorted.reserve(indices.size());
+	for (size_t c : order) {
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1]
+						: indices.size();
+
+		sorted.insert(sorted.end(), indices.begin() + clusters[c],
+			indices.begin() + end);
+	}
+
+	indices.swap(sorted);
+}
+
+void optimize_vertex_fetch(mesh_data &mesh)
+{
+	const GLuint unused = (GLuint)-1;
+	GLuint vertices = mesh.vertices();
+	std::vector<GLuint> remap(vertices, unused);
+	GLuint next = 0;
+	for (GLuint &v : mesh.indices) {
+		if (remap[v] == unused)
+			remap[v] = next++;
+
+		v = remap[v];
+	}
+
+	for (GLuint v = 0; v < vertices; ++v) {
+		if (remap[v] == unused)
+			remap[v] = next++;
+	}
+
+	std::vector<GLfloat> positions(mesh.positions.size());
+	std::vector<GLfloat> colors(mesh.colors.size());
+	for (GLuint v = 0; v < vertices; ++v) {
+		std::copy(&mesh.positions[3 * v], &mesh.positions[3 * v] + 3,
+			&positions[3 * remap[v]]);
+
+		if (!colors.empty()) {
+			std::copy(&mesh.colors[3 * v], &mesh.colors[3 * v] + 3,
+				&colors[3 * remap[v]]);
+		}
+	}
+
+	mesh.positions.swap(positions);
+	mesh.colors.swap(colors);
+}
+
+void optimize_mesh(mesh_data &mesh, bool overdraw)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	GLuint vertices = mesh.vertices();
+	vertex_cache_stats before = measure_vertex_cache(mesh.indices,
+							vertices);
+
+	std::vector<size_t> clusters = optimize_vertex_cache(mesh.indices,
+							vertices);
+	if (overdraw)
+		optimize_overdraw(mesh.indices, mesh.positions, clusters);
+
+	optimize_vertex_fetch(mesh);
+	vertex_cache_stats after = measure_vertex_cache(mesh.indices,
+							vertices);
+
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	++stats.meshes;
+	stats.triangles += mesh.triangles();
+	stats.vertices += vertices;
+	stats.misses_before += before.acmr * mesh.triangles();
+	stats.misses_after += after.acmr * mesh.triangles();
+	stats.ms += ms;
+}
+
+void optimize_meshes(std::vector<mesh_data> &meshes, bool overdraw,
+		int threads)
+{
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	threads = std::min<size_t>(threads, meshes.size());
+
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t i = next++; i < meshes.size(); i = next++)
+			optimize_mesh(meshes[i], overdraw);
+	};
+
+	// This thread takes meshes too.
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; ++i)
+		workers.emplace_back(work);
+
+	work();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+void print_mesh_optimizer_report()
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	if (stats.triangles == 0 || stats.vertices == 0)
+		return;
+
+	cout << "Mesh optimizer: " << stats.meshes << " mesh(es), "
+		<< stats.triangles << " triangles, ACMR "
+		<< stats.misses_before / stats.triangles << " -> "
+		<< stats.misses_after / stats.triangles << ", ATVR "
+		<< stats.misses_before / stats.vertices << " -> "
+		<< stats.misses_after / stats.vertices << ", "
+		<< stats.ms << " ms" << endl;
+}
@@ -0,0 +1,663 @@
+//
+// Source implementation file for software occlusion culling.
+//
+
+#include "../include/occlusion_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE__)
+#define OCCLUSION_SSE
+#include <xmmintrin.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+// Rows of the depth buffer a worker rasterizes at a time.
+const int BAND_ROWS = 8;
+// Corners with a w this small or less are taken as behind the eye.
+const float MIN_W = 1e-5f;
+// Occluders must project within this many viewports of the screen, so
+// that the edge functions stay precise.
+const float GUARD_BAND = 1.0f;
+const GLuint FNV_OFFSET = 2166136261u, FNV_PRIME = 16777619u;
+
+#ifdef OCCLUSION_SSE
+
+float horizontal_min(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+float horizontal_max(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+//
+// Screen bounds of a box seen through mvp, in pixels of the depth buffer:
+// min x, min y, max x, max y, and its nearest depth. Returns false when a
+// corner isn't in front of the eye. Corner k is the center plus or minus
+// each extent, minus for axis a when bit a of k is set; the eight of them
+// are projected four at a time.
+//
+bool project_box(const glm::mat4 &mvp, const glm::vec3 &center,
+		const glm::vec3 &extent, float bounds[4], float &nearest)
+{
+	glm::vec4 base = mvp * glm::vec4(center, 1.0f);
+	glm::vec4 axis[3] = {
+		mvp[0] * extent.x, mvp[1] * extent.y, mvp[2] * extent.z
+	};
+
+	// Corners 0 to 3 in low, 4 to 7 in high, x, y, z and w apart.
+	const __m128 sign_x = _mm_set_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+	const __m128 sign_y = _mm_set_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+	__m128 low[4], high[4];
+	for (int c = 0; c < 4; ++c) {
+		__m128 v = _mm_add_ps(_mm_set1_ps(base[c]),
+				_mm_mul_ps(sign_x, _mm_set1_ps(axis[0][c])));
+		v = _mm_add_ps(v, _mm_mul_ps(sign_y, _mm_set1_ps(axis[1][c])));
+		low[c] = _mm_add_ps(v, _mm_set1_ps(axis[2][c]));
+		high[c] = _mm_sub_ps(v, _mm_set1_ps(axis[2][c]));
+	}
+
+	// NaN fails too.
+	const __m128 min_w = _mm_set1_ps(MIN_W);
+	if ((_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(low[3], min_w),
+				_mm_cmpgt_ps(high[3], min_w)))) != 0xf)
+		return false;
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 scale[3] = {
+		_mm_set1_ps(0.5f * OCCLUSION_WIDTH),
+		_mm_set1_ps(0.5f * OCCLUSION_HEIGHT),
+		half
+	};
+
+	__m128 low_w = _mm_div_ps(one, low[3]);
+	__m128 high_w = _mm_div_ps(one, high[3]);
+	for (int c = 0; c < 3; ++c) {
+		__m128 a = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(low[c], low_w),
+						scale[c]), scale[c]);
+		__m128 b = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(high[c], high_w),
+						scale[c]), scale[c]);
+
+		float least = horizontal_min(_mm_min_ps(a, b));
+		if (c == 2) {
+			nearest = least;
+		} else {
+			bounds[c] = least;
+			bounds[c + 2] = horizontal_max(_mm_max_ps(a, b));
+		}
+	}
+
+	return true;
+}
+
+#else
+
+bool project_box(const glm::mat4 &mvp, const glm::vec3 &center,
+		const glm::vec3 &extent, float bounds[4], float &nearest)
+{
+	glm::vec4 base = mvp * glm::vec4(center, 1.0f);
+	glm::vec4 axis[3] = {
+		mvp[0] * extent.x, mvp[1] * extent.y, mvp[2] * extent.z
+	};
+
+	const float scale[3] = {
+		0.5f * OCCLUSION_WIDTH, 0.5f * OCCLUSION_HEIGHT, 0.5f
+	};
+
+	for (int k = 0; k < 8; ++k) {
+		glm::vec4 corner;
+		for (int c = 0; c < 4; ++c) {
+			float v = base[c] + (k & 1 ? -1.0f : 1.0f) * axis[0][c];
+			v += (k & 2 ? -1.0f : 1.0f) * axis[1][c];
+			corner[c] = k & 4 ? v - axis[2][c] : v + axis[2][c];
+		}
+
+		// NaN fails too.
+		if (!(corner.w > MIN_W))
+			return false;
+
+		float inverse_w = 1.0f / corner.w;
+		float screen[3];
+		for (int c = 0; c < 3; ++c)
+			screen[c] = corner[c] * inverse_w * scale[c] + scale[c];
+
+		for (int c = 0; c < 2; ++c) {
+			bounds[c] = k == 0 ? screen[c] :
+				std::min(bounds[c], screen[c]);
+			bounds[c + 2] = k == 0 ? screen[c] :
+				std::max(bounds[c + 2], screen[c]);
+		}
+
+		nearest = k == 0 ? screen[2] : std::min(nearest, screen[2]);
+	}
+
+	return true;
+}
+
+#endif // OCCLUSION_SSE
+
+//
+// First of the count items that worker of workers takes, the items up to
+// the next worker's first being its share.
+//
+size_t range_start(size_t count, int worker, int workers)
+{
+	return count * worker / workers;
+}
+
+// End of anon namespace.
+}
+
+occlusion_culler::occlusion_culler()
+	: next_band(0), frames(0), tested_total(0), hidden_total(0),
+	occluders_total(0), checksum(FNV_OFFSET), pass_ms(0.0), wait_ms(0.0),
+	frame_pending(false), stopping(false)
+{
+	// Every level halves the one below, down to a single texel.
+	int width = OCCLUSION_WIDTH, height = OCCLUSION_HEIGHT;
+	size_t total = 0;
+	for (;;) {
+		level_start.push_back(total);
+		level_width.push_back(width);
+		level_height.push_back(height);
+		total += width * height;
+		if (width == 1 && height == 1)
+			break;
+
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	pyramid.assign(total, 1.0f);
+}
+
+occlusion_culler::~occlusion_culler()
+{
+	stop();
+}
+
+void occlusion_culler::start(int threads)
+{
+	stop();
+	pool.start(threads);
+	driver = std::thread(&occlusion_culler::drive, this);
+}
+
+void occlusion_culler::set_scene(
+		const std::vector<occluder_mesh> &new_meshes,
+		const std::vector<occlusion_object> &new_objects)
+{
+	meshes = new_meshes;
+	objects = new_objects;
+	rects.assign(4 * objects.size(), 0);
+	nearest.assign(objects.size(), 0.0f);
+	coverage.assign(objects.size(), 0.0f);
+	hidden.assign(objects.size(), 0);
+}
+
+void occlusion_culler::begin(const glm::mat4 &new_mvp)
+{
+	if (!driver.joinable()) {
+		mvp = new_mvp;
+		frame();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		mvp = new_mvp;
+		frame_pending = true;
+	}
+
+	frame_asked.notify_one();
+}
+
+void occlusion_culler::end()
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		frame_done.wait(lock, [this] { return !frame_pending; });
+	}
+
+	wait_ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+void occlusion_culler::print_report() const
+{
+	if (frames == 0)
+		return;
+
+	cout << "Occlusion: " << objects.size() << " objects, "
+		<< (double)tested_total / frames << " tested and "
+		<< (double)hidden_total / frames
+		<< " occluded a frame on average behind "
+		<< (double)occluders_total / frames << " occluders, checksum "
+		<< std::hex << checksum << std::dec << endl;
+
+	cout << "Occlusion pass: " << pass_ms / frames << " ms a frame on "
+		<< threads() << " thread(s)"
+#ifdef OCCLUSION_SSE
+		<< ", SSE"
+#endif
+		<< ", " << wait_ms / frames << " ms of it waited for" << endl;
+}
+
+void occlusion_culler::stop()
+{
+	// The frame under way finishes first, so no helper is left out of
+	// a pass.
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		frame_done.wait(lock, [this] { return !frame_pending; });
+		stopping = true;
+	}
+
+	frame_asked.notify_all();
+	if (driver.joinable())
+		driver.join();
+
+	pool.stop();
+	stopping = false;
+}
+
+//
+// Project, pick the occluders and rasterize them, build the pyramid and
+// test, then count what was occluded.
+//
+void occlusion_culler::frame()
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	pool.run([this](int worker) { project_pass(worker); });
+	pick_occluders();
+	next_band = 0;
+	pool.run([this](int worker) { raster_pass(worker); });
+	build_pyramid();
+	pool.run([this](int worker) { test_pass(worker); });
+
+	for (size_t i = 0; i < objects.size(); ++i) {
+		if (rects[4 * i + 2] >= rects[4 * i])
+			++tested_total;
+
+		hidden_total += hidden[i];
+		checksum = (checksum ^ hidden[i]) * FNV_PRIME;
+	}
+
+	occluders_total += occluders.size();
+	++frames;
+
+	pass_ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// Screen rectangle, nearest depth and occluder score of a share of the
+// objects.
+//
+void occlusion_culler::project_pass(int worker)
+{
+	size_t first = range_start(objects.size(), worker, threads());
+	size_t last = range_start(objects.size(), worker + 1, threads());
+	for (size_t i = first; i < last; ++i) {
+		const occlusion_object &object = objects[i];
+		int *rect = &rects[4 * i];
+		float bounds[4];
+		rect[0] = rect[1] = 0;
+		rect[2] = rect[3] = -1;
+		coverage[i] = 0.0f;
+		if (!project_box(mvp, object.center, object.extent, bounds,
+				nearest[i]))
+			continue;
+
+		if (bounds[2] < 0.0f || bounds[0] >= OCCLUSION_WIDTH ||
+			bounds[3] < 0.0f || bounds[1] >= OCCLUSION_HEIGHT)
+			continue;
+
+		rect[0] = (int)std::max(bounds[0], 0.0f);
+		rect[1] = (int)std::max(bounds[1], 0.0f);
+		rect[2] = (int)std::min(bounds[2], OCCLUSION_WIDTH - 1.0f);
+		rect[3] = (int)std::min(bounds[3], OCCLUSION_HEIGHT - 1.0f);
+
+		// Occluders clipped by the near plane on GL would hide more
+		// here than they do there.
+		const occluder_mesh &mesh = meshes[object.mesh];
+		if (mesh.count / 3 > OCCLUDER_MAX_TRIANGLES ||
+			nearest[i] < 0.0f ||
+			bounds[0] < -GUARD_BAND * OCCLUSION_WIDTH ||
+			bounds[1] < -GUARD_BAND * OCCLUSION_HEIGHT ||
+			bounds[2] > (1.0f + GUARD_BAND) * OCCLUSION_WIDTH ||
+			bounds[3] > (1.0f + GUARD_BAND) * OCCLUSION_HEIGHT)
+			continue;
+
+		coverage[i] = (float)(rect[2] - rect[0] + 1) *
+			(rect[3] - rect[1] + 1);
+	}
+}
+
+//
+// Keep the OCCLUDERS objects covering the most, ties going to the lower
+// number, and set up their triangles in that order.
+//
+void occlusion_culler::pick_occluders()
+{
+	occluders.clear();
+	for (GLuint i = 0; i < objects.size(); ++i) {
+		if (coverage[i] > 0.0f)
+			occluders.push_back(i);
+	}
+
+	if (occluders.size() > (size_t)OCCLUDERS) {
+		std::nth_element(occluders.begin(),
+				occluders.begin() + OCCLUDERS - 1,
+				occluders.end(), [this](GLuint a, GLuint b) {
+			return coverage[a] > coverage[b] ||
+				(coverage[a] == coverage[b] && a < b);
+		});
+
+		occluders.resize(OCCLUDERS);
+		std::sort(occluders.begin(), occluders.end());
+	}
+
+	triangles.clear();
+	for (GLuint i : occluders)
+		setup_occluder(i);
+}
+
+//
+// Edge functions and depth planes of an occluder's triangles, in double
+// and then rounded, over the pixels of the depth buffer they cover.
+//
+void occlusion_culler::setup_occluder(GLuint object)
+{
+	const occluder_mesh &mesh = meshes[objects[object].mesh];
+	glm::mat4 transform = mvp * objects[object].model;
+	for (GLsizei t = 0; t + 2 < mesh.count; t += 3) {
+		double x[3], y[3], z[3];
+		bool behind = false;
+		for (int v = 0; v < 3; ++v) {
+			const GLfloat *p = mesh.positions +
+				3 * mesh.indices[t + v];
+			glm::vec4 clip = transform * glm::vec4(p[0], p[1], p[2],
+								1.0f);
+			if (!(clip.w > MIN_W)) {
+				behind = true;
+				break;
+			}
+
+			x[v] = (clip.x / (double)clip.w * 0.5 + 0.5) *
+				OCCLUSION_WIDTH;
+			y[v] = (clip.y / (double)clip.w * 0.5 + 0.5) *
+				OCCLUSION_HEIGHT;
+			z[v] = clip.z / (double)clip.w * 0.5 + 0.5;
+		}
+
+		double area = (x[1] - x[0]) * (y[2] - y[0]) -
+			(x[2] - x[0]) * (y[1] - y[0]);
+		if (behind || !(area != 0.0 && std::isfinite(area)))
+			continue;
+
+		occluder_triangle triangle;
+		triangle.min_x = std::max(0, (int)std::ceil(
+				std::min(x[0], std::min(x[1], x[2])) - 0.5));
+		triangle.min_y = std::max(0, (int)std::ceil(
+				std::min(y[0], std::min(y[1], y[2])) - 0.5));
+		triangle.max_x = std::min(OCCLUSION_WIDTH - 1, (int)std::floor(
+				std::max(x[0], std::max(x[1], x[2])) - 0.5));
+		triangle.max_y = std::min(OCCLUSION_HEIGHT - 1, (int)std::floor(
+				std::max(y[0], std::max(y[1], y[2])) - 0.5));
+		if (triangle.min_x > triangle.max_x ||
+			triangle.min_y > triangle.max_y)
+			continue;
+
+		// Inside on the positive side of every edge, whichever way
+		// the triangle winds.
+		double side = area > 0.0 ? 1.0 : -1.0;
+		for (int i = 0; i < 3; ++i) {
+			int j = (i + 1) % 3;
+			triangle.edge[i][0] = side * (y[i] - y[j]);
+			triangle.edge[i][1] = side * (x[j] - x[i]);
+			triangle.edge[i][2] = side *
+				(x[i] * y[j] - y[i] * x[j]);
+		}
+
+		double a = ((z[1] - z[0]) * (y[2] - y[0]) -
+			(z[2] - z[0]) * (y[1] - y[0])) / area;
+		double b = ((x[1] - x[0]) * (z[2] - z[0]) -
+			(x[2] - x[0]) * (z[1] - z[0])) / area;
+		triangle.depth[0] = a;
+		triangle.depth[1] = b;
+		triangle.depth[2] = z[0] - a * x[0] - b * y[0];
+		triangle.nearest = std::min(z[0], std::min(z[1], z[2]));
+		triangles.push_back(triangle);
+	}
+}
+
+//
+// Clear and rasterize bands of rows until there are none left. A band is
+// only ever one worker's, and a pixel only depends on the triangles, so
+// whoever takes it gets the same depths.
+//
+void occlusion_culler::raster_pass(int)
+{
+	const int bands = (OCCLUSION_HEIGHT + BAND_ROWS - 1) / BAND_ROWS;
+	for (int band = next_band++; band < bands; band = next_band++) {
+		int y0 = band * BAND_ROWS;
+		int y1 = std::min(OCCLUSION_HEIGHT, y0 + BAND_ROWS) - 1;
+		std::fill(pyramid.begin() + y0 * OCCLUSION_WIDTH,
+			pyramid.begin() + (y1 + 1) * OCCLUSION_WIDTH, 1.0f);
+
+		for (const occluder_triangle &triangle : triangles) {
+			if (triangle.max_y < y0 || triangle.min_y > y1)
+				continue;
+
+			raster_triangle(triangle, std::max(y0, triangle.min_y),
+					std::min(y1, triangle.max_y));
+		}
+	}
+}
+
+#ifdef OCCLUSION_SSE
+
+//
+// Keep the nearer of the triangle's depth and the buffer's on rows y0 to
+// y1, four pixels at a time. Groups start on multiples of four, which the
+// width is one of.
+//
+void occlusion_culler::raster_triangle(const occluder_triangle &triangle,
+				int y0, int y1)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 centers = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 first = _mm_set1_ps(triangle.min_x + 0.5f);
+	const __m128 last = _mm_set1_ps(triangle.max_x + 0.5f);
+	const __m128 depth_a = _mm_set1_ps(triangle.depth[0]);
+	const __m128 nearest_depth = _mm_set1_ps(triangle.nearest);
+	__m128 edge_a[3];
+	for (int i = 0; i < 3; ++i)
+		edge_a[i] = _mm_set1_ps(triangle.edge[i][0]);
+
+	for (int y = y0; y <= y1; ++y) {
+		float center_y = y + 0.5f;
+		__m128 edge_row[3];
+		for (int i = 0; i < 3; ++i) {
+			edge_row[i] = _mm_set1_ps(triangle.edge[i][1] *
+						center_y + triangle.edge[i][2]);
+		}
+
+		__m128 depth_row = _mm_set1_ps(triangle.depth[1] * center_y +
+					triangle.depth[2]);
+
+		float *row = &pyramid[y * OCCLUSION_WIDTH];
+		for (int x = triangle.min_x & ~3; x <= triangle.max_x; x += 4) {
+			__m128 xs = _mm_add_ps(_mm_set1_ps((float)x), centers);
+			__m128 mask = _mm_and_ps(_mm_cmpge_ps(xs, first),
+						_mm_cmple_ps(xs, last));
+			for (int i = 0; i < 3; ++i) {
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(
+						_mm_mul_ps(edge_a[i], xs),
+						edge_row[i]), zero));
+			}
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			__m128 z = _mm_max_ps(_mm_add_ps(
+					_mm_mul_ps(depth_a, xs), depth_row),
+					nearest_depth);
+			__m128 old = _mm_loadu_ps(row + x);
+			_mm_storeu_ps(row + x, _mm_or_ps(
+					_mm_and_ps(mask, _mm_min_ps(z, old)),
+					_mm_andnot_ps(mask, old)));
+		}
+	}
+}
+
+#else
+
+void occlusion_culler::raster_triangle(const occluder_triangle &triangle,
+				int y0, int y1)
+{
+	for (int y = y0; y <= y1; ++y) {
+		float center_y = y + 0.5f;
+		float edge_row[3];
+		for (int i = 0; i < 3; ++i) {
+			edge_row[i] = triangle.edge[i][1] * center_y +
+				triangle.edge[i][2];
+		}
+
+		float depth_row = triangle.depth[1] * center_y +
+			triangle.depth[2];
+
+		float *row = &pyramid[y * OCCLUSION_WIDTH];
+		for (int x = triangle.min_x; x <= triangle.max_x; ++x) {
+			float center_x = x + 0.5f;
+			bool inside = true;
+			for (int i = 0; i < 3; ++i) {
+				inside = inside && triangle.edge[i][0] *
+					center_x + edge_row[i] >= 0.0f;
+			}
+
+			if (inside) {
+				float z = std::max(triangle.depth[0] *
+					center_x + depth_row, triangle.nearest);
+				row[x] = std::min(row[x], z);
+			}
+		}
+	}
+}
+
+#endif // OCCLUSION_SSE
+
+//
+// Every level above the depth buffer keeps the farthest of the 2x2 texels
+// below it.
+//
+void occlusion_culler::build_pyramid()
+{
+	for (size_t level = 1; level < level_start.size(); ++level) {
+		const float *below = &pyramid[level_start[level - 1]];
+		float *texel = &pyramid[level_start[level]];
+		int below_width = level_width[level - 1];
+		int below_height = level_height[level - 1];
+		for (int y = 0; y < level_height[level]; ++y) {
+			int y0 = std::min(2 * y, below_height - 1);
+			int y1 = std::min(2 * y + 1, below_height - 1);
+			for (int x = 0; x < level_width[level]; ++x) {
+				int x0 = std::min(2 * x, below_width - 1);
+				int x1 = std::min(2 * x + 1, below_width - 1);
+				*texel++ = std::max(
+					std::max(below[y0 * below_width + x0],
+						below[y0 * below_width + x1]),
+					std::max(below[y1 * below_width + x0],
+						below[y1 * below_width + x1]));
+			}
+		}
+	}
+}
+
+void occlusion_culler::test_pass(int worker)
+{
+	size_t first = range_start(objects.size(), worker, threads());
+	size_t last = range_start(objects.size(), worker + 1, threads());
+	for (size_t i = first; i < last; ++i)
+		hidden[i] = test_object(i);
+}
+
+//
+// Whether the nearest depth of an object is behind the farthest depth of
+// the 2x2 texels at most that its rectangle covers on some level.
+//
+bool occlusion_culler::test_object(GLuint object) const
+{
+	const int *rect = &rects[4 * object];
+	if (rect[2] < rect[0])
+		return false;
+
+	size_t level = 0;
+	while (level + 1 < level_start.size() &&
+		((rect[2] >> level) - (rect[0] >> level) > 1 ||
+		(rect[3] >> level) - (rect[1] >> level) > 1))
+		++level;
+
+	const float *texels = &pyramid[level_start[level]];
+	int width = level_width[level], height = level_height[level];
+	float farthest = 0.0f;
+	for (int y = rect[1] >> level; y <= (rect[3] >> level); ++y) {
+		for (int x = rect[0] >> level; x <= (rect[2] >> level); ++x) {
+			farthest = std::max(farthest, texels[
+					std::min(y, height - 1) * width +
+					std::min(x, width - 1)]);
+		}
+	}
+
+	return nearest[object] > farthest;
+}
+
+//
+// Driver thread: run each frame begin() asks for, until stopped.
+//
+void occlusion_culler::drive()
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frame_asked.wait(lock, [this] {
+				return stopping || frame_pending;
+			});
+
+			if (stopping)
+				return;
+		}
+
+		frame();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frame_pending = false;
+		}
+
+		frame_done.notify_all();
+	}
+}
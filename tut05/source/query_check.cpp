@@ -0,0 +1,51 @@
+//
+// Source implementation file for the frame loop query checker.
+//
+
+#include "../include/query_check.h"
+
+#include <iostream>
+#include <set>
+#include <string>
+
+using std::cerr;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+bool in_frame = false;
+unsigned long queries = 0;
+// Call sites already reported, as "file:line".
+std::set<std::string> reported;
+
+// End of anon namespace.
+}
+
+void query_check_begin_frame()
+{
+	in_frame = true;
+}
+
+void query_check_end_frame()
+{
+	in_frame = false;
+}
+
+void query_check_report(const char *name, const char *file, int line)
+{
+	if (!in_frame)
+		return;
+
+	++queries;
+	std::string site = std::string(file) + ":" + std::to_string(line);
+	if (reported.insert(site).second) {
+		cerr << "Warning: " << name << " called inside the frame loop at "
+			<< site << endl;
+	}
+}
+
+unsigned long query_check_count()
+{
+	return queries;
+}
@@ -0,0 +1,205 @@
+//
+// Source implementation file for GLSL program reflection.
+//
+
+#include "../include/shader_program.h"
+#include "../include/query_check.h"
+
+#include <cstring>
+#include <iostream>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+uniform_upload_stats stats = { 0, 0 };
+
+//
+// Bytes taken by one element of a GLSL uniform type, 0 if unsupported.
+//
+size_t type_size(GLenum type)
+{
+	switch (type) {
+	case GL_FLOAT:
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+		return 4;
+	case GL_FLOAT_VEC2:
+	case GL_INT_VEC2:
+		return 8;
+	case GL_FLOAT_VEC3:
+	case GL_INT_VEC3:
+		return 12;
+	case GL_FLOAT_VEC4:
+	case GL_INT_VEC4:
+	case GL_FLOAT_MAT2:
+		return 16;
+	case GL_FLOAT_MAT3:
+		return 36;
+	case GL_FLOAT_MAT4:
+		return 64;
+	default:
+		return 0;
+	}
+}
+
+//
+// Uniform arrays are reported as "name[0]", look them up as "name".
+//
+std::string base_name(const char *name)
+{
+	std::string res = name;
+	size_t bracket = res.find('[');
+	if (bracket != std::string::npos)
+		res.erase(bracket);
+
+	return res;
+}
+
+// End of anon namespace.
+}
+
+void shader_program::reflect(GLuint program)
+{
+	id = program;
+	attributes.clear();
+	uniforms.clear();
+
+	GLint count = 0, max_length = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+	std::vector<char> name(max_length + 1);
+	for (GLint i = 0; i < count; ++i) {
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(program, i, name.size(), nullptr,
+				&size, &type, name.data());
+
+		attribute_info a;
+		a.name = name.data();
+		a.location = glGetAttribLocation(program, name.data());
+		attributes.push_back(a);
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	name.resize(max_length + 1);
+	for (GLint i = 0; i < count; ++i) {
+		uniform_info u;
+		glGetActiveUniform(program, i, name.size(), nullptr,
+				&u.count, &u.type, name.data());
+
+		u.name = base_name(name.data());
+		u.location = glGetUniformLocation(program, name.data());
+		u.initialized = false;
+		u.shadow.resize(type_size(u.type) * u.count);
+		uniforms.push_back(u);
+	}
+}
+
+GLint shader_program::attribute(const char *name) const
+{
+	for (const attribute_info &a : attributes) {
+		if (a.name == name)
+			return a.location;
+	}
+
+	return -1;
+}
+
+int shader_program::find_uniform(const char *name, size_t size) const
+{
+	for (size_t i = 0; i < uniforms.size(); ++i) {
+		const uniform_info &u = uniforms[i];
+		if (u.name != name)
+			continue;
+
+		if (u.shadow.empty() || u.shadow.size() != size) {
+			cerr << "Uniform " << name << " doesn't match a "
+				<< size << " byte value" << endl;
+
+			return -1;
+		}
+
+		return i;
+	}
+
+	return -1;
+}
+
+void shader_program::set_uniform(int index, const void *value, size_t size)
+{
+	uniform_info &u = uniforms[index];
+	if (u.initialized && memcmp(u.shadow.data(), value, size) == 0) {
+		++stats.skipped;
+		return;
+	}
+
+	memcpy(u.shadow.data(), value, size);
+	u.initialized = true;
+	upload(u);
+	++stats.issued;
+}
+
+//
+// Push the shadow copy of a uniform to the program in use.
+//
+void shader_program::upload(const uniform_info &u)
+{
+	const GLfloat *f = reinterpret_cast<const GLfloat *>(u.shadow.data());
+	const GLint *i = reinterpret_cast<const GLint *>(u.shadow.data());
+	switch (u.type) {
+	case GL_FLOAT:
+		glUniform1fv(u.location, u.count, f);
+		break;
+	case GL_FLOAT_VEC2:
+		glUniform2fv(u.location, u.count, f);
+		break;
+	case GL_FLOAT_VEC3:
+		glUniform3fv(u.location, u.count, f);
+		break;
+	case GL_FLOAT_VEC4:
+		glUniform4fv(u.location, u.count, f);
+		break;
+	case GL_FLOAT_MAT2:
+		glUniformMatrix2fv(u.location, u.count, GL_FALSE, f);
+		break;
+	case GL_FLOAT_MAT3:
+		glUniformMatrix3fv(u.location, u.count, GL_FALSE, f);
+		break;
+	case GL_FLOAT_MAT4:
+		glUniformMatrix4fv(u.location, u.count, GL_FALSE, f);
+		break;
+	case GL_INT_VEC2:
+		glUniform2iv(u.location, u.count, i);
+		break;
+	case GL_INT_VEC3:
+		glUniform3iv(u.location, u.count, i);
+		break;
+	case GL_INT_VEC4:
+		glUniform4iv(u.location, u.count, i);
+		break;
+	default:
+		// int, bool and samplers.
+		glUniform1iv(u.location, u.count, i);
+		break;
+	}
+}
+
+const uniform_upload_stats &get_uniform_upload_stats()
+{
+	return stats;
+}
+
+void print_uniform_upload_report()
+{
+	cout << "Uniform uploads: " << stats.issued << " issued, "
+		<< stats.skipped << " skipped" << endl;
+}
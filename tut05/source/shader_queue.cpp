@@ -0,0 +1,259 @@
+//
+// Source implementation file for the asynchronous GLSL program build queue.
+//
+
+#include "../include/shader_queue.h"
+#include "../include/program_cache.h"
+#include "../include/query_check.h"
+#include "../include/shader_utils.h"
+
+#include "SDL.h"
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Let the driver pick its own number of compiler threads.
+const GLuint ALL_COMPILER_THREADS = 0xffffffff;
+
+//
+// Hand a stage to the driver without asking for its status,
+// since that would wait for the compile to finish.
+//
+GLuint submit_shader(asset_view source, GLenum type)
+{
+	GLint length = source.size;
+	GLuint res = glCreateShader(type);
+	glShaderSource(res, 1, &source.data, &length);
+	glCompileShader(res);
+
+	return res;
+}
+
+//
+// Check the compile status of a submitted stage, printing its log on error.
+//
+bool shader_compiled(GLuint shader, const std::string &filename)
+{
+	GLint compile_ok = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_ok);
+	if (compile_ok == GL_FALSE) {
+		cerr << filename << ":";
+		print_log(shader);
+		return false;
+	}
+
+	return true;
+}
+
+double elapsed_ms(Uint64 start)
+{
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 /
+		SDL_GetPerformanceFrequency();
+}
+
+// End of anon namespace.
+}
+
+//
+// No GL calls here, so a queue can live in a global made before the
+// context. Driver capabilities are queried on the first submit().
+//
+shader_queue::shader_queue()
+	: initialized(false), parallel(false), use_cache(false)
+{
+}
+
+//
+// Anything never fetched with program() still belongs to the queue.
+//
+shader_queue::~shader_queue()
+{
+	for (entry &e : entries) {
+		if (e.resolved)
+			continue;
+
+		glDeleteShader(e.vs);
+		glDeleteShader(e.fs);
+		glDeleteProgram(e.program);
+	}
+}
+
+int shader_queue::add_program(const char *vs_filename,
+				const char *fs_filename,
+				const std::vector<std::string> &defines)
+{
+	entry e;
+	e.vs_filename = vs_filename;
+	e.fs_filename = fs_filename;
+	e.defines = defines;
+	e.vs = 0;
+	e.fs = 0;
+	e.program = 0;
+	e.key = 0;
+	e.submitted = false;
+	e.from_cache = false;
+	e.resolved = false;
+	entries.push_back(e);
+
+	return entries.size() - 1;
+}
+
+//
+// Preprocess both sources and either restore the cached program or
+// start compiling the stages. The cache is keyed on the preprocessed
+// text, so every permutation gets its own entry.
+//
+void shader_queue::submit_stages(entry &e)
+{
+	std::string vs_text, fs_text;
+	if (!preprocess_shader(e.vs_filename.c_str(), e.defines, vs_text) ||
+		!preprocess_shader(e.fs_filename.c_str(), e.defines, fs_text)) {
+
+		return;
+	}
+
+	asset_view vs_source = { vs_text.data(), vs_text.size() };
+	asset_view fs_source = { fs_text.data(), fs_text.size() };
+	if (use_cache) {
+		e.key = program_cache_key(vs_source, fs_source);
+		e.program = load_program_binary(e.key);
+		e.from_cache = e.program != 0;
+	}
+
+	if (!e.from_cache) {
+		e.vs = submit_shader(vs_source, GL_VERTEX_SHADER);
+		e.fs = submit_shader(fs_source, GL_FRAGMENT_SHADER);
+	}
+}
+
+void shader_queue::submit()
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	if (!initialized) {
+		use_cache = program_binary_supported();
+		if (GLEW_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(ALL_COMPILER_THREADS);
+			parallel = true;
+		} else if (GLEW_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(ALL_COMPILER_THREADS);
+			parallel = true;
+		}
+
+		initialized = true;
+	}
+
+	// Start every compile before the first link so they overlap.
+	for (entry &e : entries) {
+		if (!e.submitted)
+			submit_stages(e);
+	}
+
+	for (entry &e : entries) {
+		if (e.submitted)
+			continue;
+
+		e.submitted = true;
+		if (e.from_cache || e.vs == 0 || e.fs == 0)
+			continue;
+
+		e.program = glCreateProgram();
+		if (use_cache) {
+			glProgramParameteri(e.program,
+					GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+					GL_TRUE);
+		}
+
+		glAttachShader(e.program, e.vs);
+		glAttachShader(e.program, e.fs);
+		glLinkProgram(e.program);
+	}
+
+	get_program_cache_stats().ms += elapsed_ms(start);
+}
+
+bool shader_queue::ready(int ticket) const
+{
+	const entry &e = entries[ticket];
+	if (!e.submitted)
+		return false;
+
+	if (e.resolved || e.from_cache || e.program == 0 || !parallel)
+		return true;
+
+	GLint done = GL_FALSE;
+	glGetProgramiv(e.program, GL_COMPLETION_STATUS_KHR, &done);
+
+	return done == GL_TRUE;
+}
+
+//
+// First use of a program: this is where the driver is waited on and
+// where compile and link errors get reported.
+//
+void shader_queue::resolve(entry &e)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	program_cache_stats &stats = get_program_cache_stats();
+
+	if (e.from_cache) {
+		++stats.hits;
+	} else if (e.program != 0) {
+		bool vs_ok = shader_compiled(e.vs, e.vs_filename);
+		bool fs_ok = shader_compiled(e.fs, e.fs_filename);
+		GLint link_ok = GL_FALSE;
+		glGetProgramiv(e.program, GL_LINK_STATUS, &link_ok);
+		if (vs_ok && fs_ok && link_ok == GL_FALSE) {
+			cerr << "glLinkProgram: ";
+			print_log(e.program);
+		}
+
+		// The program keeps what it needs, the stages can go.
+		glDetachShader(e.program, e.vs);
+		glDetachShader(e.program, e.fs);
+
+		if (vs_ok && fs_ok && link_ok == GL_TRUE) {
+			++stats.misses;
+			if (use_cache)
+				store_program_binary(e.program, e.key);
+		} else {
+			glDeleteProgram(e.program);
+			e.program = 0;
+		}
+	}
+
+	glDeleteShader(e.vs);
+	glDeleteShader(e.fs);
+	e.vs = 0;
+	e.fs = 0;
+	e.resolved = true;
+
+	stats.ms += elapsed_ms(start);
+}
+
+GLuint shader_queue::program(int ticket)
+{
+	entry &e = entries[ticket];
+	if (!e.submitted)
+		submit();
+
+	if (!e.resolved)
+		resolve(e);
+
+	return e.program;
+}
+
+//
+// Build a single program right away through a one-entry queue.
+//
+GLuint create_program(const char *vs_filename, const char *fs_filename)
+{
+	shader_queue queue;
+	int ticket = queue.add_program(vs_filename, fs_filename);
+	queue.submit();
+
+	return queue.program(ticket);
+}
@@ -0,0 +1,333 @@
+//
+// Source implementation file for GLSL hot reload.
+//
+
+#include "../include/shader_watcher.h"
+#include "../include/query_check.h"
+#include "../include/shader_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+shader_watcher::shader_watcher()
+	: event_type(0), inotify_fd(-1)
+{
+	wake_pipe[0] = -1;
+	wake_pipe[1] = -1;
+}
+
+shader_watcher::~shader_watcher()
+{
+	// Too late to touch GL here, only the thread is cleaned up.
+	stages.clear();
+	stop();
+}
+
+bool shader_watcher::start(const char *dir)
+{
+#ifdef __linux__
+	directory = dir;
+	event_type = SDL_RegisterEvents(1);
+	if (event_type == (Uint32)-1) {
+		cerr << "Error: SDL_RegisterEvents: " << SDL_GetError() << endl;
+		event_type = 0;
+		return false;
+	}
+
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (inotify_fd == -1 ||
+		inotify_add_watch(inotify_fd, dir,
+				IN_CLOSE_WRITE | IN_MOVED_TO) == -1 ||
+		pipe(wake_pipe) == -1) {
+
+		cerr << "Error watching " << dir << ": " << strerror(errno)
+			<< endl;
+
+		stop();
+		return false;
+	}
+
+	thread = std::thread(&shader_watcher::watch, this);
+
+	return true;
+#else
+	cerr << "Shader hot reload needs inotify, not watching " << dir << endl;
+	return false;
+#endif
+}
+
+void shader_watcher::stop()
+{
+#ifdef __linux__
+	if (thread.joinable()) {
+		// Wake the thread up from poll() and wait for it.
+		if (write(wake_pipe[1], "", 1) == 1)
+			thread.join();
+		else
+			thread.detach();
+	}
+
+	for (int *fd : { &inotify_fd, &wake_pipe[0], &wake_pipe[1] }) {
+		if (*fd != -1)
+			close(*fd);
+
+		*fd = -1;
+	}
+#endif
+
+	for (auto &s : stages)
+		glDeleteShader(s.second);
+
+	stages.clear();
+	programs.clear();
+}
+
+void shader_watcher::add_program(GLuint *program,
+				const char *vs_filename,
+				const char *fs_filename,
+				relink_callback on_relink)
+{
+	watched_program p;
+	p.program = program;
+	p.vs_filename = vs_filename;
+	p.fs_filename = fs_filename;
+	p.on_relink = on_relink;
+
+	// Only needed for the list of included files.
+	std::string source;
+	preprocess_shader(vs_filename, {}, source, &p.vs_files);
+	preprocess_shader(fs_filename, {}, source, &p.fs_files);
+	programs.push_back(p);
+}
+
+//
+// Watcher thread: block on inotify and forward writes as SDL events.
+// SDL_PushEvent is safe to call from any thread.
+//
+void shader_watcher::watch()
+{
+#ifdef __linux__
+	alignas(struct inotify_event) char buf[4096];
+	while (true) {
+		struct pollfd fds[2] = {
+			{ inotify_fd, POLLIN, 0 },
+			{ wake_pipe[0], POLLIN, 0 }
+		};
+
+		if (poll(fds, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		// stop() was called.
+		if (fds[1].revents != 0)
+			return;
+
+		ssize_t len = read(inotify_fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if (len == -1 && errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		for (char *p = buf; p < buf + len; ) {
+			const struct inotify_event *ie =
+				reinterpret_cast<struct inotify_event *>(p);
+
+			if (ie->len > 0) {
+				SDL_Event ev;
+				memset(&ev, 0, sizeof(ev));
+				ev.type = event_type;
+				ev.user.data1 = new std::string(directory + "/" +
+								ie->name);
+
+				if (SDL_PushEvent(&ev) <= 0) {
+					delete static_cast<std::string *>(
+							ev.user.data1);
+				}
+			}
+
+			p += sizeof(struct inotify_event) + ie->len;
+		}
+	}
+#endif
+}
+
+bool shader_watcher::handle_event(const SDL_Event &ev)
+{
+	if (!is_change(ev))
+		return false;
+
+	std::string *filename = static_cast<std::string *>(ev.user.data1);
+	reload(*filename);
+	delete filename;
+
+	return true;
+}
+
+void shader_watcher::discard_event(const SDL_Event &ev) const
+{
+	// The filename was allocated by watch().
+	if (is_change(ev))
+		delete static_cast<std::string *>(ev.user.data1);
+}
+
+//
+// Recompile the stages that read filename and relink their programs.
+//
+void shader_watcher::reload(const std::string &filename)
+{
+	// Which stages read filename, decided before any of them is rebuilt:
+	// a rebuild refreshes the file lists of every program sharing the
+	// stage, and a program must be relinked even if the new version of
+	// its stage no longer reads filename.
+	std::vector<std::pair<bool, bool>> changed;
+	for (const watched_program &p : programs) {
+		bool vs_changed = std::count(p.vs_files.begin(),
+					p.vs_files.end(),
+					filename) != 0;
+
+		bool fs_changed = std::count(p.fs_files.begin(),
+					p.fs_files.end(),
+					filename) != 0;
+
+		changed.emplace_back(vs_changed, fs_changed);
+	}
+
+	// Stages shared between programs are only compiled once.
+	std::map<std::string, bool> rebuilt;
+	for (size_t i = 0; i < programs.size(); ++i) {
+		watched_program &p = programs[i];
+		bool vs_changed = changed[i].first;
+		bool fs_changed = changed[i].second;
+		if (!vs_changed && !fs_changed)
+			continue;
+
+		if (vs_changed && !rebuild(p.vs_filename, GL_VERTEX_SHADER,
+					rebuilt)) {
+
+			continue;
+		}
+
+		if (fs_changed && !rebuild(p.fs_filename, GL_FRAGMENT_SHADER,
+					rebuilt)) {
+
+			continue;
+		}
+
+		relink(p);
+	}
+}
+
+//
+// Compile a new version of one stage, keeping the old one on errors.
+// Once the stage has been read, the file lists of every program using it
+// are refreshed, so includes added or removed are watched from then on.
+//
+bool shader_watcher::rebuild(const std::string &filename,
+				GLenum type,
+				std::map<std::string, bool> &rebuilt)
+{
+	auto done = rebuilt.find(filename);
+	if (done != rebuilt.end())
+		return done->second;
+
+	std::string source;
+	std::vector<std::string> files;
+	GLuint res = 0;
+	if (preprocess_shader(filename.c_str(), {}, source, &files)) {
+		for (watched_program &p : programs) {
+			if (p.vs_filename == filename)
+				p.vs_files = files;
+
+			if (p.fs_filename == filename)
+				p.fs_files = files;
+		}
+
+		asset_view view = { source.data(), source.size() };
+		res = compile_shader(filename.c_str(), view, type);
+	}
+
+	rebuilt[filename] = res != 0;
+	if (res == 0) {
+		cerr << "Keeping the previous program after errors in "
+			<< filename << endl;
+
+		return false;
+	}
+
+	GLuint &old = stages[filename];
+	glDeleteShader(old);
+	old = res;
+
+	return true;
+}
+
+//
+// Link a new program for p and swap it in only if everything succeeded.
+//
+void shader_watcher::relink(watched_program &p)
+{
+	GLuint vs = stage(p.vs_filename, GL_VERTEX_SHADER);
+	GLuint fs = stage(p.fs_filename, GL_FRAGMENT_SHADER);
+	if (vs == 0 || fs == 0)
+		return;
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+	glDetachShader(program, vs);
+	glDetachShader(program, fs);
+
+	GLint link_ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+	if (link_ok == GL_FALSE) {
+		cerr << "glLinkProgram: ";
+		print_log(program);
+		glDeleteProgram(program);
+		return;
+	}
+
+	if (!p.on_relink(program)) {
+		cerr << "Keeping the previous program for " << p.vs_filename
+			<< " and " << p.fs_filename << endl;
+
+		glDeleteProgram(program);
+		return;
+	}
+
+	glDeleteProgram(*p.program);
+	*p.program = program;
+	cout << "Reloaded " << p.vs_filename << " and " << p.fs_filename
+		<< endl;
+}
+
+//
+// Compiled stage for filename. The unchanged stage of a program is only
+// compiled the first time its partner is edited.
+//
+GLuint shader_watcher::stage(const std::string &filename, GLenum type)
+{
+	GLuint &res = stages[filename];
+	if (res == 0)
+		res = create_shader(filename.c_str(), type);
+
+	return res;
+}
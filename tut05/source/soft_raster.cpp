@@ -0,0 +1,660 @@
+//
+// Source implementation file for the software rasterizer.
+//
+
+#include "../include/soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__)
+#define RASTER_SSE
+#include <emmintrin.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+// Constants.
+const int TILE_SIZE = 64;
+// Positions snap to 1 / SUBPIXELS of a pixel, as GL's usually do.
+const double SUBPIXELS = 256.0;
+// Triangles reaching this many viewports out to a side are clipped there,
+// so that pixel coordinates stay small enough for float edge functions.
+const float GUARD_BAND = 4.0f;
+// Near, far and the four guard band planes, as dot(plane, clip) >= 0.
+const int CLIP_PLANES = 6;
+const glm::vec4 CLIP_PLANE[CLIP_PLANES] = {
+	glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+	glm::vec4(0.0f, 0.0f, -1.0f, 1.0f),
+	glm::vec4(1.0f, 0.0f, 0.0f, GUARD_BAND),
+	glm::vec4(-1.0f, 0.0f, 0.0f, GUARD_BAND),
+	glm::vec4(0.0f, 1.0f, 0.0f, GUARD_BAND),
+	glm::vec4(0.0f, -1.0f, 0.0f, GUARD_BAND)
+};
+// Each plane can add a corner to the triangle.
+const int MAX_CORNERS = 3 + CLIP_PLANES;
+
+//
+// Attribute i of a vertex array laid out as glVertexAttribPointer takes it.
+//
+const GLfloat *fetch(const GLfloat *base, GLsizei stride, GLint size,
+		GLuint i)
+{
+	size_t step = stride != 0 ? stride : size * sizeof(GLfloat);
+	return (const GLfloat *)((const char *)base + i * step);
+}
+
+//
+// Clip the polygon of count corners to the side of plane where the dot
+// product is positive, as Sutherland-Hodgman does. Returns the corners
+// left, at most one more than given.
+//
+int clip_polygon(const glm::vec4 &plane, int count,
+		const glm::vec4 *position, const glm::vec3 *color,
+		glm::vec4 *clipped_position, glm::vec3 *clipped_color)
+{
+	int kept = 0;
+	for (int i = 0; i < count; ++i) {
+		int j = (i + 1) % count;
+		float di = glm::dot(plane, position[i]);
+		float dj = glm::dot(plane, position[j]);
+		if (di >= 0.0f) {
+			clipped_position[kept] = position[i];
+			clipped_color[kept] = color[i];
+			++kept;
+		}
+
+		if ((di >= 0.0f) != (dj >= 0.0f)) {
+			float t = di / (di - dj);
+			clipped_position[kept] = glm::mix(position[i],
+							position[j], t);
+
+			clipped_color[kept] = glm::mix(color[i], color[j], t);
+			++kept;
+		}
+	}
+
+	return kept;
+}
+
+//
+// A color as it is stored, RGBA bytes in memory order.
+//
+GLuint pack_color(float r, float g, float b, float a)
+{
+	float channels[4] = { r, g, b, a };
+	GLubyte bytes[4];
+	for (int i = 0; i < 4; ++i) {
+		float c = std::min(std::max(channels[i], 0.0f), 1.0f);
+		bytes[i] = (GLubyte)(c * 255.0f + 0.5f);
+	}
+
+	GLuint word;
+	memcpy(&word, bytes, sizeof(word));
+
+	return word;
+}
+
+// End of anon namespace.
+}
+
+soft_raster::soft_raster()
+	: width(0), height(0), tiles_x(0), tiles_y(0), depth_test(false),
+	blend(false), queued(0), total_triangles(0), frames(0), seconds(0.0),
+	bins(1),
+	next_tile(0)
+{
+}
+
+soft_raster::~soft_raster()
+{
+	stop();
+}
+
+void soft_raster::start(int threads)
+{
+	stop();
+	pool.start(threads);
+	bins.resize(pool.threads());
+}
+
+void soft_raster::resize(int new_width, int new_height)
+{
+	if (new_width == width && new_height == height)
+		return;
+
+	width = new_width;
+	height = new_height;
+	tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	color.assign(width * height, 0);
+	depth.assign(width * height, 1.0f);
+}
+
+void soft_raster::clear(float r, float g, float b, float a)
+{
+	std::fill(color.begin(), color.end(), pack_color(r, g, b, a));
+	std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void soft_raster::draw(const soft_mesh &mesh, const glm::mat4 &mvp,
+		float alpha)
+{
+	if (mesh.count < 3)
+		return;
+
+	commands.push_back({mesh, mvp, alpha, depth_test, blend, queued});
+	queued += mesh.count / 3;
+}
+
+void soft_raster::finish()
+{
+	if (queued > 0 && tiles_x > 0 && tiles_y > 0) {
+		std::chrono::steady_clock::time_point begin =
+			std::chrono::steady_clock::now();
+
+		pool.run([this](int worker) { setup_pass(worker); });
+		next_tile = 0;
+		pool.run([this](int worker) { raster_pass(worker); });
+
+		seconds += std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - begin).count();
+
+		for (const worker_bins &mine : bins)
+			total_triangles += mine.triangles.size();
+	}
+
+	commands.clear();
+	queued = 0;
+	++frames;
+}
+
+const GLubyte *soft_raster::pixels() const
+{
+	return (const GLubyte *)color.data();
+}
+
+void soft_raster::print_report() const
+{
+	cout << "Software raster: " << total_triangles << " triangles in "
+		<< frames << " frames on " << threads() << " thread(s)"
+#ifdef RASTER_SSE
+		<< ", SSE"
+#endif
+		<< ", " << (seconds > 0.0 ? total_triangles / seconds : 0.0)
+		<< " triangles/s" << endl;
+}
+
+void soft_raster::stop()
+{
+	pool.stop();
+	bins.resize(1);
+}
+
+//
+// First pass: set up this worker's share of the frame's triangles, which
+// is contiguous so that the bins keep the order they were drawn in.
+//
+void soft_raster::setup_pass(int worker)
+{
+	worker_bins &mine = bins[worker];
+	mine.triangles.clear();
+	mine.tiles.resize(tiles_x * tiles_y);
+	for (std::vector<GLuint> &tile : mine.tiles)
+		tile.clear();
+
+	size_t begin = queued * worker / bins.size();
+	size_t end = queued * (worker + 1) / bins.size();
+	if (begin == end)
+		return;
+
+	// Last command starting at or before begin.
+	std::vector<command>::const_iterator draw = std::upper_bound(
+		commands.begin(), commands.end(), begin,
+		[](size_t triangle, const command &c) {
+			return triangle < c.first;
+		}) - 1;
+
+	for (size_t triangle = begin; triangle < end; ++triangle) {
+		while (triangle >= draw->first + draw->mesh.count / 3)
+			++draw;
+
+		setup_triangle(*draw, triangle - draw->first, mine);
+	}
+}
+
+//
+// Second pass: rasterize whole tiles, taking every worker's bins in
+// worker order, which is submission order.
+//
+void soft_raster::raster_pass(int)
+{
+	int tiles = tiles_x * tiles_y;
+	for (int tile = next_tile++; tile < tiles; tile = next_tile++) {
+		int x0 = tile % tiles_x * TILE_SIZE;
+		int y0 = tile / tiles_x * TILE_SIZE;
+		int x1 = std::min(x0 + TILE_SIZE, width) - 1;
+		int y1 = std::min(y0 + TILE_SIZE, height) - 1;
+		for (const worker_bins &theirs : bins) {
+			for (GLuint i : theirs.tiles[tile]) {
+				raster_triangle(theirs.triangles[i], x0, y0,
+						x1, y1);
+			}
+		}
+	}
+}
+
+//
+// Run the vertex stage on one triangle of a draw, clipping it where it
+// leaves the near or far plane or the guard band.
+//
+void soft_raster::setup_triangle(const command &draw, size_t triangle,
+		worker_bins &mine)
+{
+	const soft_mesh &mesh = draw.mesh;
+	glm::vec4 position[MAX_CORNERS];
+	glm::vec3 corner_color[MAX_CORNERS];
+	bool inside = true;
+	for (int k = 0; k < 3; ++k) {
+		GLuint i = triangle * 3 + k;
+		if (mesh.indices != nullptr)
+			i = mesh.indices[i];
+
+		const GLfloat *p = fetch(mesh.positions, mesh.position_stride,
+					mesh.position_size, i);
+
+		const GLfloat *c = fetch(mesh.colors, mesh.color_stride, 3, i);
+		float z = mesh.position_size > 2 ? p[2] : 0.0f;
+		position[k] = draw.mvp * glm::vec4(p[0], p[1], z, 1.0f);
+		corner_color[k] = glm::vec3(c[0], c[1], c[2]);
+		for (int plane = 0; plane < CLIP_PLANES; ++plane) {
+			if (glm::dot(CLIP_PLANE[plane], position[k]) < 0.0f)
+				inside = false;
+		}
+	}
+
+	if (inside) {
+		add_triangle(position, corner_color, draw, mine);
+		return;
+	}
+
+	int corners = 3;
+	for (int plane = 0; plane < CLIP_PLANES && corners > 0; ++plane) {
+		glm::vec4 clipped_position[MAX_CORNERS];
+		glm::vec3 clipped_color[MAX_CORNERS];
+		corners = clip_polygon(CLIP_PLANE[plane], corners, position,
+					corner_color, clipped_position,
+					clipped_color);
+
+		std::copy(clipped_position, clipped_position + corners,
+			position);
+
+		std::copy(clipped_color, clipped_color + corners,
+			corner_color);
+	}
+
+	// What is left is convex, so a fan around the first corner.
+	for (int k = 1; k + 1 < corners; ++k) {
+		glm::vec4 fan_position[3] = {
+			position[0], position[k], position[k + 1]
+		};
+		glm::vec3 fan_color[3] = {
+			corner_color[0], corner_color[k], corner_color[k + 1]
+		};
+
+		add_triangle(fan_position, fan_color, draw, mine);
+	}
+}
+
+//
+// Project a clipped triangle to pixels, set up its edges and planes, and
+// bin it into every tile it may touch.
+//
+void soft_raster::add_triangle(const glm::vec4 *clip,
+		const glm::vec3 *corner_color, const command &draw,
+		worker_bins &mine)
+{
+	// Per corner: x, y, then the plane values z, 1 / w, r, g, b / w.
+	double x[3], y[3], values[5][3];
+	for (int k = 0; k < 3; ++k) {
+		// Only a corner touching every clip plane can have w at 0.
+		if (clip[k].w <= 0.0f)
+			return;
+
+		double inverse_w = 1.0 / clip[k].w;
+		double ndc_x = clip[k].x * inverse_w;
+		double ndc_y = clip[k].y * inverse_w;
+		x[k] = std::floor((ndc_x * 0.5 + 0.5) * width * SUBPIXELS +
+				0.5) / SUBPIXELS;
+
+		y[k] = std::floor((ndc_y * 0.5 + 0.5) * height * SUBPIXELS +
+				0.5) / SUBPIXELS;
+
+		values[0][k] = clip[k].z * inverse_w * 0.5 + 0.5;
+		values[1][k] = inverse_w;
+		for (int c = 0; c < 3; ++c)
+			values[2 + c][k] = corner_color[k][c] * inverse_w;
+	}
+
+	// Both windings are drawn, counter-clockwise from here on.
+	double area = (x[1] - x[0]) * (y[2] - y[0]) -
+		(y[1] - y[0]) * (x[2] - x[0]);
+
+	if (area == 0.0)
+		return;
+
+	if (area < 0.0) {
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		for (int p = 0; p < 5; ++p)
+			std::swap(values[p][1], values[p][2]);
+
+		area = -area;
+	}
+
+	setup triangle;
+	double left = std::min(std::min(x[0], x[1]), x[2]);
+	double right = std::max(std::max(x[0], x[1]), x[2]);
+	double bottom = std::min(std::min(y[0], y[1]), y[2]);
+	double top = std::max(std::max(y[0], y[1]), y[2]);
+	triangle.min_x = std::max(0, (int)std::floor(left));
+	triangle.min_y = std::max(0, (int)std::floor(bottom));
+	triangle.max_x = std::min(width - 1, (int)std::ceil(right));
+	triangle.max_y = std::min(height - 1, (int)std::ceil(top));
+
+	if (triangle.min_x > triangle.max_x ||
+		triangle.min_y > triangle.max_y) {
+
+		return;
+	}
+
+	// Edge i runs between the other two corners and is zero there, so
+	// edge i over the area is the weight of corner i.
+	double edge[3][3];
+	for (int i = 0; i < 3; ++i) {
+		int j = (i + 1) % 3, k = (i + 2) % 3;
+		double a = y[j] - y[k];
+		double b = x[k] - x[j];
+		double c = x[j] * y[k] - x[k] * y[j];
+		triangle.top_left[i] = a > 0.0 || (a == 0.0 && b < 0.0);
+		edge[i][0] = a;
+		edge[i][1] = b;
+		edge[i][2] = c + 0.5 * a + 0.5 * b;
+		for (int e = 0; e < 3; ++e)
+			triangle.edge[i][e] = edge[i][e];
+	}
+
+	for (int p = 0; p < 5; ++p) {
+		for (int e = 0; e < 3; ++e) {
+			double sum = 0.0;
+			for (int i = 0; i < 3; ++i)
+				sum += values[p][i] * edge[i][e];
+
+			triangle.plane[p][e] = sum / area;
+		}
+	}
+
+	triangle.alpha = draw.alpha;
+	triangle.depth_test = draw.depth_test;
+	triangle.blend = draw.blend;
+
+	GLuint index = mine.triangles.size();
+	mine.triangles.push_back(triangle);
+	for (int ty = triangle.min_y / TILE_SIZE;
+		ty <= triangle.max_y / TILE_SIZE; ++ty) {
+
+		for (int tx = triangle.min_x / TILE_SIZE;
+			tx <= triangle.max_x / TILE_SIZE; ++tx) {
+
+			// Skip the tile if its corner furthest inside an edge
+			// is still outside it, by more than a pixel so that
+			// rounding the edges to float can't lose any.
+			bool touches = true;
+			for (int i = 0; i < 3 && touches; ++i) {
+				double a = edge[i][0], b = edge[i][1];
+				int px = tx * TILE_SIZE +
+					(a > 0.0 ? TILE_SIZE - 1 : 0);
+				int py = ty * TILE_SIZE +
+					(b > 0.0 ? TILE_SIZE - 1 : 0);
+				touches = a * px + b * py + edge[i][2] >=
+					-(std::fabs(a) + std::fabs(b));
+			}
+
+			if (touches)
+				mine.tiles[ty * tiles_x + tx].push_back(index);
+		}
+	}
+}
+
+#ifdef RASTER_SSE
+
+//
+// Rasterize the part of a triangle inside the tile x0..x1, y0..y1, four
+// pixels of a row at a time. Groups start on multiples of four, so only
+// the last one of a row on an image whose width isn't one can stick out
+// of the tile; that one goes through a copy, as the pixels past the edge
+// belong to another tile.
+//
+void soft_raster::raster_triangle(const setup &triangle, int x0, int y0,
+		int x1, int y1)
+{
+	int tile_x1 = x1;
+	x0 = std::max(x0, triangle.min_x) & ~3;
+	y0 = std::max(y0, triangle.min_y);
+	x1 = std::min(x1, triangle.max_x);
+	y1 = std::min(y1, triangle.max_y);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 last_x = _mm_set1_ps((float)tile_x1);
+	const __m128 alpha = _mm_set1_ps(triangle.alpha);
+	const __m128 keep = _mm_sub_ps(one, alpha);
+	const __m128 unorm = _mm_set1_ps(255.0f);
+	const __m128i byte = _mm_set1_epi32(0xff);
+
+	__m128 edge_a[3], top_left[3], plane_a[5];
+	for (int i = 0; i < 3; ++i) {
+		edge_a[i] = _mm_set1_ps(triangle.edge[i][0]);
+		top_left[i] = _mm_castsi128_ps(_mm_set1_epi32(
+					triangle.top_left[i] ? -1 : 0));
+	}
+
+	for (int p = 0; p < 5; ++p)
+		plane_a[p] = _mm_set1_ps(triangle.plane[p][0]);
+
+	for (int y = y0; y <= y1; ++y) {
+		__m128 edge_row[3], plane_row[5];
+		for (int i = 0; i < 3; ++i) {
+			edge_row[i] = _mm_set1_ps(triangle.edge[i][1] * y +
+						triangle.edge[i][2]);
+		}
+
+		for (int p = 0; p < 5; ++p) {
+			plane_row[p] = _mm_set1_ps(triangle.plane[p][1] * y +
+						triangle.plane[p][2]);
+		}
+
+		GLuint *color_row = &color[y * width];
+		GLfloat *depth_row = &depth[y * width];
+		for (int x = x0; x <= x1; x += 4) {
+			__m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128 mask = _mm_cmple_ps(xs, last_x);
+			for (int i = 0; i < 3; ++i) {
+				__m128 e = _mm_add_ps(_mm_mul_ps(edge_a[i], xs),
+						edge_row[i]);
+
+				__m128 on_edge = _mm_and_ps(
+						_mm_cmpeq_ps(e, zero),
+						top_left[i]);
+
+				mask = _mm_and_ps(mask, _mm_or_ps(
+						_mm_cmpgt_ps(e, zero),
+						on_edge));
+			}
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			// Depth range clipping, then the depth test.
+			__m128 z = _mm_add_ps(_mm_mul_ps(plane_a[0], xs),
+					plane_row[0]);
+
+			mask = _mm_and_ps(mask, _mm_and_ps(
+					_mm_cmpge_ps(z, zero),
+					_mm_cmple_ps(z, one)));
+
+			GLuint *pixel = &color_row[x];
+			GLfloat *z_buffer = &depth_row[x];
+			int spilled = std::min(4, tile_x1 - x + 1);
+			alignas(16) GLuint spill_color[4] = { 0, 0, 0, 0 };
+			alignas(16) GLfloat spill_depth[4] = { 0, 0, 0, 0 };
+			if (spilled < 4) {
+				std::copy(pixel, pixel + spilled, spill_color);
+				std::copy(z_buffer, z_buffer + spilled,
+					spill_depth);
+
+				pixel = spill_color;
+				z_buffer = spill_depth;
+			}
+
+			if (triangle.depth_test) {
+				__m128 old = _mm_loadu_ps(z_buffer);
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old));
+				_mm_storeu_ps(z_buffer, _mm_or_ps(
+						_mm_and_ps(mask, z),
+						_mm_andnot_ps(mask, old)));
+			}
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			// Perspective correct color, over w and back.
+			__m128 w = _mm_div_ps(one, _mm_add_ps(
+					_mm_mul_ps(plane_a[1], xs),
+					plane_row[1]));
+
+			__m128 channel[4];
+			for (int c = 0; c < 3; ++c) {
+				channel[c] = _mm_mul_ps(w, _mm_add_ps(
+						_mm_mul_ps(plane_a[2 + c], xs),
+						plane_row[2 + c]));
+			}
+
+			channel[3] = alpha;
+
+			__m128i old = _mm_loadu_si128((const __m128i *)pixel);
+			if (triangle.blend) {
+				for (int c = 0; c < 4; ++c) {
+					__m128 dst = _mm_div_ps(_mm_cvtepi32_ps(
+						_mm_and_si128(_mm_srli_epi32(
+							old, 8 * c), byte)),
+						unorm);
+
+					channel[c] = _mm_add_ps(
+						_mm_mul_ps(channel[c], alpha),
+						_mm_mul_ps(dst, keep));
+				}
+			}
+
+			__m128i packed = _mm_setzero_si128();
+			for (int c = 0; c < 4; ++c) {
+				__m128 v = _mm_min_ps(_mm_max_ps(channel[c],
+							zero), one);
+
+				packed = _mm_or_si128(packed, _mm_slli_epi32(
+						_mm_cvtps_epi32(_mm_mul_ps(v,
+								unorm)),
+						8 * c));
+			}
+
+			__m128i lane_mask = _mm_castps_si128(mask);
+			_mm_storeu_si128((__m128i *)pixel, _mm_or_si128(
+					_mm_and_si128(lane_mask, packed),
+					_mm_andnot_si128(lane_mask, old)));
+
+			if (spilled < 4) {
+				std::copy(spill_color, spill_color + spilled,
+					&color_row[x]);
+
+				std::copy(spill_depth, spill_depth + spilled,
+					&depth_row[x]);
+			}
+		}
+	}
+}
+
+#else
+
+//
+// The same one pixel at a time, for builds without SSE2.
+//
+void soft_raster::raster_triangle(const setup &triangle, int x0, int y0,
+		int x1, int y1)
+{
+	x0 = std::max(x0, triangle.min_x);
+	y0 = std::max(y0, triangle.min_y);
+	x1 = std::min(x1, triangle.max_x);
+	y1 = std::min(y1, triangle.max_y);
+
+	for (int y = y0; y <= y1; ++y) {
+		for (int x = x0; x <= x1; ++x) {
+			bool inside = true;
+			for (int i = 0; i < 3 && inside; ++i) {
+				float e = triangle.edge[i][0] * x +
+					(triangle.edge[i][1] * y +
+						triangle.edge[i][2]);
+
+				inside = e > 0.0f ||
+					(e == 0.0f && triangle.top_left[i]);
+			}
+
+			float value[5];
+			for (int p = 0; p < 5; ++p) {
+				value[p] = triangle.plane[p][0] * x +
+					(triangle.plane[p][1] * y +
+						triangle.plane[p][2]);
+			}
+
+			if (!inside || value[0] < 0.0f || value[0] > 1.0f)
+				continue;
+
+			GLfloat &z = depth[y * width + x];
+			if (triangle.depth_test) {
+				if (!(value[0] < z))
+					continue;
+
+				z = value[0];
+			}
+
+			float w = 1.0f / value[1];
+			float channel[4] = {
+				value[2] * w, value[3] * w, value[4] * w,
+				triangle.alpha
+			};
+
+			GLuint &pixel = color[y * width + x];
+			if (triangle.blend) {
+				GLubyte old[4];
+				memcpy(old, &pixel, sizeof(old));
+				for (int c = 0; c < 4; ++c) {
+					channel[c] = channel[c] *
+						triangle.alpha + old[c] /
+						255.0f * (1.0f -
+							triangle.alpha);
+				}
+			}
+
+			pixel = pack_color(channel[0], channel[1], channel[2],
+					channel[3]);
+		}
+	}
+}
+
+#endif // RASTER_SSE
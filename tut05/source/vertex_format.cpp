@@ -0,0 +1,630 @@
+//
+// Source implementation file for compact vertex formats.
+//
+
+#include "../include/vertex_format.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#if defined(__SSE2__)
+#define VERTEX_FORMAT_SSE
+#include <emmintrin.h>
+#endif
+
+// F16C is picked at run time, the rest of the build doesn't assume it.
+#if defined(VERTEX_FORMAT_SSE) && defined(__GNUC__) && defined(__x86_64__)
+#define VERTEX_FORMAT_F16C
+#include <immintrin.h>
+#endif
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// Anon namespace for internal linkage.
+namespace {
+
+//
+// Totals of every mesh packed, for the report.
+//
+struct packing_stats {
+	int meshes;
+	size_t vertices;
+	size_t float_bytes;
+	size_t packed_bytes;
+	float position_error;
+	float color_error;
+	double ms;
+	const char *last_format;
+};
+
+packing_stats stats = { 0, 0, 0, 0, 0.0f, 0.0f, 0.0, nullptr };
+std::mutex stats_mutex;
+
+const float SNORM16_MAX = 32767.0f;
+// What SNORM16 divides 2c + 1 by before OpenGL 4.2.
+const float SNORM16_RANGE = 65535.0f;
+const float UNORM8_MAX = 255.0f;
+// Half an ulp of a half float, relative to the value.
+const float HALF_ROUNDING = 1.0f / 2048.0f;
+// Half of the smallest half float step, that of denormals.
+const float HALF_DENORMAL_ROUNDING = 1.0f / 33554432.0f;
+// Slack for the float arithmetic of the conversions and of the checks.
+const float ERROR_SLACK = 1.01f;
+
+const GLsizei FLOAT3_BYTES = 3 * sizeof(GLfloat);
+// Three 16-bit values padded to keep every vertex 4 byte aligned.
+const GLsizei SHORT3_BYTES = 4 * sizeof(GLshort);
+const GLsizei UBYTE4_BYTES = 4;
+
+//
+// Round to nearest, ties to even, as the SSE conversions do.
+//
+GLushort float_to_half(float value)
+{
+	Uint32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	GLushort sign = (bits >> 16) & 0x8000;
+	Uint32 magnitude = bits & 0x7fffffff;
+	// Infinities and NaNs, NaNs kept quiet.
+	if (magnitude >= 0x7f800000)
+		return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+
+	// 65520 and up round to infinity.
+	if (magnitude >= 0x477ff000)
+		return sign | 0x7c00;
+
+	// Below 2^-14 the half is denormal, a multiple of 2^-24; scaling by
+	// a power of two is exact, so the rounding is the only one.
+	if (magnitude < 0x38800000) {
+		return sign | (GLushort)std::nearbyint(std::fabs(value) *
+							16777216.0f);
+	}
+
+	// Exponent rebiased from 127 to 15, 23 bits of mantissa rounded to
+	// 10; a carry out of the mantissa steps the exponent as it should.
+	Uint32 rebiased = magnitude - ((127 - 15) << 23);
+	return sign | ((rebiased + 0xfff + ((rebiased >> 13) & 1)) >> 13);
+}
+
+float half_to_float(GLushort half)
+{
+	Uint32 sign = (Uint32)(half & 0x8000) << 16;
+	Uint32 exponent = (half >> 10) & 0x1f;
+	Uint32 mantissa = half & 0x3ff;
+	Uint32 bits;
+	if (exponent == 0) {
+		float magnitude = mantissa / 16777216.0f;
+		memcpy(&bits, &magnitude, sizeof(bits));
+		bits |= sign;
+	} else if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+//
+// out[i] = round((in[i] - offset[i % 3]) * scale[i % 3]), saturated to
+// the range of a short: in is x y z x y z...
+//
+void to_snorm16_scalar(const GLfloat *in, size_t n, const float offset[3],
+		const float scale[3], GLshort *out)
+{
+	for (size_t i = 0; i < n; ++i) {
+		float q = std::nearbyint((in[i] - offset[i % 3]) *
+					scale[i % 3]);
+
+		out[i] = std::max(-32768.0f, std::min(32767.0f, q));
+	}
+}
+
+//
+// out[i] = round(in[i] * 255), clamped to 0..255.
+//
+void to_unorm8_scalar(const GLfloat *in, size_t n, GLubyte *out)
+{
+	for (size_t i = 0; i < n; ++i) {
+		float c = std::max(0.0f, std::min(1.0f, in[i]));
+		out[i] = std::nearbyint(c * UNORM8_MAX);
+	}
+}
+
+void to_half_scalar(const GLfloat *in, size_t n, GLushort *out)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = float_to_half(in[i]);
+}
+
+#ifdef VERTEX_FORMAT_SSE
+
+//
+// The per-axis constants for 12 floats (4 vertices) at a time: lanes of
+// the three registers cycle x y z x, y z x y, z x y z.
+//
+void axis_registers(const float axis[3], __m128 lanes[3])
+{
+	lanes[0] = _mm_setr_ps(axis[0], axis[1], axis[2], axis[0]);
+	lanes[1] = _mm_setr_ps(axis[1], axis[2], axis[0], axis[1]);
+	lanes[2] = _mm_setr_ps(axis[2], axis[0], axis[1], axis[2]);
+}
+
+//
+// As to_snorm16_scalar(), 4 vertices a step; _mm_cvtps_epi32 rounds to
+// nearest even and _mm_packs_epi32 saturates.
+//
+void to_snorm16_sse(const GLfloat *in, size_t n, const float offset[3],
+		const float scale[3], GLshort *out)
+{
+	__m128 offsets[3], scales[3];
+	axis_registers(offset, offsets);
+	axis_registers(scale, scales);
+
+	size_t i = 0;
+	for (; i + 12 <= n; i += 12) {
+		__m128i q[3];
+		for (int k = 0; k < 3; ++k) {
+			__m128 v = _mm_loadu_ps(in + i + 4 * k);
+			v = _mm_mul_ps(_mm_sub_ps(v, offsets[k]), scales[k]);
+			q[k] = _mm_cvtps_epi32(v);
+		}
+
+		_mm_storeu_si128((__m128i *)(out + i),
+				_mm_packs_epi32(q[0], q[1]));
+		_mm_storel_epi64((__m128i *)(out + i + 8),
+				_mm_packs_epi32(q[2], q[2]));
+	}
+
+	to_snorm16_scalar(in + i, n - i, offset, scale, out + i);
+}
+
+//
+// As to_unorm8_scalar(), 12 floats a step.
+//
+void to_unorm8_sse(const GLfloat *in, size_t n, GLubyte *out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 unorm8_max = _mm_set1_ps(UNORM8_MAX);
+
+	size_t i = 0;
+	for (; i + 12 <= n; i += 12) {
+		__m128i q[3];
+		for (int k = 0; k < 3; ++k) {
+			__m128 c = _mm_loadu_ps(in + i + 4 * k);
+			c = _mm_max_ps(zero, _mm_min_ps(one, c));
+			q[k] = _mm_cvtps_epi32(_mm_mul_ps(c, unorm8_max));
+		}
+
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]),
+						_mm_packs_epi32(q[2], q[2]));
+
+		// 12 of the 16 bytes are ours.
+		_mm_storel_epi64((__m128i *)(out + i), bytes);
+		int last = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+		memcpy(out + i + 8, &last, 4);
+	}
+
+	to_unorm8_scalar(in + i, n - i, out + i);
+}
+
+#endif // VERTEX_FORMAT_SSE
+
+#ifdef VERTEX_FORMAT_F16C
+
+//
+// 4 floats a step with the F16C conversion, rounding to nearest even.
+//
+__attribute__((target("f16c")))
+void to_half_f16c(const GLfloat *in, size_t n, GLushort *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i half = _mm_cvtps_ph(_mm_loadu_ps(in + i), 0);
+		_mm_storel_epi64((__m128i *)(out + i), half);
+	}
+
+	to_half_scalar(in + i, n - i, out + i);
+}
+
+bool has_f16c()
+{
+	static bool f16c = __builtin_cpu_supports("f16c");
+	return f16c;
+}
+
+#endif // VERTEX_FORMAT_F16C
+
+void to_snorm16(const GLfloat *in, size_t n, const float offset[3],
+		const float scale[3], GLshort *out)
+{
+#ifdef VERTEX_FORMAT_SSE
+	to_snorm16_sse(in, n, offset, scale, out);
+#else
+	to_snorm16_scalar(in, n, offset, scale, out);
+#endif
+}
+
+void to_unorm8(const GLfloat *in, size_t n, GLubyte *out)
+{
+#ifdef VERTEX_FORMAT_SSE
+	to_unorm8_sse(in, n, out);
+#else
+	to_unorm8_scalar(in, n, out);
+#endif
+}
+
+void to_half(const GLfloat *in, size_t n, GLushort *out)
+{
+#ifdef VERTEX_FORMAT_F16C
+	if (has_f16c()) {
+		to_half_f16c(in, n, out);
+		return;
+	}
+#endif
+
+	to_half_scalar(in, n, out);
+}
+
+GLsizei position_bytes(position_format format)
+{
+	return format == POSITION_FLOAT ? FLOAT3_BYTES : SHORT3_BYTES;
+}
+
+GLsizei color_bytes(color_format format)
+{
+	return format == COLOR_FLOAT ? FLOAT3_BYTES : UBYTE4_BYTES;
+}
+
+//
+// Copy count elements of size bytes from a packed array into every
+// vertex, at offset.
+//
+void interleave(const void *elements, size_t size, size_t count,
+		packed_mesh &packed, size_t offset)
+{
+	const GLubyte *in = (const GLubyte *)elements;
+	GLubyte *out = packed.vertices.data() + offset;
+	for (size_t v = 0; v < count; ++v) {
+		memcpy(out, in, size);
+		in += size;
+		out += packed.stride;
+	}
+}
+
+//
+// Decode every position the way GL will, and return the largest error
+// over the allowed one, below 1 when all are within it. SNORM16 is
+// decoded both ways GL has defined it: max(c / 32767, -1) from 4.2 on,
+// within half a step of the source, and (2c + 1) / 65535 before, which
+// lands up to one step further off and gets that much more.
+//
+float check_positions(const mesh_view &mesh, const packed_mesh &packed,
+		const float offset[3], const float step[3], float &largest)
+{
+	float worst = 0.0f;
+	largest = 0.0f;
+	const GLubyte *vertex = packed.vertices.data() + packed.position.offset;
+	for (GLuint v = 0; v < mesh.vertices; ++v, vertex += packed.stride) {
+		for (int a = 0; a < 3; ++a) {
+			float source = mesh.positions[3 * v + a];
+			double decoded, older = 0.0;
+			float bound, older_bound = 0.0f;
+			if (packed.position.type == GL_SHORT) {
+				GLshort q;
+				memcpy(&q, vertex + a * sizeof(q), sizeof(q));
+				decoded = offset[a] + (double)step[a] *
+					std::max((float)q, -SNORM16_MAX);
+
+				older = offset[a] + (double)step[a] *
+					SNORM16_MAX * (2.0 * q + 1.0) /
+					SNORM16_RANGE;
+
+				bound = 0.5f * step[a];
+				older_bound = 1.5f * step[a];
+			} else {
+				GLushort half;
+				memcpy(&half, vertex + a * sizeof(half),
+					sizeof(half));
+
+				decoded = half_to_float(half);
+				bound = std::max(std::fabs(source) * HALF_ROUNDING,
+						HALF_DENORMAL_ROUNDING);
+			}
+
+			float error = std::fabs(decoded - source);
+			float over = error / bound;
+			if (older_bound > 0.0f) {
+				float older_error = std::fabs(older - source);
+				error = std::max(error, older_error);
+				over = std::max(over,
+						older_error / older_bound);
+			}
+
+			// NaN never compares below the bound either.
+			if (!(over <= ERROR_SLACK))
+				return over;
+
+			largest = std::max(largest, error);
+			worst = std::max(worst, over);
+		}
+	}
+
+	return worst;
+}
+
+float check_colors(const mesh_view &mesh, const packed_mesh &packed,
+		float &largest)
+{
+	const float bound = 0.5f / UNORM8_MAX;
+	float worst = 0.0f;
+	largest = 0.0f;
+	const GLubyte *vertex = packed.vertices.data() + packed.color.offset;
+	for (GLuint v = 0; v < mesh.vertices; ++v, vertex += packed.stride) {
+		for (int c = 0; c < 3; ++c) {
+			float source = mesh.colors[3 * v + c];
+			float error = std::fabs(vertex[c] / UNORM8_MAX - source);
+			if (!(error <= bound * ERROR_SLACK))
+				return error / bound;
+
+			largest = std::max(largest, error);
+			worst = std::max(worst, error / bound);
+		}
+	}
+
+	return worst;
+}
+
+float sign_not_zero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// End of anon namespace.
+}
+
+bool parse_vertex_format(const char *name, vertex_format &format)
+{
+	if (strcmp(name, "float") == 0) {
+		format = FLOAT_VERTEX_FORMAT;
+	} else if (strcmp(name, "half") == 0) {
+		format.position = POSITION_HALF;
+		format.color = COLOR_UNORM8;
+	} else if (strcmp(name, "snorm16") == 0) {
+		format = COMPACT_VERTEX_FORMAT;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+const char *vertex_format_name(const vertex_format &format)
+{
+	switch (format.position) {
+	case POSITION_HALF:
+		return "half";
+	case POSITION_SNORM16:
+		return "snorm16";
+	default:
+		return "float";
+	}
+}
+
+GLsizei vertex_format_stride(const vertex_format &format)
+{
+	return position_bytes(format.position) + color_bytes(format.color);
+}
+
+bool vertex_format_supported(const vertex_format &format)
+{
+	if (format.position == POSITION_HALF)
+		return GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex;
+
+	return true;
+}
+
+bool pack_vertices(const mesh_view &mesh, const vertex_format &format,
+		packed_mesh &packed)
+{
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	size_t n = 3 * (size_t)mesh.vertices;
+	packed.stride = vertex_format_stride(format);
+	packed.vertices.assign((size_t)packed.stride * mesh.vertices, 0);
+	packed.dequantize = glm::mat4(1.0f);
+	packed.position_error = 0.0f;
+	packed.color_error = 0.0f;
+
+	packed.position = FLOAT3_LAYOUT;
+	packed.position.stride = packed.stride;
+	packed.color = FLOAT3_LAYOUT;
+	packed.color.stride = packed.stride;
+	packed.color.offset = position_bytes(format.position);
+
+	// Positions, then the bounds they are checked against.
+	float offset[3] = { 0.0f, 0.0f, 0.0f };
+	float step[3] = { 1.0f, 1.0f, 1.0f };
+	if (format.position == POSITION_SNORM16) {
+		glm::vec3 low(0.0f), high(0.0f);
+		for (GLuint v = 0; v < mesh.vertices; ++v) {
+			for (int a = 0; a < 3; ++a) {
+				float p = mesh.positions[3 * v + a];
+				low[a] = v == 0 ? p : std::min(low[a], p);
+				high[a] = v == 0 ? p : std::max(high[a], p);
+			}
+		}
+
+		// -1..1 covers the box exactly; a flat axis keeps a unit scale.
+		float scale[3];
+		glm::vec3 half_extent;
+		for (int a = 0; a < 3; ++a) {
+			offset[a] = 0.5f * (low[a] + high[a]);
+			half_extent[a] = 0.5f * (high[a] - low[a]);
+			if (half_extent[a] <= 0.0f)
+				half_extent[a] = 1.0f;
+
+			scale[a] = SNORM16_MAX / half_extent[a];
+			step[a] = half_extent[a] / SNORM16_MAX;
+		}
+
+		std::vector<GLshort> quantized(n);
+		to_snorm16(mesh.positions, n, offset, scale, quantized.data());
+		for (GLuint v = 0; v < mesh.vertices; ++v) {
+			memcpy(&packed.vertices[(size_t)v * packed.stride],
+				&quantized[3 * v], 3 * sizeof(GLshort));
+		}
+
+		packed.position.type = GL_SHORT;
+		packed.position.normalized = GL_TRUE;
+		packed.dequantize = glm::scale(glm::translate(glm::mat4(1.0f),
+						glm::vec3(offset[0], offset[1],
+							offset[2])),
+					half_extent);
+	} else if (format.position == POSITION_HALF) {
+		std::vector<GLushort> halves(n);
+		to_half(mesh.positions, n, halves.data());
+		for (GLuint v = 0; v < mesh.vertices; ++v) {
+			memcpy(&packed.vertices[(size_t)v * packed.stride],
+				&halves[3 * v], 3 * sizeof(GLushort));
+		}
+
+		packed.position.type = GL_HALF_FLOAT;
+	} else {
+		interleave(mesh.positions, FLOAT3_BYTES, mesh.vertices, packed, 0);
+	}
+
+	if (format.color == COLOR_UNORM8) {
+		std::vector<GLubyte> bytes(n);
+		to_unorm8(mesh.colors, n, bytes.data());
+		for (GLuint v = 0; v < mesh.vertices; ++v) {
+			GLubyte *color = &packed.vertices[(size_t)v * packed.stride +
+							packed.color.offset];
+			memcpy(color, &bytes[3 * v], 3);
+			color[3] = 255;
+		}
+
+		packed.color.type = GL_UNSIGNED_BYTE;
+		packed.color.normalized = GL_TRUE;
+	} else {
+		interleave(mesh.colors, FLOAT3_BYTES, mesh.vertices, packed,
+			packed.color.offset);
+	}
+
+	// Floats are copied as they are, there is nothing to check.
+	const char *name = vertex_format_name(format);
+	if (format.position != POSITION_FLOAT) {
+		float over = check_positions(mesh, packed, offset, step,
+					packed.position_error);
+		if (!(over <= ERROR_SLACK)) {
+			cerr << "Error: " << name << " positions are off by "
+				<< over << " times the allowed error" << endl;
+
+			return false;
+		}
+	}
+
+	if (format.color == COLOR_UNORM8) {
+		float over = check_colors(mesh, packed, packed.color_error);
+		if (!(over <= ERROR_SLACK)) {
+			cerr << "Error: UNORM8 colors are off by " << over
+				<< " times the allowed error, are they all "
+				<< "in 0..1?" << endl;
+
+			return false;
+		}
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	++stats.meshes;
+	stats.vertices += mesh.vertices;
+	stats.float_bytes += (size_t)2 * FLOAT3_BYTES * mesh.vertices;
+	stats.packed_bytes += packed.vertices.size();
+	stats.position_error = std::max(stats.position_error,
+					packed.position_error);
+	stats.color_error = std::max(stats.color_error, packed.color_error);
+	stats.ms += ms;
+	stats.last_format = name;
+
+	return true;
+}
+
+void encode_octahedral(const glm::vec3 &normal, GLshort encoded[2])
+{
+	// Onto the octahedron |x| + |y| + |z| = 1, whose lower half is then
+	// folded out over the corners of the square.
+	float l1 = std::fabs(normal.x) + std::fabs(normal.y) +
+		std::fabs(normal.z);
+	float x = l1 > 0.0f ? normal.x / l1 : 0.0f;
+	float y = l1 > 0.0f ? normal.y / l1 : 0.0f;
+	if (normal.z < 0.0f) {
+		float folded_x = (1.0f - std::fabs(y)) * sign_not_zero(x);
+		y = (1.0f - std::fabs(x)) * sign_not_zero(y);
+		x = folded_x;
+	}
+
+	const float xy[2] = { x, y };
+	const float none[3] = { 0.0f, 0.0f, 0.0f };
+	const float scale[3] = { SNORM16_MAX, SNORM16_MAX, SNORM16_MAX };
+	to_snorm16_scalar(xy, 2, none, scale, encoded);
+}
+
+glm::vec3 decode_octahedral(const GLshort encoded[2])
+{
+	float x = std::max(encoded[0] / SNORM16_MAX, -1.0f);
+	float y = std::max(encoded[1] / SNORM16_MAX, -1.0f);
+	glm::vec3 normal(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+	if (normal.z < 0.0f) {
+		normal.x = (1.0f - std::fabs(y)) * sign_not_zero(x);
+		normal.y = (1.0f - std::fabs(x)) * sign_not_zero(y);
+	}
+
+	return glm::normalize(normal);
+}
+
+const char *vertex_format_simd_name(const vertex_format &format)
+{
+#ifdef VERTEX_FORMAT_F16C
+	if (format.position == POSITION_HALF)
+		return has_f16c() ? "F16C" : "scalar";
+#endif
+
+#ifdef VERTEX_FORMAT_SSE
+	if (format.position != POSITION_HALF)
+		return "SSE2";
+#endif
+
+	return "scalar";
+}
+
+void print_vertex_format_report()
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	if (stats.vertices == 0 || stats.packed_bytes == 0)
+		return;
+
+	cout << "Vertex format: " << stats.last_format << ", "
+		<< stats.vertices << " vertices in " << stats.meshes
+		<< " mesh(es), " << stats.packed_bytes << " bytes ("
+		<< stats.float_bytes << " as floats, "
+		<< (double)stats.float_bytes / stats.packed_bytes
+		<< "x smaller), max error " << stats.position_error
+		<< " position / " << stats.color_error << " color, "
+		<< stats.ms << " ms" << endl;
+}
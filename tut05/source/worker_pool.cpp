@@ -0,0 +1,95 @@
+//
+// Source implementation file for a pool of worker threads running passes.
+//
+
+#include "../include/worker_pool.h"
+
+#include <algorithm>
+
+worker_pool::worker_pool()
+	: pass(nullptr), generation(0), running(0), stopping(false)
+{
+}
+
+worker_pool::~worker_pool()
+{
+	stop();
+}
+
+void worker_pool::start(int threads)
+{
+	stop();
+	if (threads <= 0)
+		threads = cores();
+
+	for (int i = 1; i < threads; ++i)
+		workers.emplace_back(&worker_pool::work, this, i, generation);
+}
+
+//
+// Hand pass to every worker, run it as worker 0 and wait for the others.
+//
+void worker_pool::run(const std::function<void(int)> &next)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pass = &next;
+		running = workers.size();
+		++generation;
+	}
+
+	started.notify_all();
+	next(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return running == 0; });
+	pass = nullptr;
+}
+
+void worker_pool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	started.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+
+	workers.clear();
+	stopping = false;
+}
+
+int worker_pool::cores()
+{
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//
+// Worker thread: run each new pass, until stopped.
+//
+void worker_pool::work(int worker, unsigned long seen)
+{
+	for (;;) {
+		const std::function<void(int)> *current;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [&] {
+				return stopping || generation != seen;
+			});
+
+			if (stopping)
+				return;
+
+			seen = generation;
+			current = pass;
+		}
+
+		(*current)(worker);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--running == 0)
+			finished.notify_one();
+	}
+}